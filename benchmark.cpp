@@ -0,0 +1,816 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "demosaic.h"
+#include "etc2.h"
+#include "raw_image.h"
+
+#ifdef WITH_PNG
+#include "lodepng.h"
+#include "png_dump.h"
+#include "tiled_image.h"
+#endif
+
+using namespace std;
+
+static const int BenchWidth = 1024;
+static const int BenchHeight = 1024;
+static const int BenchIterations = 20;
+
+void FillNoise(GLfloat* samples, size_t count, unsigned int seed)
+{
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        samples[i] = (seed >> 8) / 16777216.0f;
+    }
+}
+
+void FillNoise(vector<GLfloat>& samples, unsigned int seed)
+{
+    FillNoise(samples.data(), samples.size(), seed);
+}
+
+static void FillNoise(const HostImage& image, unsigned int seed)
+{
+    FillNoise(image.buffer.As<GLfloat>(), image.buffer.Size() / sizeof(GLfloat), seed);
+}
+
+static bool SameImage(const HostImage& a, const HostImage& b)
+{
+    return a.buffer.Size() == b.buffer.Size() && memcmp(a.buffer.Data(), b.buffer.Data(), a.buffer.Size()) == 0;
+}
+
+double TimeDraws(GlWarpEngine& engine, const WarpJob& job, int iterations)
+{
+    engine.Draw(job);
+    glFinish();
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        engine.Draw(job);
+    glFinish();
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void BenchmarkManualBilinear(GlWarpEngine& engine)
+{
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    FillNoise(sourceImage, 1);
+
+    // Rotated and slightly magnified, so fractions cover the whole range
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+
+    const HostImage hardwareImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage manualImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage repeatImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+
+    WarpJob job;
+    job.source = sourceImage.view;
+    job.target = hardwareImage.view;
+    job.mesh = &mesh;
+    job.filter = Filter::Linear;
+    engine.Upload(job);
+
+    job.sampling = Sampling::Hardware;
+    const double hardwareTime = TimeDraws(engine, job, BenchIterations);
+    engine.Readback(job);
+
+    job.sampling = Sampling::Manual;
+    const double manualTime = TimeDraws(engine, job, BenchIterations);
+    job.target = manualImage.view;
+    engine.Readback(job);
+    engine.Draw(job);
+    job.target = repeatImage.view;
+    engine.Readback(job);
+
+    const GLfloat* hardware = hardwareImage.buffer.As<GLfloat>();
+    const GLfloat* manual = manualImage.buffer.As<GLfloat>();
+    float maxDeviation = 0;
+    for (size_t i = 0; i < size_t(4) * BenchWidth * BenchHeight; ++i)
+        maxDeviation = fmaxf(maxDeviation, fabsf(hardware[i] - manual[i]));
+
+    printf("\n**** Bilinear sampling of a %dx%d RGBA32F texture, rotated and scaled ****\n", BenchWidth, BenchHeight);
+    printf("hardware GL_LINEAR: %.3f ms/draw\n", hardwareTime);
+    printf("manual fp32 weights: %.3f ms/draw (%.2fx)\n", manualTime, manualTime / hardwareTime);
+    printf("max deviation: %g, manual repeat is %s\n", maxDeviation, SameImage(manualImage, repeatImage) ? "EQUAL" : "DIFFERENT");
+}
+
+void BenchmarkGather(GlWarpEngine& engine)
+{
+    const HostImage sourceImage = AllocateImage(PixelFormat::R32F, BenchWidth, BenchHeight);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    FillNoise(sourceImage, 2);
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+
+    WarpJob job;
+    job.source = sourceImage.view;
+    job.target = targetImage.view;
+    job.mesh = &mesh;
+    engine.Upload(job);
+
+    printf("\n**** texelFetch against textureGather on a %dx%d R32F texture ****\n", BenchWidth, BenchHeight);
+    const char* names[] = { "linear", "cubic", "min" };
+    const Filter filters[] = { Filter::Linear, Filter::Cubic, Filter::Min };
+    for (int i = 0; i < 3; ++i) {
+        job.filter = filters[i];
+        job.sampling = Sampling::Manual;
+        const double fetchTime = TimeDraws(engine, job, BenchIterations);
+        job.sampling = Sampling::Gather;
+        const double gatherTime = TimeDraws(engine, job, BenchIterations);
+        printf("%s: %.3f ms/draw fetched, %.3f ms/draw gathered (%.2fx)\n", names[i], fetchTime, gatherTime, fetchTime / gatherTime);
+    }
+}
+
+void BenchmarkCpuScaling()
+{
+    const int Size = 2048;
+    const int Iterations = 5;
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA32F, Size, Size);
+    const HostImage referenceImage = AllocateImage(PixelFormat::RGBA32F, Size, Size);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA32F, Size, Size);
+    FillNoise(sourceImage, 4);
+    const WarpMesh mesh = MakeRotationMesh(30, 0.9f);
+
+    WarpJob job;
+    job.source = sourceImage.view;
+    job.mesh = &mesh;
+    job.filter = Filter::Linear;
+
+    printf("\n**** Tiled CPU bilinear remap of a %dx%d RGBA32F texture, rotated ****\n", Size, Size);
+    const unsigned maxThreads = max(1u, thread::hardware_concurrency());
+    double singleTime = 0;
+    for (unsigned threads = 1;; threads = min(threads * 2, maxThreads)) {
+        CpuWarpEngine engine(CpuKernels::Best, threads);
+        job.target = threads == 1 ? referenceImage.view : targetImage.view;
+        engine.Run(job);
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+            engine.Run(job);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        const double time = elapsed.count() / Iterations;
+        if (threads == 1)
+            singleTime = time;
+
+        printf("%s, %2u threads: %8.3f ms/run, %7.1f Mpixel/s (%.2fx)%s\n", CpuWarpEngine::KernelsName(engine.Kernels()), threads,
+            time, Size * double(Size) / time / 1000, singleTime / time,
+            threads == 1 ? "" : SameImage(referenceImage, targetImage) ? ", EQUAL" : ", DIFFERENT");
+
+        if (threads == maxThreads) {
+            const vector<CpuThreadStats>& stats = engine.ThreadStats();
+            for (size_t i = 0; i < stats.size(); ++i) {
+                printf("...thread %2zu: %4zu tiles, %7.1f Mpixel/s\n", i, stats[i].tiles,
+                    stats[i].seconds > 0 ? stats[i].pixels / stats[i].seconds / 1e6 : 0.0);
+            }
+            break;
+        }
+    }
+}
+
+void BenchmarkCpuFormats()
+{
+    const int Iterations = 5;
+    const PixelFormat formats[] = {
+        PixelFormat::R8, PixelFormat::RGB8, PixelFormat::RGBA8, PixelFormat::R16UI,
+        PixelFormat::RGBA16F, PixelFormat::R32F, PixelFormat::RGBA32F
+    };
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    CpuWarpEngine engine(CpuKernels::Best, 1);
+
+    printf("\n**** Single-threaded CPU bilinear remap of a %dx%d texture, rotated ****\n", BenchWidth, BenchHeight);
+    for (auto format : formats) {
+        // Any bit pattern will do for timing, but keep half floats finite
+        const HostImage sourceImage = AllocateImage(format, BenchWidth, BenchHeight);
+        unsigned char* samples = sourceImage.buffer.As<unsigned char>();
+        for (size_t i = 0; i < sourceImage.buffer.Size(); ++i)
+            samples[i] = (unsigned char)(i * 7 % 61);
+
+        WarpJob job;
+        job.source = sourceImage.view;
+        job.target = targetImage.view;
+        job.mesh = &mesh;
+        job.filter = Filter::Linear;
+
+        // Hardware sampling of integer formats takes the fixed-point path,
+        // Manual sampling always runs the fp32 kernels
+        printf("%-8s", FormatName(format));
+        for (auto sampling : { Sampling::Manual, Sampling::Hardware }) {
+            job.sampling = sampling;
+            engine.Run(job);
+            const auto start = chrono::steady_clock::now();
+            for (int i = 0; i < Iterations; ++i)
+                engine.Run(job);
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+            const double time = elapsed.count() / Iterations;
+            printf(" %s %8.3f ms/run, %7.1f Mpixel/s", sampling == Sampling::Manual ? "fp32" : "hw  ",
+                time, BenchWidth * double(BenchHeight) / time / 1000);
+        }
+        printf("\n");
+    }
+}
+
+static double TimeRuns(WarpEngine& engine, const WarpJob& job, int iterations)
+{
+    engine.Run(job);
+    const auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        engine.Run(job);
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void BenchmarkEngineSelection(EngineSelector& selector, GlWarpEngine& gl, CpuWarpEngine& cpu)
+{
+    const int sizes[] = { 3, 16, 64, 256, 1024 };
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+
+    printf("\n**** Engine selection, RGBA32F linear and RGBA8 hardware linear, rotated ****\n");
+    for (auto format : { PixelFormat::RGBA32F, PixelFormat::RGBA8 }) {
+        for (int size : sizes) {
+            const HostImage sourceImage = AllocateImage(format, size, size);
+            const HostImage targetImage = AllocateImage(PixelFormat::RGBA32F, size, size);
+            FillNoise(sourceImage, 3);
+
+            WarpJob job;
+            job.source = sourceImage.view;
+            job.target = targetImage.view;
+            job.mesh = &mesh;
+            job.filter = Filter::Linear;
+            job.sampling = format == PixelFormat::RGBA8 ? Sampling::Hardware : Sampling::Manual;
+
+            const int iterations = size <= 64 ? 100 : size <= 256 ? 10 : 2;
+            const double glTime = TimeRuns(gl, job, iterations);
+            const double cpuTime = TimeRuns(cpu, job, iterations);
+            WarpEngine& chosen = selector.Choose(job);
+            const bool right = (&chosen == &cpu) == (cpuTime < glTime);
+            printf("%-8s %4dx%-4d GL %9.3f ms, CPU %9.3f ms, selected %-3s (%s)\n", FormatName(format), size, size,
+                glTime, cpuTime, chosen.Name(), right ? "faster" : "slower");
+        }
+    }
+
+    const HostArenaStats stats = DefaultHostArena().Stats();
+    printf("host buffers: %zu allocated, %zu reused, %.1f MB cached, %.1f MB on reserved huge pages\n",
+        stats.allocations, stats.reuses, stats.cachedBytes / 1048576.0, stats.hugePageBytes / 1048576.0);
+}
+
+void BenchmarkOutputPacking(GlWarpEngine& engine)
+{
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    FillNoise(sourceImage, 6);
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+
+    WarpJob job;
+    job.source = sourceImage.view;
+    job.mesh = &mesh;
+    job.filter = Filter::Linear;
+
+    printf("\n**** Readback of a %dx%d warp per target format ****\n", BenchWidth, BenchHeight);
+    double floatTime = 0;
+    for (auto format : { PixelFormat::RGBA32F, PixelFormat::RGBA16F, PixelFormat::RGBA8, PixelFormat::R8 }) {
+        const HostImage targetImage = AllocateImage(format, BenchWidth, BenchHeight);
+        job.target = targetImage.view;
+        engine.Upload(job);
+        engine.Draw(job);
+        engine.Readback(job);
+
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < BenchIterations; ++i)
+            engine.Readback(job);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        const double time = elapsed.count() / BenchIterations;
+        if (format == PixelFormat::RGBA32F)
+            floatTime = time;
+
+        const double bytes = double(PlaneBytes(format, 0, BenchWidth, BenchHeight));
+        printf("%-8s %6.2f MB %.3f ms/readback (%.2fx), %.0f MB/s\n", FormatName(format), bytes / 1048576.0,
+            time, floatTime / time, bytes / 1048576.0 / (time / 1000));
+    }
+}
+
+void BenchmarkPyramid(GlPyramidBuilder& builder)
+{
+    const int Levels = 6;
+    const int Iterations = 5;
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    FillNoise(sourceImage, 7);
+
+    printf("\n**** %d-level pyramid of a %dx%d RGBA32F image ****\n", Levels, BenchWidth, BenchHeight);
+    for (bool laplacian : { false, true }) {
+        Pyramid pyramid;
+        builder.Build(sourceImage.view, Levels, laplacian, pyramid);
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+            builder.Build(sourceImage.view, Levels, laplacian, pyramid);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        printf("%s, one readback: %.3f ms/pyramid\n", laplacian ? "Laplacian" : "Gaussian", elapsed.count() / Iterations);
+    }
+
+    // What a pass per level costs: each level is uploaded, reduced and read
+    // back before the next one starts
+    Pyramid level;
+    const auto start = chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i) {
+        ImageView source = sourceImage.view;
+        for (int l = 1; l < Levels; ++l) {
+            Pyramid next;
+            builder.Build(source, 2, false, next);
+            level = move(next);
+            source = level.levels[1];
+        }
+    }
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    printf("Gaussian, round trip per level: %.3f ms/pyramid\n", elapsed.count() / Iterations);
+}
+
+void BenchmarkResidentChain(GlWarpEngine& engine)
+{
+    const int Iterations = 5;
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage middleImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA8, BenchWidth, BenchHeight);
+    FillNoise(sourceImage, 8);
+    const WarpMesh meshes[3] = { MakeRotationMesh(10, 0.9f), MakeRotationMesh(-5, 1.1f), MakeRotationMesh(0, 1) };
+
+    // Rotate, rotate and scale back, convert to RGBA8
+    WarpJob steps[3];
+    for (int i = 0; i < 3; ++i) {
+        steps[i].mesh = &meshes[i];
+        steps[i].filter = Filter::Linear;
+        steps[i].source = middleImage.view;
+        steps[i].target = i < 2 ? middleImage.view : targetImage.view;
+    }
+    steps[0].source = sourceImage.view;
+
+    printf("\n**** Three chained warps of a %dx%d RGBA32F image ****\n", BenchWidth, BenchHeight);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < Iterations + 1; ++i) {
+        if (i == 1)
+            start = chrono::steady_clock::now();
+        for (auto& step : steps)
+            engine.Run(step);
+    }
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    const double roundTripTime = elapsed.count() / Iterations;
+
+    for (int i = 0; i < Iterations + 1; ++i) {
+        if (i == 1)
+            start = chrono::steady_clock::now();
+        GpuImage image = engine.UploadImage(sourceImage.view);
+        for (auto& step : steps)
+            image = engine.Warp(step, image);
+        engine.ReadImage(image, targetImage.view);
+    }
+    elapsed = chrono::steady_clock::now() - start;
+    const double residentTime = elapsed.count() / Iterations;
+
+    printf("round trip per step: %.3f ms/chain\n", roundTripTime);
+    printf("resident: %.3f ms/chain (%.2fx)\n", residentTime, roundTripTime / residentTime);
+}
+
+void BenchmarkPointSampling(GlWarpEngine& engine)
+{
+    const size_t Points = size_t(1) << 20;
+    const int Iterations = 5;
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    HostBuffer coordinates = DefaultHostArena().Acquire(Points * 2 * sizeof(float));
+    HostBuffer values = DefaultHostArena().Acquire(Points * 4 * sizeof(float));
+    FillNoise(sourceImage, 9);
+    FillNoise(coordinates.As<GLfloat>(), Points * 2, 10);
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+
+    WarpJob job;
+    job.source = sourceImage.view;
+    job.target = targetImage.view;
+    job.mesh = &mesh;
+    job.filter = Filter::Linear;
+
+    printf("\n**** %zu scattered samples of a %dx%d RGBA32F texture ****\n", Points, BenchWidth, BenchHeight);
+    for (auto sampling : { Sampling::Hardware, Sampling::Manual }) {
+        job.sampling = sampling;
+        engine.SamplePoints(job, coordinates.As<GLfloat>(), Points, values.As<GLfloat>());
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+            engine.SamplePoints(job, coordinates.As<GLfloat>(), Points, values.As<GLfloat>());
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        const double pointTime = elapsed.count() / Iterations;
+
+        const GpuImage resident = engine.UploadImage(sourceImage.view);
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+            engine.SamplePoints(job, resident, coordinates.As<GLfloat>(), Points, values.As<GLfloat>());
+        elapsed = chrono::steady_clock::now() - start;
+        const double residentTime = elapsed.count() / Iterations;
+
+        // A full warp producing as many samples, for comparison
+        engine.Run(job);
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+            engine.Run(job);
+        elapsed = chrono::steady_clock::now() - start;
+        const double warpTime = elapsed.count() / Iterations;
+
+        printf("%s linear: %.3f ms for the point list with upload, %.3f ms on a resident image (%.1f Msamples/s), "
+            "%.3f ms for a dense warp with upload and readback\n", sampling == Sampling::Hardware ? "hardware" : "manual",
+            pointTime, residentTime, Points / residentTime / 1000, warpTime);
+    }
+}
+
+void BenchmarkAlignment(GlWarpEngine& engine)
+{
+    const int Iterations = 10;
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage templateImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth / 2, BenchHeight / 2);
+    FillNoise(sourceImage, 11);
+    FillNoise(templateImage, 12);
+
+    WarpJob job;
+    job.source = sourceImage.view;
+    job.sampling = Sampling::Manual;
+
+    printf("\n**** Affine alignment of a %dx%d template to a %dx%d RGBA32F image ****\n",
+        BenchWidth / 2, BenchHeight / 2, BenchWidth, BenchHeight);
+    for (auto filter : { Filter::Linear, Filter::Cubic }) {
+        job.filter = filter;
+        // Noise never converges, so every run does all iterations
+        float affine[6] = { 0.5f, 0, 0.25f, 0, 0.5f, 0.25f };
+        engine.AlignAffine(job, templateImage.view, 1, affine);
+        auto start = chrono::steady_clock::now();
+        engine.AlignAffine(job, templateImage.view, Iterations, affine);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+        // Sample, gradients and template per pixel, had the terms been
+        // summed on the host
+        const size_t hostBytes = size_t(BenchWidth / 2) * (BenchHeight / 2) * 4 * sizeof(float) * 4;
+        printf("%s: %.3f ms/iteration including upload, %zu bytes read back per iteration instead of %zu\n",
+            filter == Filter::Linear ? "linear" : "cubic", elapsed.count() / Iterations, 29 * sizeof(float), hostBytes);
+    }
+}
+
+void BenchmarkGpuStatistics(GlWarpEngine& engine)
+{
+    const int Iterations = 10;
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage referenceImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    FillNoise(sourceImage, 13);
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+
+    WarpJob job;
+    job.source = sourceImage.view;
+    job.target = referenceImage.view;
+    job.mesh = &mesh;
+    job.filter = Filter::Linear;
+    engine.Run(job);
+    const GpuImage reference = engine.UploadImage(referenceImage.view);
+    job.target = targetImage.view;
+    engine.Upload(job);
+    engine.Draw(job);
+
+    printf("\n**** Validating a %dx%d RGBA32F target against a reference ****\n", BenchWidth, BenchHeight);
+    bool equal = false;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i) {
+        engine.Readback(job);
+        equal = SameImage(targetImage, referenceImage);
+    }
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    printf("readback and host compare: %.3f ms, %s, %zu bytes read back\n", elapsed.count() / Iterations,
+        equal ? "equal" : "different", size_t(BenchWidth) * BenchHeight * 4 * sizeof(float));
+
+    ImageDifference difference;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i)
+        engine.CompareTarget(reference, 0, difference);
+    elapsed = chrono::steady_clock::now() - start;
+    printf("GPU statistics: %.3f ms, %s, %zu bytes read back\n", elapsed.count() / Iterations,
+        difference.Equal() ? "equal" : "different", 17 * sizeof(float));
+
+    vector<unsigned> counts;
+    for (int bins : { 256, 4096 }) {
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+            engine.TargetHistogram(0, bins, 0, 1, counts);
+        elapsed = chrono::steady_clock::now() - start;
+        printf("%d-bin GPU histogram: %.3f ms\n", bins, elapsed.count() / Iterations);
+    }
+}
+
+void BenchmarkEtc2()
+{
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA8, BenchWidth, BenchHeight);
+    vector<GLfloat> noise(size_t(BenchWidth) * BenchHeight);
+    FillNoise(noise, 14);
+    // Smooth content with some noise, closer to real imagery than noise alone
+    unsigned char* texels = sourceImage.buffer.As<unsigned char>();
+    for (int y = 0; y < BenchHeight; ++y) {
+        for (int x = 0; x < BenchWidth; ++x) {
+            const size_t i = size_t(y) * BenchWidth + x;
+            for (int c = 0; c < 4; ++c)
+                texels[i * 4 + c] = (unsigned char)min(255.0f, ((x + c * 37) % 256) * 0.6f + ((y * 3) % 256) * 0.3f + noise[i] * 25);
+        }
+    }
+
+    printf("\n**** ETC2 RGB8 encoding of a %dx%d RGBA8 image ****\n", BenchWidth, BenchHeight);
+    CompressedImage image;
+    ThreadPool pool;
+    const struct { const char* name; CpuKernels kernels; ThreadPool* pool; } Runs[] = {
+        { "scalar, 1 thread", CpuKernels::Scalar, nullptr },
+        { "best kernels, 1 thread", CpuKernels::Best, nullptr },
+        { "best kernels, pool", CpuKernels::Best, &pool },
+    };
+    for (auto& run : Runs) {
+        auto start = chrono::steady_clock::now();
+        EncodeEtc2(sourceImage.view, CompressedFormat::Etc2Rgb8, image, run.pool, run.kernels);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        printf("%s: %.1f ms (%.1f Mpixels/s)\n", run.name, elapsed.count(), BenchWidth * BenchHeight / elapsed.count() / 1000);
+    }
+}
+
+void BenchmarkCompressedSources(GlWarpEngine& engine)
+{
+    const int Iterations = 10;
+    const HostImage rgba8 = AllocateImage(PixelFormat::RGBA8, BenchWidth, BenchHeight);
+    const HostImage rgba32f = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    FillNoise(rgba32f, 15);
+    const GLfloat* samples = rgba32f.buffer.As<GLfloat>();
+    for (size_t i = 0; i < size_t(BenchWidth) * BenchHeight * 4; ++i)
+        rgba8.buffer.As<unsigned char>()[i] = (unsigned char)(samples[i] * 255);
+    CompressedImage etc2;
+    EncodeEtc2(rgba8.view, CompressedFormat::Etc2Rgb8, etc2);
+
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+    WarpJob job;
+    job.mesh = &mesh;
+    job.filter = Filter::Linear;
+    job.target = MakeImageView(PixelFormat::RGBA8, BenchWidth, BenchHeight, nullptr);
+
+    printf("\n**** Rotating a resident %dx%d source into RGBA8 ****\n", BenchWidth, BenchHeight);
+    const struct { const char* name; GpuImage source; size_t bytes; } Sources[] = {
+        { "RGBA32F", engine.UploadImage(rgba32f.view), rgba32f.buffer.Size() },
+        { "RGBA8", engine.UploadImage(rgba8.view), rgba8.buffer.Size() },
+        { "ETC2 RGB8", engine.UploadImage(etc2), etc2.blocks.size() },
+    };
+    for (auto& source : Sources) {
+        engine.Warp(job, source.source);
+        glFinish();
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+            engine.Warp(job, source.source);
+        glFinish();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        printf("%s: %.3f ms/warp, %zu texture bytes\n", source.name, elapsed.count() / Iterations, source.bytes);
+    }
+}
+
+void BenchmarkSrgb(GlWarpEngine& engine)
+{
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA8, BenchWidth, BenchHeight);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA8, BenchWidth, BenchHeight);
+    const HostImage linearImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    FillNoise(linearImage, 16);
+    for (size_t i = 0; i < size_t(BenchWidth) * BenchHeight * 4; ++i)
+        sourceImage.buffer.As<unsigned char>()[i] = (unsigned char)(linearImage.buffer.As<GLfloat>()[i] * 255);
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+
+    WarpJob job;
+    job.source = sourceImage.view;
+    job.target = targetImage.view;
+    job.mesh = &mesh;
+    job.filter = Filter::Linear;
+
+    printf("\n**** RGBA8 to RGBA8 rotation of a %dx%d image, linear and sRGB ****\n", BenchWidth, BenchHeight);
+    for (auto encoding : { ColorEncoding::Linear, ColorEncoding::Srgb }) {
+        job.source.encoding = encoding;
+        job.target.encoding = encoding;
+        printf("%s: %.3f ms/run\n", encoding == ColorEncoding::Srgb ? "sRGB textures" : "linear", TimeRuns(engine, job, BenchIterations));
+    }
+
+    const size_t Pixels = size_t(BenchWidth) * BenchHeight;
+    for (auto kernels : { CpuKernels::Scalar, CpuKernels::Avx2 }) {
+        if (!KernelsSupported(kernels))
+            continue;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < BenchIterations; ++i)
+            SrgbToLinear(kernels, sourceImage.buffer.As<unsigned char>(), 4, Pixels, linearImage.buffer.As<GLfloat>());
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        printf("host sRGB decode, %s: %.3f ms (%.0f Mpixels/s)\n", CpuWarpEngine::KernelsName(kernels),
+            elapsed.count() / BenchIterations, Pixels * BenchIterations / elapsed.count() / 1000);
+    }
+}
+
+void BenchmarkBayer(GlWarpEngine& engine)
+{
+    const HostImage mosaic = AllocateImage(PixelFormat::R8, BenchWidth, BenchHeight);
+    const HostImage rgba8 = AllocateImage(PixelFormat::RGBA8, BenchWidth, BenchHeight);
+    const HostImage rgba32f = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA8, BenchWidth, BenchHeight);
+    FillNoise(rgba32f, 17);
+    for (size_t i = 0; i < size_t(BenchWidth) * BenchHeight; ++i)
+        mosaic.buffer.As<unsigned char>()[i] = (unsigned char)(rgba32f.buffer.As<GLfloat>()[i] * 255);
+    const float Identity[6] = { 1, 0, 0, 0, 1, 0 };
+    const WarpMesh copy = MakeAffineMesh(Identity);
+    const WarpMesh rotation = MakeRotationMesh(10, 0.9f);
+
+    WarpJob fused;
+    fused.source = mosaic.view;
+    fused.source.bayer = BayerPattern::RGGB;
+    fused.target = targetImage.view;
+    fused.mesh = &rotation;
+    fused.filter = Filter::Linear;
+
+    printf("\n**** Demosaicing and rotating a %dx%d RGGB R8 mosaic into RGBA8 ****\n", BenchWidth, BenchHeight);
+    for (Demosaic method : { Demosaic::Bilinear, Demosaic::Malvar }) {
+        fused.demosaic = method;
+        printf("fused, %s: %.3f ms/frame, %zu bytes uploaded\n", method == Demosaic::Malvar ? "Malvar" : "bilinear",
+            TimeRuns(engine, fused, BenchIterations), mosaic.buffer.Size());
+    }
+
+    // The same Malvar frame in two passes, through an RGBA8 or an RGBA32F
+    // intermediate demosaiced on the GPU or the host
+    WarpJob demosaic = fused;
+    demosaic.target = rgba8.view;
+    demosaic.mesh = &copy;
+    demosaic.filter = Filter::Nearest;
+    WarpJob warp = fused;
+    warp.source = rgba8.view;
+    const double gpuPasses = TimeRuns(engine, demosaic, BenchIterations) + TimeRuns(engine, warp, BenchIterations);
+    printf("GL demosaic, then GL warp: %.3f ms/frame, %zu bytes uploaded\n", gpuPasses, mosaic.buffer.Size() + rgba8.buffer.Size());
+
+    ThreadPool pool;
+    warp.source = rgba32f.view;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < BenchIterations; ++i)
+        DemosaicBayer(fused.source, Demosaic::Malvar, rgba32f.view, &pool);
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    const double hostPasses = elapsed.count() / BenchIterations + TimeRuns(engine, warp, BenchIterations);
+    printf("host demosaic on %u threads, then GL warp: %.3f ms/frame, %zu bytes uploaded\n", pool.ThreadCount(), hostPasses,
+        rgba32f.buffer.Size());
+}
+
+void BenchmarkStridedViews(GlWarpEngine& engine)
+{
+    const int FrameWidth = 2 * BenchWidth, FrameHeight = 2 * BenchHeight;
+    const HostImage frame = AllocateImage(PixelFormat::RGBA8, FrameWidth, FrameHeight);
+    const HostImage canvas = AllocateImage(PixelFormat::RGBA8, FrameWidth, FrameHeight);
+    const HostImage packedSource = AllocateImage(PixelFormat::RGBA8, BenchWidth, BenchHeight);
+    const HostImage packedTarget = AllocateImage(PixelFormat::RGBA8, BenchWidth, BenchHeight);
+    memset(frame.buffer.As<unsigned char>(), 0x80, frame.buffer.Size());
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+    const size_t rowBytes = size_t(BenchWidth) * 4;
+
+    WarpJob job;
+    job.source = SubImage(frame.view, 256, 128, BenchWidth, BenchHeight);
+    job.target = SubImage(canvas.view, 512, 256, BenchWidth, BenchHeight);
+    job.mesh = &mesh;
+    job.filter = Filter::Linear;
+
+    printf("\n**** RGBA8 %dx%d region of a %dx%d frame into a region of a canvas ****\n", BenchWidth, BenchHeight,
+        FrameWidth, FrameHeight);
+    printf("row lengths: %.3f ms/run\n", TimeRuns(engine, job, BenchIterations));
+
+    // Copy the region out, warp packed images and copy the result in
+    WarpJob packed = job;
+    packed.source = packedSource.view;
+    packed.target = packedTarget.view;
+    engine.Run(packed);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < BenchIterations; ++i) {
+        for (int y = 0; y < BenchHeight; ++y)
+            memcpy(packedSource.buffer.As<unsigned char>() + y * rowBytes, (const unsigned char*)job.source.planes[0] + y * size_t(FrameWidth) * 4, rowBytes);
+        engine.Run(packed);
+        for (int y = 0; y < BenchHeight; ++y)
+            memcpy((unsigned char*)job.target.planes[0] + y * size_t(FrameWidth) * 4, packedTarget.buffer.As<unsigned char>() + y * rowBytes, rowBytes);
+    }
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    printf("host repacking: %.3f ms/run\n", elapsed.count() / BenchIterations);
+}
+
+void BenchmarkRawImages(GlWarpEngine& engine)
+{
+    const int Iterations = 5;
+    const char* Path = "BenchmarkImage.raw";
+    const HostImage sourceImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    FillNoise(sourceImage, 18);
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+    WarpJob job;
+    job.source = sourceImage.view;
+    job.target = targetImage.view;
+    job.mesh = &mesh;
+    job.filter = Filter::Linear;
+
+    printf("\n**** Dumping a %dx%d RGBA32F warp result ****\n", BenchWidth, BenchHeight);
+    printf("warp and readback: %.3f ms\n", TimeRuns(engine, job, Iterations));
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i) {
+        engine.Run(job);
+        WriteRawImage(Path, targetImage.view);
+    }
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    printf("warp, then raw file: %.3f ms\n", elapsed.count() / Iterations);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i) {
+        RawImageFile file;
+        file.Create(Path, PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+        job.target = file.View();
+        engine.Run(job);
+    }
+    elapsed = chrono::steady_clock::now() - start;
+    job.target = targetImage.view;
+    printf("warp read back into a mapped raw file: %.3f ms\n", elapsed.count() / Iterations);
+
+#ifdef WITH_PNG
+    const HostBuffer packed = DefaultHostArena().Acquire(size_t(BenchWidth) * BenchHeight * 4);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i) {
+        engine.Run(job);
+        PackUnorm8(targetImage.buffer.As<float>(), size_t(BenchWidth) * BenchHeight * 4, packed.As<uint8_t>());
+        lodepng_encode_file("BenchmarkImage.png", packed.As<uint8_t>(), BenchWidth, BenchHeight, LCT_RGBA, 8);
+    }
+    elapsed = chrono::steady_clock::now() - start;
+    printf("warp, then 8-bit PNG: %.3f ms\n", elapsed.count() / Iterations);
+    remove("BenchmarkImage.png");
+#endif
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i) {
+        RawImageFile file;
+        file.Open(Path);
+        engine.UploadImage(file.View());
+        glFinish();
+    }
+    elapsed = chrono::steady_clock::now() - start;
+    printf("raw file mapped and uploaded: %.3f ms\n", elapsed.count() / Iterations);
+    remove(Path);
+}
+
+#ifdef WITH_PNG
+void BenchmarkTiledImages()
+{
+    const int Iterations = 3;
+    const char* Path = "BenchmarkImage.tiles";
+    const HostImage image = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    const HostImage decoded = AllocateImage(PixelFormat::RGBA32F, BenchWidth, BenchHeight);
+    // Smooth content, like a warp result, rather than noise, which no
+    // lossless coder can shrink
+    GLfloat* samples = image.buffer.As<GLfloat>();
+    for (int y = 0; y < BenchHeight; ++y)
+        for (int x = 0; x < BenchWidth; ++x)
+            for (int c = 0; c < 4; ++c)
+                samples[(size_t(y) * BenchWidth + x) * 4 + c] = c == 3 ? 1.0f : 0.5f + 0.5f * sinf(0.01f * (c + 1) * x + 0.013f * y);
+
+    printf("\n**** Archiving a %dx%d RGBA32F image, %zu bytes ****\n", BenchWidth, BenchHeight, image.buffer.Size());
+    unsigned char* stream = nullptr;
+    size_t streamBytes = 0;
+    auto start = chrono::steady_clock::now();
+    lodepng_zlib_compress(&stream, &streamBytes, image.buffer.As<unsigned char>(), image.buffer.Size(), &lodepng_default_compress_settings);
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    free(stream);
+    printf("one zlib stream: %.1f ms, %zu bytes\n", elapsed.count(), streamBytes);
+
+    ThreadPool pool;
+    printf("pool of %u threads\n", pool.ThreadCount());
+    for (ThreadPool* threads : { (ThreadPool*)nullptr, &pool }) {
+        const char* name = threads ? "pool" : "1 thread";
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+            WriteTiledImage(Path, image.view, 256, threads);
+        elapsed = chrono::steady_clock::now() - start;
+        struct stat info;
+        stat(Path, &info);
+        printf("256x256 shuffled tiles, %s: write %.1f ms, %lld bytes\n", name, elapsed.count() / Iterations,
+            (long long)info.st_size);
+
+        TiledImageReader reader;
+        reader.Open(Path);
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+            reader.ReadRegion(0, 0, decoded.view, threads);
+        elapsed = chrono::steady_clock::now() - start;
+        printf("256x256 shuffled tiles, %s: read %.1f ms, %s\n", name, elapsed.count() / Iterations,
+            SameImage(image, decoded) ? "lossless" : "DIFFERENT");
+    }
+
+    TiledImageReader reader;
+    reader.Open(Path);
+    size_t tiles = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i)
+        reader.ReadRegion(BenchWidth / 2 - 128, BenchHeight / 2 - 128, SubImage(decoded.view, 0, 0, 256, 256), nullptr, &tiles);
+    elapsed = chrono::steady_clock::now() - start;
+    printf("256x256 region, 1 thread: read %.1f ms, %zu of %zu tiles\n", elapsed.count() / Iterations, tiles, reader.TileCount());
+    remove(Path);
+}
+#endif
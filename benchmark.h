@@ -0,0 +1,93 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "gl_warp.h"
+#include "gl_pyramid.h"
+#include "cpu_warp.h"
+#include "engine_selector.h"
+#include "host_buffer.h"
+
+#include <vector>
+
+// Deterministic pseudo-random samples in [0, 1).
+void FillNoise(GLfloat* samples, size_t count, unsigned int seed);
+void FillNoise(std::vector<GLfloat>& samples, unsigned int seed);
+
+// Wall-clock milliseconds per Draw() of the job, which must have been
+// uploaded already. Excludes upload and readback.
+double TimeDraws(GlWarpEngine& engine, const WarpJob& job, int iterations);
+
+// Manual fp32 bilinear against the sampler's GL_LINEAR on a rotated and
+// scaled RGBA32F image: cost per draw, deviation and repeatability.
+void BenchmarkManualBilinear(GlWarpEngine& engine);
+
+// texelFetch against textureGather kernels on a rotated single-channel
+// R32F image.
+void BenchmarkGather(GlWarpEngine& engine);
+
+// Tiled CPU remap of a rotated RGBA32F image with 1, 2, 4, ... threads up to
+// the hardware thread count: throughput, scaling and per-thread balance.
+void BenchmarkCpuScaling();
+
+// Single-threaded CPU bilinear remap per sample type and channel count, fp32
+// against the fixed-point path of 8- and 16-bit integer formats.
+void BenchmarkCpuFormats();
+
+// Measured GL and CPU time per Run() of rotations from 3x3 to 1024x1024
+// against the calibrated selector's pick.
+void BenchmarkEngineSelection(EngineSelector& selector, GlWarpEngine& gl, CpuWarpEngine& cpu);
+
+// Time per Readback() of a 1024x1024 warp into RGBA32F, RGBA16F, RGBA8 and
+// R8 targets; R8 includes the pass packing four pixels per texel.
+void BenchmarkOutputPacking(GlWarpEngine& engine);
+
+// Gaussian and Laplacian pyramids of a 1024x1024 image built in one chain
+// of passes, against a round trip through the host per level.
+void BenchmarkPyramid(GlPyramidBuilder& builder);
+
+// Three warps of a 1024x1024 image chained through resident images, against
+// a readback and upload between steps.
+void BenchmarkResidentChain(GlWarpEngine& engine);
+
+// Compute-shader sampling of a million scattered points against a dense
+// warp producing as many samples.
+void BenchmarkPointSampling(GlWarpEngine& engine);
+
+// Gauss-Newton affine alignment of a 512x512 template: time per iteration,
+// with the normal equations reduced on the GPU.
+void BenchmarkAlignment(GlWarpEngine& engine);
+
+// Deciding whether a 1024x1024 target matches a reference by readback and
+// host comparison, against reductions on the GPU; also GPU histograms.
+void BenchmarkGpuStatistics(GlWarpEngine& engine);
+
+// ETC2 encoding of a 1024x1024 image: scalar against SIMD table search,
+// one thread against the pool.
+void BenchmarkEtc2();
+
+// Warps of resident RGBA32F, RGBA8 and ETC2 sources.
+void BenchmarkCompressedSources(GlWarpEngine& engine);
+
+// GL rotation of an RGBA8 image with and without sRGB textures, and the
+// host's sRGB decode table, scalar against AVX2 gathers.
+void BenchmarkSrgb(GlWarpEngine& engine);
+
+// Raw Bayer frame to rotated RGBA8: the fused demosaic and warp against a
+// GL demosaic pass followed by a warp, and a host demosaic followed by one.
+void BenchmarkBayer(GlWarpEngine& engine);
+
+// Warping a region of a large frame into a region of a large canvas, with
+// row lengths against copying the regions in and out.
+void BenchmarkStridedViews(GlWarpEngine& engine);
+
+// Saving a warp result as a raw file, written after readback or read back
+// into the mapping, against 8-bit PNG, and uploading a mapped raw file.
+void BenchmarkRawImages(GlWarpEngine& engine);
+
+#ifdef WITH_PNG
+// Compressing a float image as one zlib stream against shuffled tiles on
+// one thread and on a pool, and decoding it whole and a region of it.
+void BenchmarkTiledImages();
+#endif
+
+#endif
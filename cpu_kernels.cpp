@@ -0,0 +1,842 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_WARP_X86
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "cpu_kernels.h"
+
+using namespace std;
+
+// All kernels evaluate the coordinate math below with the same operations
+// in the same order, so every instruction set produces identical results.
+
+// Wraps an integral coordinate like GL_REPEAT: an approximate quotient from
+// the reciprocal, then one correction step either way.
+static inline int WrapCoord(float coord, float size, float invSize)
+{
+    float wrapped = coord - size * floorf(coord * invSize);
+    if (wrapped < 0)
+        wrapped += size;
+    if (wrapped >= size)
+        wrapped -= size;
+    return int(wrapped);
+}
+
+// Splits a texel-space coordinate into base texel and fraction, with the
+// fraction snapped to 1/65536 texel as in the GL shader.
+static inline float SplitCoord(float coord, float& f)
+{
+    float base = floorf(coord);
+    f = floorf((coord - base) * 65536.0f + 0.5f) * (1.0f / 65536.0f);
+    const float carry = floorf(f);
+    f -= carry;
+    return base + carry;
+}
+
+static inline void CubicWeights(float f, float w[4])
+{
+    // Keys kernel, a = -0.5
+    const float f2 = f * f;
+    const float f3 = f2 * f;
+    w[0] = -0.5f * f3 + f2 - 0.5f * f;
+    w[1] = 1.5f * f3 - 2.5f * f2 + 1.0f;
+    w[2] = -1.5f * f3 + 2.0f * f2 + 0.5f * f;
+    w[3] = 0.5f * f3 - 0.5f * f2;
+}
+
+// Binary16 sample, distinct from uint16_t for template dispatch
+struct Half
+{
+    uint16_t bits;
+};
+
+static inline float LoadSample(uint8_t sample) { return float(sample) / 255.0f; }
+static inline float LoadSample(uint16_t sample) { return float(sample); }
+static inline float LoadSample(Half sample) { return HalfToFloat(sample.bits); }
+static inline float LoadSample(float sample) { return sample; }
+
+template <typename T, int Channels>
+static inline void FetchTexel(const T* texels, int width, int x, int y, float texel[4])
+{
+    const T* p = texels + (size_t(y) * width + x) * Channels;
+    if (Channels == 1) {
+        texel[0] = texel[1] = texel[2] = LoadSample(p[0]);
+        texel[3] = 1;
+        return;
+    }
+    for (int c = 0; c < Channels; ++c)
+        texel[c] = LoadSample(p[c]);
+    for (int c = Channels; c < 4; ++c)
+        texel[c] = c == 3 ? 1.0f : 0.0f;
+}
+
+// One pixel of a span. The filter and layout are template parameters, so
+// each instantiation is a straight-line loop body.
+template <typename T, int Channels, Filter F>
+static inline void SamplePixel(const Sampler& sampler, float u, float v, float result[4])
+{
+    const T* texels = (const T*)sampler.texels;
+    const int width = sampler.width;
+    const int height = sampler.height;
+    const float w = float(width);
+    const float h = float(height);
+    const float invW = 1.0f / w;
+    const float invH = 1.0f / h;
+
+    if (F == Filter::Nearest) {
+        FetchTexel<T, Channels>(texels, width, WrapCoord(floorf(u * w), w, invW), WrapCoord(floorf(v * h), h, invH), result);
+        return;
+    }
+
+    float fx, fy;
+    const float bx = SplitCoord(u * w - 0.5f, fx);
+    const float by = SplitCoord(v * h - 0.5f, fy);
+
+    if (F == Filter::Cubic) {
+        float wx[4], wy[4];
+        CubicWeights(fx, wx);
+        CubicWeights(fy, wy);
+        int xs[4];
+        for (int i = 0; i < 4; ++i)
+            xs[i] = WrapCoord(bx + float(i - 1), w, invW);
+
+        result[0] = result[1] = result[2] = result[3] = 0;
+        for (int j = 0; j < 4; ++j) {
+            const int y = WrapCoord(by + float(j - 1), h, invH);
+            float taps[4][4];
+            for (int i = 0; i < 4; ++i)
+                FetchTexel<T, Channels>(texels, width, xs[i], y, taps[i]);
+            for (int c = 0; c < 4; ++c) {
+                const float row = wx[0] * taps[0][c] + wx[1] * taps[1][c] + wx[2] * taps[2][c] + wx[3] * taps[3][c];
+                result[c] += wy[j] * row;
+            }
+        }
+        return;
+    }
+
+    const int x0 = WrapCoord(bx, w, invW);
+    const int y0 = WrapCoord(by, h, invH);
+    const int x1 = x0 + 1 == width ? 0 : x0 + 1;
+    const int y1 = y0 + 1 == height ? 0 : y0 + 1;
+    float t00[4], t10[4], t01[4], t11[4];
+    FetchTexel<T, Channels>(texels, width, x0, y0, t00);
+    FetchTexel<T, Channels>(texels, width, x1, y0, t10);
+    FetchTexel<T, Channels>(texels, width, x0, y1, t01);
+    FetchTexel<T, Channels>(texels, width, x1, y1, t11);
+
+    for (int c = 0; c < 4; ++c) {
+        if (F == Filter::Min) {
+            result[c] = fminf(fminf(t00[c], t10[c]), fminf(t01[c], t11[c]));
+        }
+        else if (F == Filter::Max) {
+            result[c] = fmaxf(fmaxf(t00[c], t10[c]), fmaxf(t01[c], t11[c]));
+        }
+        else {
+            const float top = t00[c] * (1.0f - fx) + t10[c] * fx;
+            const float bottom = t01[c] * (1.0f - fx) + t11[c] * fx;
+            result[c] = top * (1.0f - fy) + bottom * fy;
+        }
+    }
+}
+
+// Samples pixels [begin, end) of a span starting at (u, v).
+template <typename T, int Channels, Filter F>
+static void SampleRange(const Sampler& sampler, float u, float v, float du, float dv, int begin, int end, float* target)
+{
+    for (int i = begin; i < end; ++i)
+        SamplePixel<T, Channels, F>(sampler, u + float(i) * du, v + float(i) * dv, target + i * 4);
+}
+
+template <typename T, int Channels, Filter F>
+static void SampleSpan(const Sampler& sampler, float u, float v, float du, float dv, int count, float* target)
+{
+    SampleRange<T, Channels, F>(sampler, u, v, du, dv, 0, count, target);
+}
+
+// Portable kernels for every sample type, channel count and filter, indexed
+// by [SampleType][channels - 1][Filter].
+#define FILTER_KERNELS(T, C) { SampleSpan<T, C, Filter::Nearest>, SampleSpan<T, C, Filter::Linear>, \
+    SampleSpan<T, C, Filter::Cubic>, SampleSpan<T, C, Filter::Min>, SampleSpan<T, C, Filter::Max> }
+#define CHANNEL_KERNELS(T) { FILTER_KERNELS(T, 1), FILTER_KERNELS(T, 2), FILTER_KERNELS(T, 3), FILTER_KERNELS(T, 4) }
+
+static const SpanKernel ScalarKernels[4][4][5] = {
+    CHANNEL_KERNELS(uint8_t),
+    CHANNEL_KERNELS(uint16_t),
+    CHANNEL_KERNELS(Half),
+    CHANNEL_KERNELS(float)
+};
+
+#undef CHANNEL_KERNELS
+#undef FILTER_KERNELS
+
+#if defined(CPU_WARP_X86)
+__attribute__((target("sse4.1")))
+static inline __m128 WrapSse41(__m128 coord, __m128 size, __m128 invSize)
+{
+    __m128 wrapped = _mm_sub_ps(coord, _mm_mul_ps(size, _mm_floor_ps(_mm_mul_ps(coord, invSize))));
+    wrapped = _mm_add_ps(wrapped, _mm_and_ps(_mm_cmplt_ps(wrapped, _mm_setzero_ps()), size));
+    return _mm_sub_ps(wrapped, _mm_and_ps(_mm_cmpge_ps(wrapped, size), size));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 SplitSse41(__m128 coord, __m128& f)
+{
+    const __m128 base = _mm_floor_ps(coord);
+    f = _mm_mul_ps(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(coord, base), _mm_set1_ps(65536.0f)), _mm_set1_ps(0.5f))),
+        _mm_set1_ps(1.0f / 65536.0f));
+    const __m128 carry = _mm_floor_ps(f);
+    f = _mm_sub_ps(f, carry);
+    return _mm_add_ps(base, carry);
+}
+
+__attribute__((target("sse4.1")))
+static void NearestRgbaSse41(const Sampler& sampler, float u, float v, float du, float dv, int count, float* target)
+{
+    const float* texels = (const float*)sampler.texels;
+    const __m128 w = _mm_set1_ps(float(sampler.width));
+    const __m128 h = _mm_set1_ps(float(sampler.height));
+    const __m128 invW = _mm_set1_ps(1.0f / float(sampler.width));
+    const __m128 invH = _mm_set1_ps(1.0f / float(sampler.height));
+    const __m128i width = _mm_set1_epi32(sampler.width);
+    const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 index = _mm_add_ps(_mm_set1_ps(float(i)), lane);
+        const __m128 cu = _mm_add_ps(_mm_set1_ps(u), _mm_mul_ps(index, _mm_set1_ps(du)));
+        const __m128 cv = _mm_add_ps(_mm_set1_ps(v), _mm_mul_ps(index, _mm_set1_ps(dv)));
+        const __m128i x = _mm_cvttps_epi32(WrapSse41(_mm_floor_ps(_mm_mul_ps(cu, w)), w, invW));
+        const __m128i y = _mm_cvttps_epi32(WrapSse41(_mm_floor_ps(_mm_mul_ps(cv, h)), h, invH));
+
+        alignas(16) int32_t offsets[4];
+        _mm_store_si128((__m128i*)offsets, _mm_slli_epi32(_mm_add_epi32(_mm_mullo_epi32(y, width), x), 2));
+        for (int j = 0; j < 4; ++j)
+            _mm_storeu_ps(target + (i + j) * 4, _mm_loadu_ps(texels + offsets[j]));
+    }
+    SampleRange<float, 4, Filter::Nearest>(sampler, u, v, du, dv, i, count, target);
+}
+
+__attribute__((target("sse4.1")))
+static void LinearRgbaSse41(const Sampler& sampler, float u, float v, float du, float dv, int count, float* target)
+{
+    const float* texels = (const float*)sampler.texels;
+    const __m128 w = _mm_set1_ps(float(sampler.width));
+    const __m128 h = _mm_set1_ps(float(sampler.height));
+    const __m128 invW = _mm_set1_ps(1.0f / float(sampler.width));
+    const __m128 invH = _mm_set1_ps(1.0f / float(sampler.height));
+    const __m128i width = _mm_set1_epi32(sampler.width);
+    const __m128i height = _mm_set1_epi32(sampler.height);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 index = _mm_add_ps(_mm_set1_ps(float(i)), lane);
+        const __m128 cu = _mm_add_ps(_mm_set1_ps(u), _mm_mul_ps(index, _mm_set1_ps(du)));
+        const __m128 cv = _mm_add_ps(_mm_set1_ps(v), _mm_mul_ps(index, _mm_set1_ps(dv)));
+        __m128 fx, fy;
+        const __m128 bx = SplitSse41(_mm_sub_ps(_mm_mul_ps(cu, w), half), fx);
+        const __m128 by = SplitSse41(_mm_sub_ps(_mm_mul_ps(cv, h), half), fy);
+
+        const __m128i x0 = _mm_cvttps_epi32(WrapSse41(bx, w, invW));
+        const __m128i y0 = _mm_cvttps_epi32(WrapSse41(by, h, invH));
+        __m128i x1 = _mm_add_epi32(x0, one);
+        __m128i y1 = _mm_add_epi32(y0, one);
+        x1 = _mm_andnot_si128(_mm_cmpeq_epi32(x1, width), x1);
+        y1 = _mm_andnot_si128(_mm_cmpeq_epi32(y1, height), y1);
+        const __m128i row0 = _mm_mullo_epi32(y0, width);
+        const __m128i row1 = _mm_mullo_epi32(y1, width);
+
+        alignas(16) int32_t o00[4], o10[4], o01[4], o11[4];
+        alignas(16) float wx[4], wy[4];
+        _mm_store_si128((__m128i*)o00, _mm_slli_epi32(_mm_add_epi32(row0, x0), 2));
+        _mm_store_si128((__m128i*)o10, _mm_slli_epi32(_mm_add_epi32(row0, x1), 2));
+        _mm_store_si128((__m128i*)o01, _mm_slli_epi32(_mm_add_epi32(row1, x0), 2));
+        _mm_store_si128((__m128i*)o11, _mm_slli_epi32(_mm_add_epi32(row1, x1), 2));
+        _mm_store_ps(wx, fx);
+        _mm_store_ps(wy, fy);
+
+        const __m128 unit = _mm_set1_ps(1.0f);
+        for (int j = 0; j < 4; ++j) {
+            const __m128 fxj = _mm_set1_ps(wx[j]);
+            const __m128 fyj = _mm_set1_ps(wy[j]);
+            const __m128 gxj = _mm_sub_ps(unit, fxj);
+            const __m128 top = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(texels + o00[j]), gxj), _mm_mul_ps(_mm_loadu_ps(texels + o10[j]), fxj));
+            const __m128 bottom = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(texels + o01[j]), gxj), _mm_mul_ps(_mm_loadu_ps(texels + o11[j]), fxj));
+            _mm_storeu_ps(target + (i + j) * 4, _mm_add_ps(_mm_mul_ps(top, _mm_sub_ps(unit, fyj)), _mm_mul_ps(bottom, fyj)));
+        }
+    }
+    SampleRange<float, 4, Filter::Linear>(sampler, u, v, du, dv, i, count, target);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 WrapAvx2(__m256 coord, __m256 size, __m256 invSize)
+{
+    __m256 wrapped = _mm256_sub_ps(coord, _mm256_mul_ps(size, _mm256_floor_ps(_mm256_mul_ps(coord, invSize))));
+    wrapped = _mm256_add_ps(wrapped, _mm256_and_ps(_mm256_cmp_ps(wrapped, _mm256_setzero_ps(), _CMP_LT_OQ), size));
+    return _mm256_sub_ps(wrapped, _mm256_and_ps(_mm256_cmp_ps(wrapped, size, _CMP_GE_OQ), size));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 SplitAvx2(__m256 coord, __m256& f)
+{
+    const __m256 base = _mm256_floor_ps(coord);
+    f = _mm256_mul_ps(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(coord, base), _mm256_set1_ps(65536.0f)), _mm256_set1_ps(0.5f))),
+        _mm256_set1_ps(1.0f / 65536.0f));
+    const __m256 carry = _mm256_floor_ps(f);
+    f = _mm256_sub_ps(f, carry);
+    return _mm256_add_ps(base, carry);
+}
+
+// Two RGBA pixels per register, lower pixel in the lower half
+__attribute__((target("avx2")))
+static inline __m256 LoadPixelPair(const float* texels, int32_t lower, int32_t upper)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(texels + lower)), _mm_loadu_ps(texels + upper), 1);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 BroadcastPair(float lower, float upper)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(lower)), _mm_set1_ps(upper), 1);
+}
+
+__attribute__((target("avx2")))
+static void NearestRgbaAvx2(const Sampler& sampler, float u, float v, float du, float dv, int count, float* target)
+{
+    const float* texels = (const float*)sampler.texels;
+    const __m256 w = _mm256_set1_ps(float(sampler.width));
+    const __m256 h = _mm256_set1_ps(float(sampler.height));
+    const __m256 invW = _mm256_set1_ps(1.0f / float(sampler.width));
+    const __m256 invH = _mm256_set1_ps(1.0f / float(sampler.height));
+    const __m256i width = _mm256_set1_epi32(sampler.width);
+    const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 index = _mm256_add_ps(_mm256_set1_ps(float(i)), lane);
+        const __m256 cu = _mm256_add_ps(_mm256_set1_ps(u), _mm256_mul_ps(index, _mm256_set1_ps(du)));
+        const __m256 cv = _mm256_add_ps(_mm256_set1_ps(v), _mm256_mul_ps(index, _mm256_set1_ps(dv)));
+        const __m256i x = _mm256_cvttps_epi32(WrapAvx2(_mm256_floor_ps(_mm256_mul_ps(cu, w)), w, invW));
+        const __m256i y = _mm256_cvttps_epi32(WrapAvx2(_mm256_floor_ps(_mm256_mul_ps(cv, h)), h, invH));
+
+        alignas(32) int32_t offsets[8];
+        _mm256_store_si256((__m256i*)offsets, _mm256_slli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(y, width), x), 2));
+        for (int j = 0; j < 8; j += 2)
+            _mm256_storeu_ps(target + (i + j) * 4, LoadPixelPair(texels, offsets[j], offsets[j + 1]));
+    }
+    SampleRange<float, 4, Filter::Nearest>(sampler, u, v, du, dv, i, count, target);
+}
+
+__attribute__((target("avx2")))
+static void LinearRgbaAvx2(const Sampler& sampler, float u, float v, float du, float dv, int count, float* target)
+{
+    const float* texels = (const float*)sampler.texels;
+    const __m256 w = _mm256_set1_ps(float(sampler.width));
+    const __m256 h = _mm256_set1_ps(float(sampler.height));
+    const __m256 invW = _mm256_set1_ps(1.0f / float(sampler.width));
+    const __m256 invH = _mm256_set1_ps(1.0f / float(sampler.height));
+    const __m256i width = _mm256_set1_epi32(sampler.width);
+    const __m256i height = _mm256_set1_epi32(sampler.height);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 index = _mm256_add_ps(_mm256_set1_ps(float(i)), lane);
+        const __m256 cu = _mm256_add_ps(_mm256_set1_ps(u), _mm256_mul_ps(index, _mm256_set1_ps(du)));
+        const __m256 cv = _mm256_add_ps(_mm256_set1_ps(v), _mm256_mul_ps(index, _mm256_set1_ps(dv)));
+        __m256 fx, fy;
+        const __m256 bx = SplitAvx2(_mm256_sub_ps(_mm256_mul_ps(cu, w), half), fx);
+        const __m256 by = SplitAvx2(_mm256_sub_ps(_mm256_mul_ps(cv, h), half), fy);
+
+        const __m256i x0 = _mm256_cvttps_epi32(WrapAvx2(bx, w, invW));
+        const __m256i y0 = _mm256_cvttps_epi32(WrapAvx2(by, h, invH));
+        __m256i x1 = _mm256_add_epi32(x0, one);
+        __m256i y1 = _mm256_add_epi32(y0, one);
+        x1 = _mm256_andnot_si256(_mm256_cmpeq_epi32(x1, width), x1);
+        y1 = _mm256_andnot_si256(_mm256_cmpeq_epi32(y1, height), y1);
+        const __m256i row0 = _mm256_mullo_epi32(y0, width);
+        const __m256i row1 = _mm256_mullo_epi32(y1, width);
+
+        alignas(32) int32_t o00[8], o10[8], o01[8], o11[8];
+        alignas(32) float wx[8], wy[8];
+        _mm256_store_si256((__m256i*)o00, _mm256_slli_epi32(_mm256_add_epi32(row0, x0), 2));
+        _mm256_store_si256((__m256i*)o10, _mm256_slli_epi32(_mm256_add_epi32(row0, x1), 2));
+        _mm256_store_si256((__m256i*)o01, _mm256_slli_epi32(_mm256_add_epi32(row1, x0), 2));
+        _mm256_store_si256((__m256i*)o11, _mm256_slli_epi32(_mm256_add_epi32(row1, x1), 2));
+        _mm256_store_ps(wx, fx);
+        _mm256_store_ps(wy, fy);
+
+        const __m256 unit = _mm256_set1_ps(1.0f);
+        for (int j = 0; j < 8; j += 2) {
+            const __m256 fxj = BroadcastPair(wx[j], wx[j + 1]);
+            const __m256 fyj = BroadcastPair(wy[j], wy[j + 1]);
+            const __m256 gxj = _mm256_sub_ps(unit, fxj);
+            const __m256 top = _mm256_add_ps(_mm256_mul_ps(LoadPixelPair(texels, o00[j], o00[j + 1]), gxj),
+                _mm256_mul_ps(LoadPixelPair(texels, o10[j], o10[j + 1]), fxj));
+            const __m256 bottom = _mm256_add_ps(_mm256_mul_ps(LoadPixelPair(texels, o01[j], o01[j + 1]), gxj),
+                _mm256_mul_ps(LoadPixelPair(texels, o11[j], o11[j + 1]), fxj));
+            _mm256_storeu_ps(target + (i + j) * 4, _mm256_add_ps(_mm256_mul_ps(top, _mm256_sub_ps(unit, fyj)), _mm256_mul_ps(bottom, fyj)));
+        }
+    }
+    SampleRange<float, 4, Filter::Linear>(sampler, u, v, du, dv, i, count, target);
+}
+#endif
+
+#if defined(__ARM_NEON)
+// ARMv7 NEON has no vector floor; truncate and step negative values down.
+static inline float32x4_t FloorNeon(float32x4_t x)
+{
+    const float32x4_t truncated = vcvtq_f32_s32(vcvtq_s32_f32(x));
+    const uint32x4_t adjust = vandq_u32(vcgtq_f32(truncated, x), vreinterpretq_u32_f32(vdupq_n_f32(1.0f)));
+    return vsubq_f32(truncated, vreinterpretq_f32_u32(adjust));
+}
+
+static inline float32x4_t WrapNeon(float32x4_t coord, float32x4_t size, float32x4_t invSize)
+{
+    float32x4_t wrapped = vsubq_f32(coord, vmulq_f32(size, FloorNeon(vmulq_f32(coord, invSize))));
+    wrapped = vaddq_f32(wrapped, vreinterpretq_f32_u32(vandq_u32(vcltq_f32(wrapped, vdupq_n_f32(0.0f)), vreinterpretq_u32_f32(size))));
+    return vsubq_f32(wrapped, vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(wrapped, size), vreinterpretq_u32_f32(size))));
+}
+
+static inline float32x4_t SplitNeon(float32x4_t coord, float32x4_t& f)
+{
+    const float32x4_t base = FloorNeon(coord);
+    f = vmulq_f32(FloorNeon(vaddq_f32(vmulq_f32(vsubq_f32(coord, base), vdupq_n_f32(65536.0f)), vdupq_n_f32(0.5f))),
+        vdupq_n_f32(1.0f / 65536.0f));
+    const float32x4_t carry = FloorNeon(f);
+    f = vsubq_f32(f, carry);
+    return vaddq_f32(base, carry);
+}
+
+static void NearestRgbaNeon(const Sampler& sampler, float u, float v, float du, float dv, int count, float* target)
+{
+    const float* texels = (const float*)sampler.texels;
+    const float32x4_t w = vdupq_n_f32(float(sampler.width));
+    const float32x4_t h = vdupq_n_f32(float(sampler.height));
+    const float32x4_t invW = vdupq_n_f32(1.0f / float(sampler.width));
+    const float32x4_t invH = vdupq_n_f32(1.0f / float(sampler.height));
+    const int32x4_t width = vdupq_n_s32(sampler.width);
+    const float lanes[4] = { 0, 1, 2, 3 };
+    const float32x4_t lane = vld1q_f32(lanes);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t index = vaddq_f32(vdupq_n_f32(float(i)), lane);
+        const float32x4_t cu = vaddq_f32(vdupq_n_f32(u), vmulq_f32(index, vdupq_n_f32(du)));
+        const float32x4_t cv = vaddq_f32(vdupq_n_f32(v), vmulq_f32(index, vdupq_n_f32(dv)));
+        const int32x4_t x = vcvtq_s32_f32(WrapNeon(FloorNeon(vmulq_f32(cu, w)), w, invW));
+        const int32x4_t y = vcvtq_s32_f32(WrapNeon(FloorNeon(vmulq_f32(cv, h)), h, invH));
+
+        int32_t offsets[4];
+        vst1q_s32(offsets, vshlq_n_s32(vaddq_s32(vmulq_s32(y, width), x), 2));
+        for (int j = 0; j < 4; ++j)
+            vst1q_f32(target + (i + j) * 4, vld1q_f32(texels + offsets[j]));
+    }
+    SampleRange<float, 4, Filter::Nearest>(sampler, u, v, du, dv, i, count, target);
+}
+
+static void LinearRgbaNeon(const Sampler& sampler, float u, float v, float du, float dv, int count, float* target)
+{
+    const float* texels = (const float*)sampler.texels;
+    const float32x4_t w = vdupq_n_f32(float(sampler.width));
+    const float32x4_t h = vdupq_n_f32(float(sampler.height));
+    const float32x4_t invW = vdupq_n_f32(1.0f / float(sampler.width));
+    const float32x4_t invH = vdupq_n_f32(1.0f / float(sampler.height));
+    const int32x4_t width = vdupq_n_s32(sampler.width);
+    const int32x4_t height = vdupq_n_s32(sampler.height);
+    const int32x4_t one = vdupq_n_s32(1);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const float lanes[4] = { 0, 1, 2, 3 };
+    const float32x4_t lane = vld1q_f32(lanes);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t index = vaddq_f32(vdupq_n_f32(float(i)), lane);
+        const float32x4_t cu = vaddq_f32(vdupq_n_f32(u), vmulq_f32(index, vdupq_n_f32(du)));
+        const float32x4_t cv = vaddq_f32(vdupq_n_f32(v), vmulq_f32(index, vdupq_n_f32(dv)));
+        float32x4_t fx, fy;
+        const float32x4_t bx = SplitNeon(vsubq_f32(vmulq_f32(cu, w), half), fx);
+        const float32x4_t by = SplitNeon(vsubq_f32(vmulq_f32(cv, h), half), fy);
+
+        const int32x4_t x0 = vcvtq_s32_f32(WrapNeon(bx, w, invW));
+        const int32x4_t y0 = vcvtq_s32_f32(WrapNeon(by, h, invH));
+        int32x4_t x1 = vaddq_s32(x0, one);
+        int32x4_t y1 = vaddq_s32(y0, one);
+        x1 = vbicq_s32(x1, vreinterpretq_s32_u32(vceqq_s32(x1, width)));
+        y1 = vbicq_s32(y1, vreinterpretq_s32_u32(vceqq_s32(y1, height)));
+        const int32x4_t row0 = vmulq_s32(y0, width);
+        const int32x4_t row1 = vmulq_s32(y1, width);
+
+        int32_t o00[4], o10[4], o01[4], o11[4];
+        float wx[4], wy[4];
+        vst1q_s32(o00, vshlq_n_s32(vaddq_s32(row0, x0), 2));
+        vst1q_s32(o10, vshlq_n_s32(vaddq_s32(row0, x1), 2));
+        vst1q_s32(o01, vshlq_n_s32(vaddq_s32(row1, x0), 2));
+        vst1q_s32(o11, vshlq_n_s32(vaddq_s32(row1, x1), 2));
+        vst1q_f32(wx, fx);
+        vst1q_f32(wy, fy);
+
+        const float32x4_t unit = vdupq_n_f32(1.0f);
+        for (int j = 0; j < 4; ++j) {
+            const float32x4_t fxj = vdupq_n_f32(wx[j]);
+            const float32x4_t fyj = vdupq_n_f32(wy[j]);
+            const float32x4_t gxj = vsubq_f32(unit, fxj);
+            const float32x4_t top = vaddq_f32(vmulq_f32(vld1q_f32(texels + o00[j]), gxj), vmulq_f32(vld1q_f32(texels + o10[j]), fxj));
+            const float32x4_t bottom = vaddq_f32(vmulq_f32(vld1q_f32(texels + o01[j]), gxj), vmulq_f32(vld1q_f32(texels + o11[j]), fxj));
+            vst1q_f32(target + (i + j) * 4, vaddq_f32(vmulq_f32(top, vsubq_f32(unit, fyj)), vmulq_f32(bottom, fyj)));
+        }
+    }
+    SampleRange<float, 4, Filter::Linear>(sampler, u, v, du, dv, i, count, target);
+}
+#endif
+
+FixedWeightTable MakeFixedWeightTable(int subpixelBits)
+{
+    FixedWeightTable table = {};
+    table.bits = subpixelBits;
+    const int scale = 1 << subpixelBits;
+    for (int f = 0; f < scale; ++f) {
+        table.weights[f][0] = uint16_t(scale - f);
+        table.weights[f][1] = uint16_t(f);
+    }
+    return table;
+}
+
+void PlanFixedSpan(int sourceWidth, int sourceHeight, const FixedWeightTable& table,
+    float u, float v, float du, float dv, int count, FixedTap* taps)
+{
+    const float w = float(sourceWidth);
+    const float h = float(sourceHeight);
+    const float invW = 1.0f / w;
+    const float invH = 1.0f / h;
+    const float scale = float(1 << table.bits);
+    const float invScale = 1.0f / scale;
+
+    for (int i = 0; i < count; ++i) {
+        const float qx = floorf(((u + float(i) * du) * w - 0.5f) * scale + 0.5f);
+        const float qy = floorf(((v + float(i) * dv) * h - 0.5f) * scale + 0.5f);
+        const float bx = floorf(qx * invScale);
+        const float by = floorf(qy * invScale);
+        const int x0 = WrapCoord(bx, w, invW);
+        const int y0 = WrapCoord(by, h, invH);
+
+        FixedTap& tap = taps[i];
+        tap.texel = uint32_t(y0) * uint32_t(sourceWidth) + uint32_t(x0);
+        tap.stepX = x0 + 1 == sourceWidth ? 1 - sourceWidth : 1;
+        tap.stepY = y0 + 1 == sourceHeight ? -(sourceHeight - 1) * sourceWidth : sourceWidth;
+        tap.fx = uint16_t(qx - bx * scale);
+        tap.fy = uint16_t(qy - by * scale);
+    }
+}
+
+static inline float FixedToFloat(uint8_t, unsigned value) { return float(value) * (1.0f / 255.0f); }
+static inline float FixedToFloat(uint16_t, unsigned value) { return float(value); }
+
+template <typename T, int Channels>
+static void BlendFixedSpan(const Sampler& sampler, const FixedTap* taps, int count, const FixedWeightTable& table, float* target)
+{
+    const T* texels = (const T*)sampler.texels;
+    const unsigned half = 1u << (table.bits - 1);
+    for (int i = 0; i < count; ++i) {
+        const FixedTap& tap = taps[i];
+        const T* p00 = texels + ptrdiff_t(tap.texel) * Channels;
+        const T* p10 = p00 + ptrdiff_t(tap.stepX) * Channels;
+        const T* p01 = p00 + ptrdiff_t(tap.stepY) * Channels;
+        const T* p11 = p01 + ptrdiff_t(tap.stepX) * Channels;
+        const uint16_t* wx = table.weights[tap.fx];
+        const uint16_t* wy = table.weights[tap.fy];
+
+        float* result = target + i * 4;
+        for (int c = 0; c < Channels; ++c) {
+            const unsigned top = (p00[c] * unsigned(wx[0]) + p10[c] * unsigned(wx[1]) + half) >> table.bits;
+            const unsigned bottom = (p01[c] * unsigned(wx[0]) + p11[c] * unsigned(wx[1]) + half) >> table.bits;
+            result[c] = FixedToFloat(T(), (top * wy[0] + bottom * wy[1] + half) >> table.bits);
+        }
+        if (Channels == 1)
+            result[1] = result[2] = result[0];
+        for (int c = Channels > 1 ? Channels : 3; c < 4; ++c)
+            result[c] = c == 3 ? 1.0f : 0.0f;
+    }
+}
+
+static const FixedBlendKernel ScalarFixedKernels[2][4] = {
+    { BlendFixedSpan<uint8_t, 1>, BlendFixedSpan<uint8_t, 2>, BlendFixedSpan<uint8_t, 3>, BlendFixedSpan<uint8_t, 4> },
+    { BlendFixedSpan<uint16_t, 1>, BlendFixedSpan<uint16_t, 2>, BlendFixedSpan<uint16_t, 3>, BlendFixedSpan<uint16_t, 4> }
+};
+
+static inline uint32_t LoadRgba8(const uint8_t* texels, ptrdiff_t texel)
+{
+    uint32_t value;
+    memcpy(&value, texels + texel * 4, sizeof(value));
+    return value;
+}
+
+#if defined(CPU_WARP_X86)
+// Texels at the given offsets from two taps' top-left texels, widened to 16 bits
+__attribute__((target("sse4.1")))
+static inline __m128i LoadRgba8PairSse41(const uint8_t* texels, const FixedTap& a, const FixedTap& b, ptrdiff_t stepA, ptrdiff_t stepB)
+{
+    return _mm_cvtepu8_epi16(_mm_setr_epi32(int(LoadRgba8(texels, ptrdiff_t(a.texel) + stepA)),
+        int(LoadRgba8(texels, ptrdiff_t(b.texel) + stepB)), 0, 0));
+}
+
+// Weight k of two taps' fractions, one per channel
+__attribute__((target("sse4.1")))
+static inline __m128i WeightPairSse41(const FixedWeightTable& table, uint16_t fa, uint16_t fb, int k)
+{
+    const short wa = short(table.weights[fa][k]);
+    const short wb = short(table.weights[fb][k]);
+    return _mm_setr_epi16(wa, wa, wa, wa, wb, wb, wb, wb);
+}
+
+// Both lerps on 8 lanes of 16 bits: two RGBA8 pixels or eight R8 pixels.
+__attribute__((target("sse4.1")))
+static inline __m128i BlendFixedSse41(__m128i t00, __m128i t10, __m128i t01, __m128i t11,
+    __m128i wx0, __m128i wx1, __m128i wy0, __m128i wy1, __m128i half, __m128i shift)
+{
+    const __m128i top = _mm_srl_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(t00, wx0), _mm_mullo_epi16(t10, wx1)), half), shift);
+    const __m128i bottom = _mm_srl_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(t01, wx0), _mm_mullo_epi16(t11, wx1)), half), shift);
+    return _mm_srl_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(top, wy0), _mm_mullo_epi16(bottom, wy1)), half), shift);
+}
+
+__attribute__((target("sse4.1")))
+static void BlendFixedRgba8Sse41(const Sampler& sampler, const FixedTap* taps, int count, const FixedWeightTable& table, float* target)
+{
+    const uint8_t* texels = (const uint8_t*)sampler.texels;
+    const __m128i half = _mm_set1_epi16(short(1 << (table.bits - 1)));
+    const __m128i shift = _mm_cvtsi32_si128(table.bits);
+    const __m128 unorm = _mm_set1_ps(1.0f / 255.0f);
+
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const FixedTap& a = taps[i];
+        const FixedTap& b = taps[i + 1];
+        const __m128i result = BlendFixedSse41(
+            LoadRgba8PairSse41(texels, a, b, 0, 0), LoadRgba8PairSse41(texels, a, b, a.stepX, b.stepX),
+            LoadRgba8PairSse41(texels, a, b, a.stepY, b.stepY), LoadRgba8PairSse41(texels, a, b, a.stepY + a.stepX, b.stepY + b.stepX),
+            WeightPairSse41(table, a.fx, b.fx, 0), WeightPairSse41(table, a.fx, b.fx, 1),
+            WeightPairSse41(table, a.fy, b.fy, 0), WeightPairSse41(table, a.fy, b.fy, 1), half, shift);
+
+        _mm_storeu_ps(target + i * 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(result)), unorm));
+        _mm_storeu_ps(target + i * 4 + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(result, 8))), unorm));
+    }
+    BlendFixedSpan<uint8_t, 4>(sampler, taps + i, count - i, table, target + i * 4);
+}
+
+__attribute__((target("sse4.1")))
+static void BlendFixedR8Sse41(const Sampler& sampler, const FixedTap* taps, int count, const FixedWeightTable& table, float* target)
+{
+    const uint8_t* texels = (const uint8_t*)sampler.texels;
+    const __m128i half = _mm_set1_epi16(short(1 << (table.bits - 1)));
+    const __m128i shift = _mm_cvtsi32_si128(table.bits);
+    const __m128 unorm = _mm_set1_ps(1.0f / 255.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        alignas(16) uint16_t lanes[8][8];
+        for (int j = 0; j < 8; ++j) {
+            const FixedTap& tap = taps[i + j];
+            const uint8_t* p00 = texels + tap.texel;
+            lanes[0][j] = p00[0];
+            lanes[1][j] = p00[tap.stepX];
+            lanes[2][j] = p00[tap.stepY];
+            lanes[3][j] = p00[tap.stepY + tap.stepX];
+            lanes[4][j] = table.weights[tap.fx][0];
+            lanes[5][j] = table.weights[tap.fx][1];
+            lanes[6][j] = table.weights[tap.fy][0];
+            lanes[7][j] = table.weights[tap.fy][1];
+        }
+        __m128i v[8];
+        for (int k = 0; k < 8; ++k)
+            v[k] = _mm_load_si128((const __m128i*)lanes[k]);
+        const __m128i result = BlendFixedSse41(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], half, shift);
+
+        alignas(16) float values[8];
+        _mm_store_ps(values, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(result)), unorm));
+        _mm_store_ps(values + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(result, 8))), unorm));
+        for (int j = 0; j < 8; ++j)
+            _mm_storeu_ps(target + (i + j) * 4, _mm_blend_ps(_mm_set1_ps(values[j]), one, 8));
+    }
+    BlendFixedSpan<uint8_t, 1>(sampler, taps + i, count - i, table, target + i * 4);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static void BlendFixedRgba8Neon(const Sampler& sampler, const FixedTap* taps, int count, const FixedWeightTable& table, float* target)
+{
+    const uint8_t* texels = (const uint8_t*)sampler.texels;
+    const uint16x8_t half = vdupq_n_u16(uint16_t(1 << (table.bits - 1)));
+    const int16x8_t shift = vdupq_n_s16(int16_t(-table.bits));
+    const float32x4_t unorm = vdupq_n_f32(1.0f / 255.0f);
+
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const FixedTap& a = taps[i];
+        const FixedTap& b = taps[i + 1];
+        auto footprint = [&](ptrdiff_t stepA, ptrdiff_t stepB) {
+            const uint64_t pair = LoadRgba8(texels, ptrdiff_t(a.texel) + stepA) | (uint64_t(LoadRgba8(texels, ptrdiff_t(b.texel) + stepB)) << 32);
+            return vmovl_u8(vcreate_u8(pair));
+        };
+        auto weight = [&](uint16_t fa, uint16_t fb, int k) {
+            return vcombine_u16(vdup_n_u16(table.weights[fa][k]), vdup_n_u16(table.weights[fb][k]));
+        };
+        const uint16x8_t wx0 = weight(a.fx, b.fx, 0);
+        const uint16x8_t wx1 = weight(a.fx, b.fx, 1);
+        const uint16x8_t wy0 = weight(a.fy, b.fy, 0);
+        const uint16x8_t wy1 = weight(a.fy, b.fy, 1);
+        const uint16x8_t top = vshlq_u16(vaddq_u16(vaddq_u16(vmulq_u16(footprint(0, 0), wx0), vmulq_u16(footprint(a.stepX, b.stepX), wx1)), half), shift);
+        const uint16x8_t bottom = vshlq_u16(vaddq_u16(vaddq_u16(vmulq_u16(footprint(a.stepY, b.stepY), wx0),
+            vmulq_u16(footprint(a.stepY + a.stepX, b.stepY + b.stepX), wx1)), half), shift);
+        const uint16x8_t result = vshlq_u16(vaddq_u16(vaddq_u16(vmulq_u16(top, wy0), vmulq_u16(bottom, wy1)), half), shift);
+
+        vst1q_f32(target + i * 4, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(result))), unorm));
+        vst1q_f32(target + i * 4 + 4, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(result))), unorm));
+    }
+    BlendFixedSpan<uint8_t, 4>(sampler, taps + i, count - i, table, target + i * 4);
+}
+#endif
+
+struct SrgbTable
+{
+    float linear[256];
+
+    SrgbTable()
+    {
+        for (int i = 0; i < 256; ++i)
+            linear[i] = SrgbToLinear(i / 255.0f);
+    }
+};
+
+static const SrgbTable& Srgb()
+{
+    static const SrgbTable table;
+    return table;
+}
+
+static void SrgbToLinearScalar(const float* table, const uint8_t* texels, int channels, size_t count, float* target)
+{
+    for (size_t i = 0; i < count; ++i, texels += channels, target += 4) {
+        target[0] = table[texels[0]];
+        target[1] = table[texels[1]];
+        target[2] = table[texels[2]];
+        target[3] = channels == 4 ? texels[3] * (1.0f / 255) : 1.0f;
+    }
+}
+
+#if defined(CPU_WARP_X86)
+// Two RGBA8 texels per gather; the alpha lanes are scaled instead
+__attribute__((target("avx2")))
+static void SrgbToLinearRgba8Avx2(const float* table, const uint8_t* texels, size_t count, float* target)
+{
+    const __m256 alphaMask = _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1));
+    const __m256 unorm = _mm256_set1_ps(1.0f / 255);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(texels + i * 4)));
+        const __m256 linear = _mm256_i32gather_ps(table, index, 4);
+        const __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(index), unorm);
+        _mm256_storeu_ps(target + i * 4, _mm256_blendv_ps(linear, alpha, alphaMask));
+    }
+    SrgbToLinearScalar(table, texels + i * 4, 4, count - i, target + i * 4);
+}
+#endif
+
+void SrgbToLinear(CpuKernels kernels, const uint8_t* texels, int channels, size_t count, float* target)
+{
+    const float* table = Srgb().linear;
+#if defined(CPU_WARP_X86)
+    if (kernels == CpuKernels::Avx2 && channels == 4) {
+        SrgbToLinearRgba8Avx2(table, texels, count, target);
+        return;
+    }
+#endif
+    (void)kernels;
+    SrgbToLinearScalar(table, texels, channels, count, target);
+}
+
+bool KernelsSupported(CpuKernels kernels)
+{
+    switch (kernels) {
+    case CpuKernels::Scalar:
+        return true;
+#if defined(CPU_WARP_X86)
+    case CpuKernels::Sse41:
+        return __builtin_cpu_supports("sse4.1");
+    case CpuKernels::Avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+    case CpuKernels::Neon:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+SpanKernel SelectSpanKernel(CpuKernels kernels, const Sampler& sampler)
+{
+    if (sampler.format == PixelFormat::NV12 || sampler.format == PixelFormat::I420)
+        return nullptr;
+
+    if (sampler.format == PixelFormat::RGBA32F && (sampler.filter == Filter::Nearest || sampler.filter == Filter::Linear)) {
+        const bool nearest = sampler.filter == Filter::Nearest;
+        switch (kernels) {
+#if defined(CPU_WARP_X86)
+        case CpuKernels::Sse41:
+            return nearest ? NearestRgbaSse41 : LinearRgbaSse41;
+        case CpuKernels::Avx2:
+            return nearest ? NearestRgbaAvx2 : LinearRgbaAvx2;
+#endif
+#if defined(__ARM_NEON)
+        case CpuKernels::Neon:
+            return nearest ? NearestRgbaNeon : LinearRgbaNeon;
+#endif
+        default:
+            break;
+        }
+    }
+
+    return ScalarKernels[int(FormatSampleType(sampler.format))][ChannelCount(sampler.format) - 1][int(sampler.filter)];
+}
+
+FixedBlendKernel SelectFixedBlendKernel(CpuKernels kernels, PixelFormat format)
+{
+    const SampleType type = FormatSampleType(format);
+    if (format == PixelFormat::NV12 || format == PixelFormat::I420 || (type != SampleType::U8 && type != SampleType::U16))
+        return nullptr;
+
+    switch (kernels) {
+#if defined(CPU_WARP_X86)
+    case CpuKernels::Sse41:
+    case CpuKernels::Avx2:
+        if (format == PixelFormat::RGBA8)
+            return BlendFixedRgba8Sse41;
+        if (format == PixelFormat::R8)
+            return BlendFixedR8Sse41;
+        break;
+#endif
+#if defined(__ARM_NEON)
+    case CpuKernels::Neon:
+        if (format == PixelFormat::RGBA8)
+            return BlendFixedRgba8Neon;
+        break;
+#endif
+    default:
+        break;
+    }
+
+    return ScalarFixedKernels[type == SampleType::U8 ? 0 : 1][ChannelCount(format) - 1];
+}
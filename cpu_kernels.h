@@ -0,0 +1,75 @@
+#ifndef CPU_KERNELS_H
+#define CPU_KERNELS_H
+
+#include <stdint.h>
+
+#include "warp.h"
+
+// Instruction sets of the CPU kernels. Best picks the widest one the host
+// supports at runtime; NEON is only available in builds with WITH_NEON=1.
+enum class CpuKernels { Best, Scalar, Sse41, Avx2, Neon };
+
+bool KernelsSupported(CpuKernels kernels);
+
+// Source image and filter as seen by the span kernels.
+struct Sampler
+{
+    PixelFormat format;
+    int width;
+    int height;
+    const void* texels;
+    Filter filter;
+};
+
+// Samples count pixels whose normalized source coordinates are
+// (u + i * du, v + i * dv) and writes them as RGBA floats. Single-channel
+// sources are replicated to RGB; missing channels read as 0, alpha as 1.
+typedef void (*SpanKernel)(const Sampler& sampler, float u, float v, float du, float dv, int count, float* target);
+
+// Kernel for the sampler's format and filter, or nullptr for formats the
+// CPU cannot sample (NV12, I420).
+SpanKernel SelectSpanKernel(CpuKernels kernels, const Sampler& sampler);
+
+// Fixed-point bilinear filtering the way GPU texture units do it for 8-bit
+// textures: the texel-space coordinate is rounded to subpixelBits fraction
+// bits, and each of the two lerps is rounded back to the sample's integer
+// precision. 8-bit results are normalized by multiplying with 1 / 255.
+// subpixelBits is at most 8, so the lerps of 8-bit samples fit in 16 bits.
+
+// Weights (2^bits - f, f) for each fraction f.
+struct FixedWeightTable
+{
+    int bits;
+    uint16_t weights[256][2];
+};
+
+FixedWeightTable MakeFixedWeightTable(int subpixelBits);
+
+// Bilinear footprint of one target pixel: index of the top-left texel,
+// offsets from it to the right and lower neighbours (which wrap like
+// GL_REPEAT) and the quantized fractions.
+struct FixedTap
+{
+    uint32_t texel;
+    int32_t stepX;
+    int32_t stepY;
+    uint16_t fx;
+    uint16_t fy;
+};
+
+// Coordinates of a span as passed to a SpanKernel, resolved to taps.
+// Depends only on the source size, so taps can be reused across sources.
+void PlanFixedSpan(int sourceWidth, int sourceHeight, const FixedWeightTable& table,
+    float u, float v, float du, float dv, int count, FixedTap* taps);
+
+typedef void (*FixedBlendKernel)(const Sampler& sampler, const FixedTap* taps, int count, const FixedWeightTable& table, float* target);
+
+// Kernel for 8- and 16-bit integer formats, nullptr for the others.
+FixedBlendKernel SelectFixedBlendKernel(CpuKernels kernels, PixelFormat format);
+
+// Linearizes count sRGB-encoded RGB8 or RGBA8 texels (channels 3 or 4) to
+// RGBA floats through a 256-entry table; alpha is only normalized, and is
+// 1 for RGB8. AVX2 looks up eight samples per gather.
+void SrgbToLinear(CpuKernels kernels, const uint8_t* texels, int channels, size_t count, float* target);
+
+#endif
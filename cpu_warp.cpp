@@ -0,0 +1,420 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include "cpu_warp.h"
+#include "demosaic.h"
+#include "trace.h"
+
+using namespace std;
+
+CpuWarpEngine::CpuWarpEngine(CpuKernels kernels, unsigned threadCount)
+    : kernels(kernels), pool(threadCount)
+{
+    if (kernels == CpuKernels::Best || !KernelsSupported(kernels)) {
+        const CpuKernels preference[] = { CpuKernels::Avx2, CpuKernels::Neon, CpuKernels::Sse41, CpuKernels::Scalar };
+        for (auto candidate : preference) {
+            if (KernelsSupported(candidate)) {
+                this->kernels = candidate;
+                break;
+            }
+        }
+    }
+}
+
+const char* CpuWarpEngine::KernelsName(CpuKernels kernels)
+{
+    switch (kernels) {
+    case CpuKernels::Sse41: return "SSE4.1";
+    case CpuKernels::Avx2: return "AVX2";
+    case CpuKernels::Neon: return "NEON";
+    case CpuKernels::Scalar: return "scalar";
+    default: return "best";
+    }
+}
+
+// Mesh vertex in window coordinates (y up, pixel centers at i + 0.5) with
+// its normalized source coordinate.
+struct Vertex
+{
+    double x, y, u, v;
+};
+
+static double Edge(const Vertex& a, const Vertex& b, double px, double py)
+{
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+// Top-left rule for counter-clockwise triangles, so pixel centers on an
+// edge shared by two triangles are drawn once.
+static bool IsTopLeft(const Vertex& a, const Vertex& b)
+{
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    return dy < 0 || (dy == 0 && dx < 0);
+}
+
+// Pixel rectangle, end coordinates exclusive
+struct Rect
+{
+    int x0, y0, x1, y1;
+};
+
+// Walks the rows of a triangle inside clip and calls span(y, first, count,
+// u, v, du, dv) for each run of covered pixels.
+template <typename SpanFunction>
+static void RasterizeTriangle(Vertex v0, Vertex v1, Vertex v2, const Rect& clip, SpanFunction span)
+{
+    double area = Edge(v0, v1, v2.x, v2.y);
+    if (area == 0)
+        return;
+    if (area < 0) {
+        swap(v1, v2);
+        area = -area;
+    }
+
+    const Vertex* edges[3][2] = { { &v1, &v2 }, { &v2, &v0 }, { &v0, &v1 } };
+    const double* attributes[3][2] = { { &v0.u, &v0.v }, { &v1.u, &v1.v }, { &v2.u, &v2.v } };
+    double stepX[3];
+    bool topLeft[3];
+    double duDx = 0, dvDx = 0;
+    for (int e = 0; e < 3; ++e) {
+        stepX[e] = -(edges[e][1]->y - edges[e][0]->y);
+        topLeft[e] = IsTopLeft(*edges[e][0], *edges[e][1]);
+        duDx += stepX[e] * *attributes[e][0];
+        dvDx += stepX[e] * *attributes[e][1];
+    }
+    duDx /= area;
+    dvDx /= area;
+
+    const int xMin = int(max(double(clip.x0), floor(min(v0.x, min(v1.x, v2.x)))));
+    const int xMax = int(min(double(clip.x1 - 1), ceil(max(v0.x, max(v1.x, v2.x)))));
+    const int yMin = int(max(double(clip.y0), floor(min(v0.y, min(v1.y, v2.y)))));
+    const int yMax = int(min(double(clip.y1 - 1), ceil(max(v0.y, max(v1.y, v2.y)))));
+
+    for (int y = yMin; y <= yMax; ++y) {
+        const double py = y + 0.5;
+        double e[3];
+        for (int k = 0; k < 3; ++k)
+            e[k] = Edge(*edges[k][0], *edges[k][1], xMin + 0.5, py);
+
+        // Covered pixels of a row are contiguous in a convex triangle
+        int first = -1;
+        int last = -1;
+        for (int x = xMin; x <= xMax; ++x) {
+            bool inside = true;
+            for (int k = 0; k < 3; ++k)
+                inside = inside && (e[k] > 0 || (e[k] == 0 && topLeft[k]));
+            if (inside) {
+                if (first < 0)
+                    first = x;
+                last = x;
+            }
+            else if (first >= 0) {
+                break;
+            }
+            for (int k = 0; k < 3; ++k)
+                e[k] += stepX[k];
+        }
+        if (first < 0)
+            continue;
+
+        const double px = first + 0.5;
+        double u = 0, v = 0;
+        for (int k = 0; k < 3; ++k) {
+            const double weight = Edge(*edges[k][0], *edges[k][1], px, py);
+            u += weight * *attributes[k][0];
+            v += weight * *attributes[k][1];
+        }
+        span(y, first, last - first + 1, float(u / area), float(v / area), float(duDx), float(dvDx));
+    }
+}
+
+// Output tiles of 64x64 RGBA32F pixels take 64 KiB, which leaves room in a
+// typical L2 cache for the source texels they read at moderate scales.
+static const int TileSize = 64;
+
+// Target tiles with the triangles overlapping them, and the order in which
+// they are handed to the pool.
+struct TileGrid
+{
+    int tilesX;
+    vector<Vertex> vertices;    // three per triangle
+    vector<vector<unsigned>> bins;
+    vector<int> order;
+};
+
+static TileGrid MakeTileGrid(const WarpMesh& mesh, int width, int height, int sourceHeight)
+{
+    TileGrid grid;
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        for (int k = 0; k < 3; ++k) {
+            const unsigned short index = mesh.indices[i + k];
+            grid.vertices.push_back({
+                (mesh.targetGrid[index * 2] + 1) * 0.5 * width,
+                (mesh.targetGrid[index * 2 + 1] + 1) * 0.5 * height,
+                mesh.sourceGrid[index * 2],
+                mesh.sourceGrid[index * 2 + 1]
+            });
+        }
+    }
+
+    // Bin triangles by the tiles their bounding boxes overlap
+    const vector<Vertex>& vertices = grid.vertices;
+    const int tilesX = (width + TileSize - 1) / TileSize;
+    const int tilesY = (height + TileSize - 1) / TileSize;
+    grid.tilesX = tilesX;
+    grid.bins.resize(size_t(tilesX) * tilesY);
+    for (size_t t = 0; t < vertices.size(); t += 3) {
+        const Vertex* v = &vertices[t];
+        const double xMin = min(v[0].x, min(v[1].x, v[2].x)), xMax = max(v[0].x, max(v[1].x, v[2].x));
+        const double yMin = min(v[0].y, min(v[1].y, v[2].y)), yMax = max(v[0].y, max(v[1].y, v[2].y));
+        const int tx0 = int(max(0.0, floor(xMin / TileSize))), tx1 = int(min(tilesX - 1.0, floor(xMax / TileSize)));
+        const int ty0 = int(max(0.0, floor(yMin / TileSize))), ty1 = int(min(tilesY - 1.0, floor(yMax / TileSize)));
+        for (int ty = ty0; ty <= ty1; ++ty) {
+            for (int tx = tx0; tx <= tx1; ++tx)
+                grid.bins[size_t(ty) * tilesX + tx].push_back(unsigned(t));
+        }
+    }
+
+    // Order tiles by the band of source rows their centers map to, then
+    // along the band, so consecutive tiles (which mostly run on the same
+    // thread) read the same source rows while they are still cached.
+    struct Tile
+    {
+        int index;
+        double band;
+        double u;
+    };
+    vector<Tile> tiles;
+    for (int i = 0; i < tilesX * tilesY; ++i) {
+        Tile tile = { i, -1, 0 };
+        if (!grid.bins[i].empty()) {
+            const Vertex* v = &vertices[grid.bins[i][0]];
+            const double px = (i % tilesX + 0.5) * TileSize;
+            const double py = (i / tilesX + 0.5) * TileSize;
+            const double area = Edge(v[0], v[1], v[2].x, v[2].y);
+            if (area != 0) {
+                const double w0 = Edge(v[1], v[2], px, py) / area;
+                const double w1 = Edge(v[2], v[0], px, py) / area;
+                const double w2 = 1 - w0 - w1;
+                tile.band = floor((w0 * v[0].v + w1 * v[1].v + w2 * v[2].v) * sourceHeight / TileSize);
+                tile.u = w0 * v[0].u + w1 * v[1].u + w2 * v[2].u;
+            }
+        }
+        tiles.push_back(tile);
+    }
+    stable_sort(tiles.begin(), tiles.end(), [](const Tile& a, const Tile& b) {
+        return a.band != b.band ? a.band < b.band : a.u < b.u;
+    });
+    for (const Tile& tile : tiles)
+        grid.order.push_back(tile.index);
+    return grid;
+}
+
+static Rect TileRect(int tilesX, int index, int width, int height)
+{
+    const int x = index % tilesX * TileSize;
+    const int y = index / tilesX * TileSize;
+    return { x, y, min(width, x + TileSize), min(height, y + TileSize) };
+}
+
+static void ClearRect(float* target, int width, const Rect& rect)
+{
+    for (int y = rect.y0; y < rect.y1; ++y)
+        memset(target + (size_t(y) * width + rect.x0) * 4, 0, size_t(rect.x1 - rect.x0) * 4 * sizeof(float));
+}
+
+// Taps of every covered target pixel of a fixed-point warp, grouped per tile
+// in rasterization order. They depend on the mesh and the image sizes only,
+// so repeated warps of new frames skip rasterization and coordinate math.
+struct FixedPointPlan
+{
+    struct Span
+    {
+        size_t pixel;   // y * width + first
+        int count;
+    };
+
+    struct Tile
+    {
+        vector<Span> spans;
+        vector<FixedTap> taps;
+    };
+
+    WarpMesh mesh;
+    int sourceWidth;
+    int sourceHeight;
+    int targetWidth;
+    int targetHeight;
+    FixedWeightTable table;
+    int tilesX;
+    vector<int> order;
+    vector<Tile> tiles;
+
+    bool Matches(const WarpJob& job, int subpixelBits) const
+    {
+        return job.source.width == sourceWidth && job.source.height == sourceHeight
+            && job.target.width == targetWidth && job.target.height == targetHeight && table.bits == subpixelBits
+            && job.mesh->indices == mesh.indices && job.mesh->sourceGrid == mesh.sourceGrid && job.mesh->targetGrid == mesh.targetGrid;
+    }
+};
+
+CpuWarpEngine::~CpuWarpEngine()
+{
+}
+
+void CpuWarpEngine::SetSubpixelBits(int bits)
+{
+    subpixelBits = max(1, min(8, bits));
+}
+
+// Interleaved 8-bit sources filtered with Sampling::Hardware take the
+// fixed-point path, like the texture unit filters them in the GL engine.
+// 16-bit integer sources stay on fp32 weights, as the GL engine filters
+// them in the shader.
+static bool FixedPointFiltering(const WarpJob& job)
+{
+    return job.sampling == Sampling::Hardware && job.filter == Filter::Linear && PlaneCount(job.source.format) == 1 &&
+        FormatSampleType(job.source.format) == SampleType::U8;
+}
+
+void CpuWarpEngine::RunTiles(size_t count, const function<size_t(size_t)>& tile)
+{
+    threadStats.assign(pool.ThreadCount(), CpuThreadStats());
+    pool.Run(count, [&](size_t task, unsigned thread) {
+        TRACE_SCOPE("tile");
+        const auto start = chrono::steady_clock::now();
+        const size_t pixels = tile(task);
+
+        CpuThreadStats& stats = threadStats[thread];
+        stats.tiles += 1;
+        stats.pixels += pixels;
+        stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    });
+}
+
+void CpuWarpEngine::PlanFixedPoint(const WarpJob& job)
+{
+    TRACE_SCOPE("plan fixed point");
+    const int width = job.target.width;
+    const int height = job.target.height;
+    const TileGrid grid = MakeTileGrid(*job.mesh, width, height, job.source.height);
+
+    fixedPointPlan.reset(new FixedPointPlan);
+    FixedPointPlan& plan = *fixedPointPlan;
+    plan.mesh = *job.mesh;
+    plan.sourceWidth = job.source.width;
+    plan.sourceHeight = job.source.height;
+    plan.targetWidth = width;
+    plan.targetHeight = height;
+    plan.table = MakeFixedWeightTable(subpixelBits);
+    plan.tilesX = grid.tilesX;
+    plan.order = grid.order;
+    plan.tiles.resize(grid.bins.size());
+
+    pool.Run(grid.order.size(), [&](size_t task, unsigned) {
+        const int index = grid.order[task];
+        FixedPointPlan::Tile& tile = plan.tiles[index];
+        for (unsigned t : grid.bins[index]) {
+            RasterizeTriangle(grid.vertices[t], grid.vertices[t + 1], grid.vertices[t + 2], TileRect(grid.tilesX, index, width, height),
+                [&](int y, int first, int count, float u, float v, float du, float dv) {
+                    tile.spans.push_back({ size_t(y) * width + first, count });
+                    tile.taps.resize(tile.taps.size() + count);
+                    PlanFixedSpan(plan.sourceWidth, plan.sourceHeight, plan.table, u, v, du, dv, count, &tile.taps[tile.taps.size() - count]);
+                });
+        }
+    });
+}
+
+bool CpuWarpEngine::Run(const WarpJob& job)
+{
+    if (!job.mesh || job.target.format != PixelFormat::RGBA32F || job.target.encoding != ColorEncoding::Linear ||
+        !IsPacked(job.source) || !IsPacked(job.target))
+        return false;
+
+    if (job.source.bayer != BayerPattern::None) {
+        convertedSource.resize(size_t(job.source.width) * job.source.height * 4);
+        const ImageView rgb = MakeImageView(PixelFormat::RGBA32F, job.source.width, job.source.height, convertedSource.data());
+        {
+            TRACE_SCOPE("CPU demosaic");
+            if (!DemosaicBayer(job.source, job.demosaic, rgb, &pool))
+                return false;
+        }
+        WarpJob demosaiced = job;
+        demosaiced.source = rgb;
+        return Run(demosaiced);
+    }
+
+    // sRGB sources are linearized into a float copy for the float kernels
+    if (job.source.encoding == ColorEncoding::Srgb) {
+        if (job.source.format != PixelFormat::RGB8 && job.source.format != PixelFormat::RGBA8)
+            return false;
+        const int channels = ChannelCount(job.source.format);
+        const size_t width = job.source.width;
+        convertedSource.resize(width * job.source.height * 4);
+        {
+            TRACE_SCOPE("CPU sRGB decode");
+            pool.Run(job.source.height, [&](size_t y, unsigned) {
+                SrgbToLinear(kernels, (const uint8_t*)job.source.planes[0] + y * width * channels, channels, width,
+                    convertedSource.data() + y * width * 4);
+            });
+        }
+        WarpJob linear = job;
+        linear.source = MakeImageView(PixelFormat::RGBA32F, job.source.width, job.source.height, convertedSource.data());
+        return Run(linear);
+    }
+
+    TRACE_SCOPE("CPU warp");
+    const Sampler sampler = { job.source.format, job.source.width, job.source.height, job.source.planes[0], job.filter };
+    const int width = job.target.width;
+    const int height = job.target.height;
+    float* target = (float*)job.target.planes[0];
+
+    if (FixedPointFiltering(job)) {
+        const FixedBlendKernel blend = SelectFixedBlendKernel(kernels, job.source.format);
+        if (!blend)
+            return false;
+        if (!fixedPointPlan || !fixedPointPlan->Matches(job, subpixelBits))
+            PlanFixedPoint(job);
+
+        const FixedPointPlan& plan = *fixedPointPlan;
+        RunTiles(plan.order.size(), [&](size_t task) {
+            const int index = plan.order[task];
+            const Rect rect = TileRect(plan.tilesX, index, width, height);
+            ClearRect(target, width, rect);
+            const FixedPointPlan::Tile& tile = plan.tiles[index];
+            const FixedTap* taps = tile.taps.data();
+            for (const auto& span : tile.spans) {
+                blend(sampler, taps, span.count, plan.table, target + span.pixel * 4);
+                taps += span.count;
+            }
+            return size_t(rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+        });
+        return true;
+    }
+
+    const SpanKernel kernel = SelectSpanKernel(kernels, sampler);
+    if (!kernel)
+        return false;
+
+    const TileGrid grid = MakeTileGrid(*job.mesh, width, height, job.source.height);
+    RunTiles(grid.order.size(), [&](size_t task) {
+        const int index = grid.order[task];
+        const Rect rect = TileRect(grid.tilesX, index, width, height);
+        ClearRect(target, width, rect);
+        for (unsigned t : grid.bins[index]) {
+            RasterizeTriangle(grid.vertices[t], grid.vertices[t + 1], grid.vertices[t + 2], rect,
+                [&](int y, int first, int count, float u, float v, float du, float dv) {
+                    kernel(sampler, u, v, du, dv, count, target + (size_t(y) * width + first) * 4);
+                });
+        }
+        return size_t(rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+    });
+
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef CPU_WARP_H
+#define CPU_WARP_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cpu_kernels.h"
+#include "thread_pool.h"
+#include "warp.h"
+
+// Work done by one pool thread during the last Run(); seconds is the time
+// spent on its tiles, not including waiting.
+struct CpuThreadStats
+{
+    size_t tiles = 0;
+    size_t pixels = 0;
+    double seconds = 0;
+};
+
+struct FixedPointPlan;
+
+// Rasterizes the warp mesh on the CPU with the GL path's conventions: pixel
+// centers at (i + 0.5) / size, GL_REPEAT wrapping and uncovered pixels
+// cleared to zero. Weights are fp32, as with Sampling::Manual, and the
+// fraction is snapped to 1/65536 texel in the same way, except on the
+// fixed-point path below.
+//
+// Supports every interleaved source format with every filter through
+// kernels specialized per sample type, channel count and filter; nearest
+// and linear on RGBA32F sources also have SIMD kernels.
+//
+// The target is split into 64x64 tiles ordered by the source rows they read
+// and spread over a work-stealing thread pool; threadCount 0 uses every
+// hardware thread.
+//
+// Linear filtering of 8-bit sources with Sampling::Hardware emulates a GPU
+// texture unit in fixed point with SubpixelBits() fraction
+// bits (see cpu_kernels.h). Its per-pixel taps are cached, so repeating a
+// warp with the same mesh and image sizes only gathers and blends.
+//
+// Sources and targets must be tightly packed.
+//
+// sRGB RGB8 and RGBA8 sources are linearized through a lookup table first,
+// and Bayer mosaics demosaiced by DemosaicBayer(), and then filtered like
+// RGBA32F.
+class CpuWarpEngine : public WarpEngine
+{
+public:
+    explicit CpuWarpEngine(CpuKernels kernels = CpuKernels::Best, unsigned threadCount = 0);
+    ~CpuWarpEngine() override;
+
+    bool Run(const WarpJob& job) override;
+    const char* Name() const override { return "CPU"; }
+
+    CpuKernels Kernels() const { return kernels; }
+    static const char* KernelsName(CpuKernels kernels);
+
+    unsigned ThreadCount() const { return pool.ThreadCount(); }
+    const std::vector<CpuThreadStats>& ThreadStats() const { return threadStats; }
+
+    // 1 to 8, 8 by default like most GPUs.
+    int SubpixelBits() const { return subpixelBits; }
+    void SetSubpixelBits(int bits);
+
+private:
+    // Runs tile(task) for every task on the pool; tile returns its pixel count.
+    void RunTiles(size_t count, const std::function<size_t(size_t)>& tile);
+    void PlanFixedPoint(const WarpJob& job);
+
+    CpuKernels kernels;
+    ThreadPool pool;
+    std::vector<CpuThreadStats> threadStats;
+    int subpixelBits = 8;
+    std::unique_ptr<FixedPointPlan> fixedPointPlan;
+    std::vector<float> convertedSource;     // sRGB and Bayer sources as RGBA32F
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "demosaic.h"
+
+void BayerRedOrigin(BayerPattern pattern, int& x, int& y)
+{
+    x = pattern == BayerPattern::GRBG || pattern == BayerPattern::BGGR;
+    y = pattern == BayerPattern::GBRG || pattern == BayerPattern::BGGR;
+}
+
+template <typename Sample>
+class Mosaic
+{
+public:
+    Mosaic(const ImageView& image, float scale) :
+        samples((const Sample*)image.planes[0]), width(image.width), height(image.height),
+        rowLength(RowLength(image, 0)), scale(scale) {}
+
+    float operator()(int x, int y) const
+    {
+        x = Mirror(abs(x), width - 1);
+        y = Mirror(abs(y), height - 1);
+        return samples[size_t(y) * rowLength + x] * scale;
+    }
+
+private:
+    // Reflecting once is not enough for sides of one or two pixels, which
+    // clamp to the first one instead.
+    static int Mirror(int i, int last)
+    {
+        const int mirrored = last - abs(last - i);
+        return mirrored < 0 ? 0 : mirrored;
+    }
+
+    const Sample* samples;
+    int width;
+    int height;
+    int rowLength;
+    float scale;
+};
+
+// The expressions follow the shader term by term
+template <typename Sample>
+static void DemosaicRow(const Mosaic<Sample>& m, Demosaic method, int redX, int redY, int y, int width, float* target)
+{
+    for (int x = 0; x < width; ++x, target += 4) {
+        const float c = m(x, y);
+        const float h1 = m(x - 1, y) + m(x + 1, y);
+        const float v1 = m(x, y - 1) + m(x, y + 1);
+        const float d = m(x - 1, y - 1) + m(x + 1, y - 1) + m(x - 1, y + 1) + m(x + 1, y + 1);
+        float green, across, alongRow, alongColumn;
+        if (method == Demosaic::Malvar) {
+            const float h2 = m(x - 2, y) + m(x + 2, y);
+            const float v2 = m(x, y - 2) + m(x, y + 2);
+            green = (4.0f * c + 2.0f * (h1 + v1) - (h2 + v2)) / 8.0f;
+            across = (6.0f * c + 2.0f * d - 1.5f * (h2 + v2)) / 8.0f;
+            alongRow = (5.0f * c + 4.0f * h1 - d - h2 + 0.5f * v2) / 8.0f;
+            alongColumn = (5.0f * c + 4.0f * v1 - d - v2 + 0.5f * h2) / 8.0f;
+        } else {
+            green = (h1 + v1) / 4.0f;
+            across = d / 4.0f;
+            alongRow = h1 / 2.0f;
+            alongColumn = v1 / 2.0f;
+        }
+
+        const int px = (x - redX) & 1;
+        const int py = (y - redY) & 1;
+        if (px == py) {
+            target[0] = px == 0 ? c : across;
+            target[1] = green;
+            target[2] = px == 0 ? across : c;
+        } else {
+            target[0] = py == 0 ? alongRow : alongColumn;
+            target[1] = c;
+            target[2] = py == 0 ? alongColumn : alongRow;
+        }
+        target[3] = 1.0f;
+    }
+}
+
+template <typename Sample>
+static void DemosaicImage(const ImageView& source, float scale, Demosaic method, const ImageView& target, ThreadPool* pool)
+{
+    const Mosaic<Sample> mosaic(source, scale);
+    int redX, redY;
+    BayerRedOrigin(source.bayer, redX, redY);
+    auto row = [&](size_t y, unsigned) {
+        DemosaicRow(mosaic, method, redX, redY, int(y), source.width, (float*)target.planes[0] + y * RowLength(target, 0) * 4);
+    };
+    if (pool)
+        pool->Run(source.height, row);
+    else
+        for (int y = 0; y < source.height; ++y)
+            row(y, 0);
+}
+
+bool DemosaicBayer(const ImageView& source, Demosaic method, const ImageView& target, ThreadPool* pool)
+{
+    if (source.bayer == BayerPattern::None || target.format != PixelFormat::RGBA32F ||
+        target.width != source.width || target.height != source.height)
+        return false;
+
+    switch (source.format) {
+    case PixelFormat::R8:
+        DemosaicImage<uint8_t>(source, 1.0f / 255, method, target, pool);
+        return true;
+    case PixelFormat::R16UI:
+        DemosaicImage<uint16_t>(source, 1.0f, method, target, pool);
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef DEMOSAIC_H
+#define DEMOSAIC_H
+
+#include "image.h"
+#include "thread_pool.h"
+
+// Interpolates a Bayer mosaic, an R8 or R16UI source with a pattern set, to
+// an RGBA32F target of the same size with alpha 1. R8 samples are
+// normalized and R16UI samples stay raw counts, like the warp engines read
+// them. Neighbours beyond the edges are mirrored without repeating the
+// edge pixel, which keeps the color filter phase; sides shorter than three
+// pixels clamp to the first one. The same arithmetic as the GL engine's
+// fused path, so warping the result on the CPU is its reference. Rows are
+// spread over pool when given.
+bool DemosaicBayer(const ImageView& source, Demosaic method, const ImageView& target, ThreadPool* pool = nullptr);
+
+// Column and row of the red sample within the pattern's 2x2 quad.
+void BayerRedOrigin(BayerPattern pattern, int& x, int& y);
+
+#endif
@@ -0,0 +1,292 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#include "engine_selector.h"
+#include "host_buffer.h"
+#include "trace.h"
+
+using namespace std;
+
+static const int CalibrationRuns = 5;
+static const int SmallSize = 4;
+static const int LargeSize = 256;
+
+static size_t SourceBytes(const ImageView& source)
+{
+    size_t bytes = 0;
+    for (int plane = 0; plane < PlaneCount(source.format); ++plane)
+        bytes += PlaneBytes(source.format, plane, source.width, source.height);
+    return bytes;
+}
+
+CostFormat SourceCostFormat(const ImageView& source)
+{
+    if (source.bayer != BayerPattern::None)
+        return CostFormat::Bayer;
+    if (source.encoding == ColorEncoding::Srgb)
+        return CostFormat::Srgb8;
+    if (source.format == PixelFormat::RGBA32F)
+        return CostFormat::Rgba32F;
+    if (source.format == PixelFormat::NV12 || source.format == PixelFormat::I420)
+        return CostFormat::Unorm8;
+
+    switch (FormatSampleType(source.format)) {
+    case SampleType::U8: return CostFormat::Unorm8;
+    case SampleType::U16: return CostFormat::Uint16;
+    default: return CostFormat::Float;
+    }
+}
+
+// Only linear filtering differs between the texture unit and fp32 weights;
+// the other filters and samplings are priced like Sampling::Manual.
+double EngineCost::Estimate(const WarpJob& job) const
+{
+    const int format = int(SourceCostFormat(job.source));
+    const double pixel = job.sampling == Sampling::Hardware && job.filter == Filter::Linear ?
+        hardwareLinearPixelSeconds[format] : pixelSeconds[format][int(job.filter)];
+
+    return jobSeconds + SourceBytes(job.source) * sourceByteSeconds + double(job.source.width) * job.source.height * sourcePixelSeconds[format] +
+        double(job.target.width) * job.target.height * pixel;
+}
+
+EngineSelector::EngineSelector(GlWarpEngine& gl, CpuWarpEngine& cpu)
+    : gl(gl), cpu(cpu)
+{
+}
+
+WarpEngine& EngineSelector::Choose(const WarpJob& job)
+{
+    if (cpuCost.Estimate(job) < glCost.Estimate(job))
+        return cpu;
+    return gl;
+}
+
+bool EngineSelector::Run(const WarpJob& job)
+{
+    WarpEngine& first = Choose(job);
+    if (first.Run(job))
+        return true;
+    WarpEngine& second = &first == &cpu ? static_cast<WarpEngine&>(gl) : static_cast<WarpEngine&>(cpu);
+    return second.Run(job);
+}
+
+// Fastest of a few runs after a warm-up run, which also compiles shaders and
+// plans fixed-point taps. Fails if any run does.
+static bool TimeJob(WarpEngine& engine, const WarpJob& job, double& seconds)
+{
+    if (!engine.Run(job))
+        return false;
+    seconds = 1e9;
+    for (int i = 0; i < CalibrationRuns; ++i) {
+        const auto start = chrono::steady_clock::now();
+        if (!engine.Run(job))
+            return false;
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        seconds = min(seconds, elapsed.count());
+    }
+    return true;
+}
+
+// The representative source of each CostFormat, viewing floats for
+// Rgba32F and the 16-bit samples for the others.
+static ImageView CalibrationSource(CostFormat format, const float* floats, const uint16_t* samples)
+{
+    ImageView source;
+    switch (format) {
+    case CostFormat::Rgba32F: return MakeImageView(PixelFormat::RGBA32F, LargeSize, LargeSize, floats);
+    case CostFormat::Float: return MakeImageView(PixelFormat::RGBA16F, LargeSize, LargeSize, samples);
+    case CostFormat::Unorm8: return MakeImageView(PixelFormat::RGBA8, LargeSize, LargeSize, samples);
+    case CostFormat::Uint16: return MakeImageView(PixelFormat::R16UI, LargeSize, LargeSize, samples);
+    case CostFormat::Srgb8:
+        source = MakeImageView(PixelFormat::RGBA8, LargeSize, LargeSize, samples);
+        source.encoding = ColorEncoding::Srgb;
+        return source;
+    default:
+        source = MakeImageView(PixelFormat::R8, LargeSize, LargeSize, samples);
+        source.bayer = BayerPattern::RGGB;
+        return source;
+    }
+}
+
+// Three kinds of job separate the terms: a tiny one gives the per-job cost,
+// a large source with a tiny target the per-byte cost, and large sources
+// with large targets the per-pixel cost of each filter. Each CostFormat is
+// timed on its own, and those the CPU converts also with a tiny target for
+// the per-source-pixel cost.
+static bool MeasureCost(WarpEngine& engine, EngineCost& cost)
+{
+    const HostImage floatSource = AllocateImage(PixelFormat::RGBA32F, LargeSize, LargeSize);
+    const HostImage sampleSource = AllocateImage(PixelFormat::RGBA16F, LargeSize, LargeSize);
+    const HostImage targetImage = AllocateImage(PixelFormat::RGBA32F, LargeSize, LargeSize);
+    float* floats = floatSource.buffer.As<float>();
+    uint16_t* samples = sampleSource.buffer.As<uint16_t>();
+    unsigned seed = 5;
+    for (size_t i = 0; i < size_t(4) * LargeSize * LargeSize; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        floats[i] = (seed >> 8) / 16777216.0f;
+        samples[i] = uint16_t(seed >> 20);      // 12-bit counts, and finite as halves
+    }
+    const WarpMesh mesh = MakeRotationMesh(10, 0.9f);
+    const ImageView smallTarget = MakeImageView(PixelFormat::RGBA32F, SmallSize, SmallSize, targetImage.view.planes[0]);
+
+    WarpJob job;
+    job.mesh = &mesh;
+    double seconds;
+
+    job.source = MakeImageView(PixelFormat::RGBA32F, SmallSize, SmallSize, floats);
+    job.target = smallTarget;
+    if (!TimeJob(engine, job, cost.jobSeconds))
+        return false;
+
+    job.source = floatSource.view;
+    if (!TimeJob(engine, job, seconds))
+        return false;
+    cost.sourceByteSeconds = max(0.0, (seconds - cost.jobSeconds) / SourceBytes(job.source));
+
+    const double pixels = double(LargeSize) * LargeSize;
+    for (int format = 0; format < CostFormatCount; ++format) {
+        job.source = CalibrationSource(CostFormat(format), floats, samples);
+        job.sampling = Sampling::Manual;
+        job.filter = Filter::Nearest;
+        const double uploadSeconds = cost.jobSeconds + SourceBytes(job.source) * cost.sourceByteSeconds;
+        if (CostFormat(format) == CostFormat::Srgb8 || CostFormat(format) == CostFormat::Bayer) {
+            job.target = smallTarget;
+            if (!TimeJob(engine, job, seconds))
+                return false;
+            cost.sourcePixelSeconds[format] = max(0.0, (seconds - uploadSeconds) / pixels);
+        }
+
+        const double sourceSeconds = uploadSeconds + pixels * cost.sourcePixelSeconds[format];
+        job.target = targetImage.view;
+        for (auto filter : { Filter::Nearest, Filter::Linear, Filter::Cubic, Filter::Min, Filter::Max }) {
+            job.filter = filter;
+            if (!TimeJob(engine, job, seconds))
+                return false;
+            cost.pixelSeconds[format][int(filter)] = max(0.0, (seconds - sourceSeconds) / pixels);
+        }
+
+        job.filter = Filter::Linear;
+        job.sampling = Sampling::Hardware;
+        if (!TimeJob(engine, job, seconds))
+            return false;
+        cost.hardwareLinearPixelSeconds[format] = max(0.0, (seconds - sourceSeconds) / pixels);
+    }
+    return true;
+}
+
+// The cache is a text file of three lines per key: the key itself, then the
+// GL and the CPU cost, each as the terms in ForEachTerm() order. Lines from
+// older models have fewer terms and are measured again.
+struct CachedCosts
+{
+    EngineCost gl;
+    EngineCost cpu;
+};
+
+template <typename Cost, typename Visit>
+static void ForEachTerm(Cost& cost, Visit visit)
+{
+    visit(cost.jobSeconds);
+    visit(cost.sourceByteSeconds);
+    for (int format = 0; format < CostFormatCount; ++format) {
+        visit(cost.sourcePixelSeconds[format]);
+        for (auto& seconds : cost.pixelSeconds[format])
+            visit(seconds);
+        visit(cost.hardwareLinearPixelSeconds[format]);
+    }
+}
+
+static bool ReadCost(FILE* file, EngineCost& cost)
+{
+    char line[2048];
+    if (!fgets(line, sizeof(line), file))
+        return false;
+    char* next = line;
+    bool complete = true;
+    ForEachTerm(cost, [&](double& term) {
+        char* end;
+        term = strtod(next, &end);
+        complete = complete && end != next;
+        next = end;
+    });
+    return complete && next[strspn(next, " \n")] == 0;
+}
+
+static void WriteCost(FILE* file, const EngineCost& cost)
+{
+    const char* separator = "";
+    ForEachTerm(cost, [&](const double& term) {
+        fprintf(file, "%s%.6e", separator, term);
+        separator = " ";
+    });
+    fprintf(file, "\n");
+}
+
+static map<string, CachedCosts> LoadCache(const char* path)
+{
+    map<string, CachedCosts> cache;
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return cache;
+
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = 0;
+        CachedCosts costs;
+        if (!ReadCost(file, costs.gl) || !ReadCost(file, costs.cpu))
+            break;
+        cache[line] = costs;
+    }
+    fclose(file);
+    return cache;
+}
+
+static void SaveCache(const char* path, const map<string, CachedCosts>& cache)
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Cannot write engine calibration to %s\n", path);
+        return;
+    }
+    for (auto& entry : cache) {
+        fprintf(file, "%s\n", entry.first.c_str());
+        WriteCost(file, entry.second.gl);
+        WriteCost(file, entry.second.cpu);
+    }
+    fclose(file);
+}
+
+bool EngineSelector::Calibrate(const char* cachePath)
+{
+    // CPU costs depend on the kernels and thread count as much as the GPU
+    // costs depend on the renderer
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    cacheKey = string(renderer ? renderer : "unknown") + " / " + CpuWarpEngine::KernelsName(cpu.Kernels()) +
+        " x" + to_string(cpu.ThreadCount());
+
+    map<string, CachedCosts> cache = LoadCache(cachePath);
+    auto cached = cache.find(cacheKey);
+    if (cached != cache.end()) {
+        glCost = cached->second.gl;
+        cpuCost = cached->second.cpu;
+        return true;
+    }
+
+    TRACE_SCOPE("calibrate engines");
+    EngineCost measuredGl, measuredCpu;
+    if (!MeasureCost(gl, measuredGl) || !MeasureCost(cpu, measuredCpu)) {
+        printf("Engine calibration failed, keeping every job on the GL engine\n");
+        return false;
+    }
+    glCost = measuredGl;
+    cpuCost = measuredCpu;
+    cache[cacheKey] = { glCost, cpuCost };
+    SaveCache(cachePath, cache);
+    return false;
+}
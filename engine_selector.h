@@ -0,0 +1,64 @@
+#ifndef ENGINE_SELECTOR_H
+#define ENGINE_SELECTOR_H
+
+#include <string>
+
+#include "cpu_warp.h"
+#include "gl_warp.h"
+
+// Sources the cost model prices apart, as the engines take different paths
+// for them: RGBA32F has SIMD kernels on the CPU, other float layouts do not,
+// 8-bit sources are sampled by the texture unit or in fixed point, 16-bit
+// integers are filtered in the GL shader, and the CPU converts sRGB and
+// Bayer sources to RGBA32F before warping.
+enum class CostFormat { Rgba32F, Float, Unorm8, Uint16, Srgb8, Bayer };
+const int CostFormatCount = 6;
+CostFormat SourceCostFormat(const ImageView& source);
+
+// Linear cost model of one engine, in seconds, calibrated per CostFormat
+// with the engine's own path for each. For the GL engine the per-byte term
+// is the upload and the per-pixel terms include the readback.
+struct EngineCost
+{
+    double jobSeconds = 0;
+    double sourceByteSeconds = 0;
+    double sourcePixelSeconds[CostFormatCount] = {};        // conversion per source pixel
+    double pixelSeconds[CostFormatCount][5] = {};           // per target pixel, indexed by Filter
+    double hardwareLinearPixelSeconds[CostFormatCount] = {};    // Sampling::Hardware Linear per target pixel
+
+    double Estimate(const WarpJob& job) const;
+};
+
+// Routes each job to whichever of a GL and a CPU engine the cost model
+// predicts is faster, e.g. tiny warps to the CPU where the GPU round trip
+// dominates. Jobs the chosen engine cannot run go to the other one.
+class EngineSelector : public WarpEngine
+{
+public:
+    EngineSelector(GlWarpEngine& gl, CpuWarpEngine& cpu);
+
+    bool Run(const WarpJob& job) override;
+    const char* Name() const override { return "Auto"; }
+
+    // Loads the costs measured for this GL renderer and CPU configuration
+    // from cachePath, or times a few representative jobs on both engines
+    // and adds them to the file. Returns false if they had to be measured.
+    // Until then, or if a timed job fails, every job goes to the GL engine
+    // and nothing is cached.
+    bool Calibrate(const char* cachePath);
+
+    WarpEngine& Choose(const WarpJob& job);
+
+    const EngineCost& GlCost() const { return glCost; }
+    const EngineCost& CpuCost() const { return cpuCost; }
+    const std::string& CacheKey() const { return cacheKey; }
+
+private:
+    GlWarpEngine& gl;
+    CpuWarpEngine& cpu;
+    EngineCost glCost;
+    EngineCost cpuCost;
+    std::string cacheKey;
+};
+
+#endif
@@ -0,0 +1,671 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ETC2_X86
+#endif
+
+#include "etc2.h"
+
+using namespace std;
+
+// Modifier pairs of the ETC1 subblock tables; pixel indices 0 to 3 select
+// +small, +large, -small and -large
+static const int EtcModifiers[8][2] = {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+};
+
+// Paint color distances of the T and H modes
+static const int EtcDistances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+static const int EacModifiers[16][8] = {
+    { -3, -6, -9, -15, 2, 5, 8, 14 },
+    { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5, -8, -13, 1, 4, 7, 12 },
+    { -2, -4, -6, -13, 1, 3, 5, 12 },
+    { -3, -6, -8, -12, 2, 5, 7, 11 },
+    { -3, -7, -9, -11, 2, 6, 8, 10 },
+    { -4, -7, -8, -11, 3, 6, 7, 10 },
+    { -3, -5, -8, -11, 2, 4, 7, 10 },
+    { -2, -6, -8, -10, 1, 5, 7, 9 },
+    { -2, -5, -8, -10, 1, 4, 7, 9 },
+    { -2, -4, -8, -10, 1, 3, 7, 9 },
+    { -2, -5, -7, -10, 1, 4, 6, 9 },
+    { -3, -4, -7, -10, 2, 3, 6, 9 },
+    { -1, -2, -3, -10, 0, 1, 2, 9 },
+    { -4, -6, -8, -9, 3, 5, 7, 8 },
+    { -3, -5, -7, -9, 2, 4, 6, 8 },
+};
+
+const char* CompressedFormatName(CompressedFormat format)
+{
+    switch (format) {
+    case CompressedFormat::Etc2Rgb8: return "ETC2 RGB8";
+    case CompressedFormat::Etc2Rgba8: return "ETC2 RGBA8";
+    default: return "EAC R11";
+    }
+}
+
+PixelFormat DecodedFormat(CompressedFormat format)
+{
+    return format == CompressedFormat::EacR11 ? PixelFormat::R8 : PixelFormat::RGBA8;
+}
+
+size_t CompressedBlockBytes(CompressedFormat format)
+{
+    return format == CompressedFormat::Etc2Rgba8 ? 16 : 8;
+}
+
+size_t CompressedSize(CompressedFormat format, int width, int height)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * CompressedBlockBytes(format);
+}
+
+static inline int Clamp(int value, int low, int high)
+{
+    return value < low ? low : value > high ? high : value;
+}
+
+static inline int Extend4(int c) { return c << 4 | c; }
+static inline int Extend5(int c) { return c << 3 | c >> 2; }
+static inline int Extend6(int c) { return c << 2 | c >> 4; }
+static inline int Extend7(int c) { return c << 1 | c >> 6; }
+
+static inline int Signed3(int value)
+{
+    return value >= 4 ? value - 8 : value;
+}
+
+static inline uint64_t Bits(uint64_t block, int first, int count)
+{
+    return (block >> first) & ((uint64_t(1) << count) - 1);
+}
+
+static void StoreBlock(uint64_t block, uint8_t* bytes)
+{
+    for (int i = 0; i < 8; ++i)
+        bytes[i] = uint8_t(block >> (56 - 8 * i));
+}
+
+static uint64_t LoadBlock(const uint8_t* bytes)
+{
+    uint64_t block = 0;
+    for (int i = 0; i < 8; ++i)
+        block = block << 8 | bytes[i];
+    return block;
+}
+
+// Pixels of a block are numbered down the columns, i = x * 4 + y, like the
+// index bits
+static inline int BlockX(int i) { return i >> 2; }
+static inline int BlockY(int i) { return i & 3; }
+
+// Eight pixels of one ETC1 subblock, a channel per row, for the table
+// search
+struct Subblock
+{
+    alignas(16) int32_t channels[3][8];
+};
+
+typedef void (*TableSearch)(const Subblock& pixels, const int base[3], uint32_t errors[8]);
+
+// Error of each table with every pixel at its best modifier
+static void TableErrorsScalar(const Subblock& pixels, const int base[3], uint32_t errors[8])
+{
+    for (int t = 0; t < 8; ++t) {
+        const int modifiers[4] = { EtcModifiers[t][0], EtcModifiers[t][1], -EtcModifiers[t][0], -EtcModifiers[t][1] };
+        int candidates[4][3];
+        for (int m = 0; m < 4; ++m)
+            for (int c = 0; c < 3; ++c)
+                candidates[m][c] = Clamp(base[c] + modifiers[m], 0, 255);
+
+        uint32_t error = 0;
+        for (int i = 0; i < 8; ++i) {
+            uint32_t best = UINT32_MAX;
+            for (int m = 0; m < 4; ++m) {
+                uint32_t e = 0;
+                for (int c = 0; c < 3; ++c) {
+                    const int d = pixels.channels[c][i] - candidates[m][c];
+                    e += uint32_t(d * d);
+                }
+                best = min(best, e);
+            }
+            error += best;
+        }
+        errors[t] = error;
+    }
+}
+
+#if defined(ETC2_X86)
+// Eight pixels in two registers per channel
+__attribute__((target("sse4.1")))
+static void TableErrorsSse41(const Subblock& pixels, const int base[3], uint32_t errors[8])
+{
+    __m128i p[3][2];
+    for (int c = 0; c < 3; ++c) {
+        p[c][0] = _mm_load_si128((const __m128i*)pixels.channels[c]);
+        p[c][1] = _mm_load_si128((const __m128i*)(pixels.channels[c] + 4));
+    }
+
+    for (int t = 0; t < 8; ++t) {
+        const int modifiers[4] = { EtcModifiers[t][0], EtcModifiers[t][1], -EtcModifiers[t][0], -EtcModifiers[t][1] };
+        __m128i best[2] = { _mm_set1_epi32(INT32_MAX), _mm_set1_epi32(INT32_MAX) };
+        for (int m = 0; m < 4; ++m) {
+            __m128i e[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+            for (int c = 0; c < 3; ++c) {
+                const __m128i candidate = _mm_set1_epi32(Clamp(base[c] + modifiers[m], 0, 255));
+                for (int h = 0; h < 2; ++h) {
+                    const __m128i d = _mm_sub_epi32(p[c][h], candidate);
+                    e[h] = _mm_add_epi32(e[h], _mm_mullo_epi32(d, d));
+                }
+            }
+            best[0] = _mm_min_epi32(best[0], e[0]);
+            best[1] = _mm_min_epi32(best[1], e[1]);
+        }
+        __m128i sum = _mm_add_epi32(best[0], best[1]);
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        errors[t] = uint32_t(_mm_cvtsi128_si32(sum));
+    }
+}
+#endif
+
+static TableSearch SelectTableSearch(CpuKernels kernels)
+{
+#if defined(ETC2_X86)
+    if ((kernels == CpuKernels::Best || kernels == CpuKernels::Sse41 || kernels == CpuKernels::Avx2) &&
+        KernelsSupported(CpuKernels::Sse41))
+        return TableErrorsSse41;
+#endif
+    return TableErrorsScalar;
+}
+
+// Modifier index 0 to 3 of the closest candidate
+static int BestModifier(const uint8_t* pixel, const int base[3], int table)
+{
+    const int modifiers[4] = { EtcModifiers[table][0], EtcModifiers[table][1], -EtcModifiers[table][0], -EtcModifiers[table][1] };
+    int bestIndex = 0;
+    int bestError = INT32_MAX;
+    for (int m = 0; m < 4; ++m) {
+        int e = 0;
+        for (int c = 0; c < 3; ++c) {
+            const int d = pixel[c] - Clamp(base[c] + modifiers[m], 0, 255);
+            e += d * d;
+        }
+        if (e < bestError) {
+            bestError = e;
+            bestIndex = m;
+        }
+    }
+    return bestIndex;
+}
+
+struct EtcChoice
+{
+    uint64_t block = 0;
+    uint64_t error = UINT64_MAX;
+};
+
+// Individual or differential mode in one orientation; subblock 1 holds the
+// right columns, or the bottom rows when flipped.
+static void TryEtc1(const uint8_t pixels[16][4], bool flip, bool differential, TableSearch search, EtcChoice& choice)
+{
+    Subblock subblocks[2];
+    int count[2] = {};
+    int sum[2][3] = {};
+    int member[16];
+    for (int i = 0; i < 16; ++i) {
+        const int s = flip ? BlockY(i) >= 2 : BlockX(i) >= 2;
+        member[i] = s;
+        for (int c = 0; c < 3; ++c) {
+            subblocks[s].channels[c][count[s]] = pixels[i][c];
+            sum[s][c] += pixels[i][c];
+        }
+        ++count[s];
+    }
+
+    // Averages quantized to the mode's precision; a differential second
+    // color out of reach of the first is pulled in
+    int quantized[2][3], base[2][3];
+    const int levels = differential ? 31 : 15;
+    for (int s = 0; s < 2; ++s)
+        for (int c = 0; c < 3; ++c)
+            quantized[s][c] = (sum[s][c] * levels + 8 * 255 / 2) / (8 * 255);
+    for (int c = 0; c < 3; ++c) {
+        if (differential)
+            quantized[1][c] = Clamp(quantized[1][c], quantized[0][c] - 4, quantized[0][c] + 3);
+        for (int s = 0; s < 2; ++s)
+            base[s][c] = differential ? Extend5(quantized[s][c]) : Extend4(quantized[s][c]);
+    }
+
+    int tables[2];
+    uint64_t error = 0;
+    for (int s = 0; s < 2; ++s) {
+        uint32_t errors[8];
+        search(subblocks[s], base[s], errors);
+        tables[s] = int(min_element(errors, errors + 8) - errors);
+        error += errors[tables[s]];
+    }
+    if (error >= choice.error)
+        return;
+
+    uint64_t block = 0;
+    if (differential) {
+        block |= uint64_t(quantized[0][0]) << 59 | uint64_t((quantized[1][0] - quantized[0][0]) & 7) << 56;
+        block |= uint64_t(quantized[0][1]) << 51 | uint64_t((quantized[1][1] - quantized[0][1]) & 7) << 48;
+        block |= uint64_t(quantized[0][2]) << 43 | uint64_t((quantized[1][2] - quantized[0][2]) & 7) << 40;
+    } else {
+        block |= uint64_t(quantized[0][0]) << 60 | uint64_t(quantized[1][0]) << 56;
+        block |= uint64_t(quantized[0][1]) << 52 | uint64_t(quantized[1][1]) << 48;
+        block |= uint64_t(quantized[0][2]) << 44 | uint64_t(quantized[1][2]) << 40;
+    }
+    block |= uint64_t(tables[0]) << 37 | uint64_t(tables[1]) << 34 | uint64_t(differential) << 33 | uint64_t(flip) << 32;
+    for (int i = 0; i < 16; ++i) {
+        const int s = member[i];
+        const int m = BestModifier(pixels[i], base[s], tables[s]);
+        block |= uint64_t(m >> 1) << (16 + i) | uint64_t(m & 1) << i;
+    }
+    choice.block = block;
+    choice.error = error;
+}
+
+static inline int PlanarValue(int o, int h, int v, int x, int y)
+{
+    return Clamp((x * (h - o) + y * (v - o) + 4 * o + 2) >> 2, 0, 255);
+}
+
+// Least-squares plane c = a + b x + d y through the block, stored as its
+// values at the origin and at x = 4 and y = 4
+static void TryPlanar(const uint8_t pixels[16][4], EtcChoice& choice)
+{
+    const int bits[3] = { 6, 7, 6 };
+    int o[3], h[3], v[3];
+    for (int c = 0; c < 3; ++c) {
+        double mean = 0, sx = 0, sy = 0;
+        for (int i = 0; i < 16; ++i) {
+            mean += pixels[i][c];
+            sx += (BlockX(i) - 1.5) * pixels[i][c];
+            sy += (BlockY(i) - 1.5) * pixels[i][c];
+        }
+        mean /= 16;
+        const double b = sx / 20, d = sy / 20;
+        const double a = mean - 1.5 * b - 1.5 * d;
+        const int levels = (1 << bits[c]) - 1;
+        o[c] = Clamp(int(floor(a * levels / 255 + 0.5)), 0, levels);
+        h[c] = Clamp(int(floor((a + 4 * b) * levels / 255 + 0.5)), 0, levels);
+        v[c] = Clamp(int(floor((a + 4 * d) * levels / 255 + 0.5)), 0, levels);
+    }
+
+    const int eo[3] = { Extend6(o[0]), Extend7(o[1]), Extend6(o[2]) };
+    const int eh[3] = { Extend6(h[0]), Extend7(h[1]), Extend6(h[2]) };
+    const int ev[3] = { Extend6(v[0]), Extend7(v[1]), Extend6(v[2]) };
+    uint64_t error = 0;
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            const int d = pixels[i][c] - PlanarValue(eo[c], eh[c], ev[c], BlockX(i), BlockY(i));
+            error += uint64_t(d * d);
+        }
+    }
+    if (error >= choice.error)
+        return;
+
+    uint64_t block = uint64_t(1) << 33;
+    block |= uint64_t(o[0]) << 57;
+    block |= uint64_t(o[1] >> 6) << 56 | uint64_t(o[1] & 63) << 49;
+    block |= uint64_t(o[2] >> 5) << 48 | uint64_t((o[2] >> 3) & 3) << 43 | uint64_t((o[2] >> 1) & 3) << 40 | uint64_t(o[2] & 1) << 39;
+    block |= uint64_t(h[0] >> 1) << 34 | uint64_t(h[0] & 1) << 32;
+    block |= uint64_t(h[1]) << 25;
+    block |= uint64_t(h[2] >> 5) << 24 | uint64_t(h[2] & 31) << 19;
+    block |= uint64_t(v[0] >> 3) << 16 | uint64_t(v[0] & 7) << 13;
+    block |= uint64_t(v[1] >> 2) << 8 | uint64_t(v[1] & 3) << 6;
+    block |= uint64_t(v[2]);
+
+    // Planar blocks are marked by a differential blue that overflows while
+    // red and green stay in range; the free bits 63, 55, 47 to 45 and 42
+    // arrange that
+    if (int(Bits(block, 59, 5)) + Signed3(int(Bits(block, 56, 3))) < 0)
+        block |= uint64_t(1) << 63;
+    if (int(Bits(block, 51, 5)) + Signed3(int(Bits(block, 48, 3))) < 0)
+        block |= uint64_t(1) << 55;
+    if (Bits(block, 43, 2) + Bits(block, 40, 2) >= 4)
+        block |= uint64_t(7) << 45;
+    else
+        block |= uint64_t(1) << 42;
+
+    choice.block = block;
+    choice.error = error;
+}
+
+static uint64_t EncodeEtcBlock(const uint8_t pixels[16][4], TableSearch search)
+{
+    EtcChoice choice;
+    for (int flip = 0; flip < 2; ++flip) {
+        TryEtc1(pixels, flip != 0, true, search, choice);
+        TryEtc1(pixels, flip != 0, false, search, choice);
+    }
+    TryPlanar(pixels, choice);
+    return choice.block;
+}
+
+static inline int EacValue(int base, int multiplier, int modifier, bool r11)
+{
+    if (!r11)
+        return Clamp(base + modifier * multiplier, 0, 255);
+    return Clamp(base * 8 + 4 + (multiplier ? modifier * multiplier * 8 : modifier), 0, 2047);
+}
+
+// values are 8-bit for alpha and 11-bit for R11
+static uint64_t EncodeEacBlock(const int values[16], bool r11)
+{
+    const int low = *min_element(values, values + 16);
+    const int high = *max_element(values, values + 16);
+    const int scale = r11 ? 8 : 1;
+
+    uint64_t bestBlock = 0;
+    uint64_t bestError = UINT64_MAX;
+    for (int table = 0; table < 16 && bestError > 0; ++table) {
+        const int* modifiers = EacModifiers[table];
+        const int span = (modifiers[7] - modifiers[3]) * scale;
+        const int guess = Clamp((high - low + span / 2) / span, 1, 15);
+        for (int multiplier = max(guess - 1, 1); multiplier <= min(guess + 1, 15); ++multiplier) {
+            const double center = 0.5 * (low + high) - 0.5 * (modifiers[7] + modifiers[3]) * multiplier * scale;
+            const int baseGuess = int(floor((r11 ? (center - 4) / 8 : center) + 0.5));
+            for (int base = max(baseGuess - 1, 0); base <= min(baseGuess + 1, 255); ++base) {
+                uint64_t error = 0;
+                uint64_t indices = 0;
+                for (int i = 0; i < 16 && error < bestError; ++i) {
+                    int bestIndex = 0;
+                    int best = INT32_MAX;
+                    for (int m = 0; m < 8; ++m) {
+                        const int d = values[i] - EacValue(base, multiplier, modifiers[m], r11);
+                        if (d * d < best) {
+                            best = d * d;
+                            bestIndex = m;
+                        }
+                    }
+                    error += uint64_t(best);
+                    indices |= uint64_t(bestIndex) << (45 - 3 * i);
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    bestBlock = uint64_t(base) << 56 | uint64_t(multiplier) << 52 | uint64_t(table) << 48 | indices;
+                }
+            }
+        }
+    }
+    return bestBlock;
+}
+
+// Block (bx, by) as RGBA8, edges repeated
+static void GatherBlock(const ImageView& source, int bx, int by, uint8_t pixels[16][4])
+{
+    const int channels = ChannelCount(source.format);
+    const uint8_t* texels = (const uint8_t*)source.planes[0];
+    for (int i = 0; i < 16; ++i) {
+        const int x = min(bx * 4 + BlockX(i), source.width - 1);
+        const int y = min(by * 4 + BlockY(i), source.height - 1);
+        const uint8_t* texel = texels + (size_t(y) * RowLength(source, 0) + x) * channels;
+        for (int c = 0; c < 4; ++c)
+            pixels[i][c] = c < channels ? texel[c] : c == 3 ? 255 : texel[0];
+    }
+}
+
+bool EncodeEtc2(const ImageView& source, CompressedFormat format, CompressedImage& image, ThreadPool* pool, CpuKernels kernels)
+{
+    const PixelFormat expected = format == CompressedFormat::EacR11 ? PixelFormat::R8 : PixelFormat::RGBA8;
+    if (source.format != expected || source.width <= 0 || source.height <= 0 || !source.planes[0])
+        return false;
+
+    image.format = format;
+    image.width = source.width;
+    image.height = source.height;
+    image.blocks.resize(CompressedSize(format, source.width, source.height));
+
+    const TableSearch search = SelectTableSearch(kernels);
+    const int blocksWide = (source.width + 3) / 4;
+    const size_t blockBytes = CompressedBlockBytes(format);
+    auto encodeRow = [&](size_t by, unsigned) {
+        uint8_t* target = image.blocks.data() + by * blocksWide * blockBytes;
+        for (int bx = 0; bx < blocksWide; ++bx, target += blockBytes) {
+            uint8_t pixels[16][4];
+            GatherBlock(source, bx, int(by), pixels);
+            if (format == CompressedFormat::EacR11) {
+                int values[16];
+                for (int i = 0; i < 16; ++i)
+                    values[i] = (pixels[i][0] * 2047 + 127) / 255;
+                StoreBlock(EncodeEacBlock(values, true), target);
+                continue;
+            }
+            if (format == CompressedFormat::Etc2Rgba8) {
+                int alpha[16];
+                for (int i = 0; i < 16; ++i)
+                    alpha[i] = pixels[i][3];
+                StoreBlock(EncodeEacBlock(alpha, false), target);
+            }
+            StoreBlock(EncodeEtcBlock(pixels, search), target + blockBytes - 8);
+        }
+    };
+
+    const size_t rows = size_t(source.height + 3) / 4;
+    if (pool)
+        pool->Run(rows, encodeRow);
+    else
+        for (size_t by = 0; by < rows; ++by)
+            encodeRow(by, 0);
+    return true;
+}
+
+static void DecodeEtcBlock(uint64_t block, uint8_t pixels[16][4])
+{
+    int colors[4][3];   // T and H paint colors
+    bool paint = false;
+    const bool differential = Bits(block, 33, 1) != 0;
+    const int r = int(Bits(block, 59, 5)) + Signed3(int(Bits(block, 56, 3)));
+    const int g = int(Bits(block, 51, 5)) + Signed3(int(Bits(block, 48, 3)));
+    const int b = int(Bits(block, 43, 5)) + Signed3(int(Bits(block, 40, 3)));
+
+    if (differential && (r < 0 || r > 31)) {
+        // T mode
+        const int c1[3] = {
+            Extend4(int(Bits(block, 59, 2) << 2 | Bits(block, 56, 2))), Extend4(int(Bits(block, 52, 4))), Extend4(int(Bits(block, 48, 4)))
+        };
+        const int c2[3] = { Extend4(int(Bits(block, 44, 4))), Extend4(int(Bits(block, 40, 4))), Extend4(int(Bits(block, 36, 4))) };
+        const int d = EtcDistances[Bits(block, 34, 2) << 1 | Bits(block, 32, 1)];
+        for (int c = 0; c < 3; ++c) {
+            colors[0][c] = c1[c];
+            colors[1][c] = Clamp(c2[c] + d, 0, 255);
+            colors[2][c] = c2[c];
+            colors[3][c] = Clamp(c2[c] - d, 0, 255);
+        }
+        paint = true;
+    } else if (differential && (g < 0 || g > 31)) {
+        // H mode
+        const int c1[3] = {
+            Extend4(int(Bits(block, 59, 4))),
+            Extend4(int(Bits(block, 56, 3) << 1 | Bits(block, 52, 1))),
+            Extend4(int(Bits(block, 51, 1) << 3 | Bits(block, 48, 2) << 1 | Bits(block, 47, 1)))
+        };
+        const int c2[3] = {
+            Extend4(int(Bits(block, 43, 4))),
+            Extend4(int(Bits(block, 40, 3) << 1 | Bits(block, 39, 1))),
+            Extend4(int(Bits(block, 35, 4)))
+        };
+        const int order = (c1[0] << 16 | c1[1] << 8 | c1[2]) >= (c2[0] << 16 | c2[1] << 8 | c2[2]);
+        const int d = EtcDistances[Bits(block, 34, 1) << 2 | Bits(block, 32, 1) << 1 | order];
+        for (int c = 0; c < 3; ++c) {
+            colors[0][c] = Clamp(c1[c] + d, 0, 255);
+            colors[1][c] = Clamp(c1[c] - d, 0, 255);
+            colors[2][c] = Clamp(c2[c] + d, 0, 255);
+            colors[3][c] = Clamp(c2[c] - d, 0, 255);
+        }
+        paint = true;
+    } else if (differential && (b < 0 || b > 31)) {
+        const int o[3] = {
+            Extend6(int(Bits(block, 57, 6))),
+            Extend7(int(Bits(block, 56, 1) << 6 | Bits(block, 49, 6))),
+            Extend6(int(Bits(block, 48, 1) << 5 | Bits(block, 43, 2) << 3 | Bits(block, 40, 2) << 1 | Bits(block, 39, 1)))
+        };
+        const int h[3] = {
+            Extend6(int(Bits(block, 34, 5) << 1 | Bits(block, 32, 1))),
+            Extend7(int(Bits(block, 25, 7))),
+            Extend6(int(Bits(block, 24, 1) << 5 | Bits(block, 19, 5)))
+        };
+        const int v[3] = {
+            Extend6(int(Bits(block, 16, 3) << 3 | Bits(block, 13, 3))),
+            Extend7(int(Bits(block, 8, 5) << 2 | Bits(block, 6, 2))),
+            Extend6(int(Bits(block, 0, 6)))
+        };
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                pixels[i][c] = uint8_t(PlanarValue(o[c], h[c], v[c], BlockX(i), BlockY(i)));
+        return;
+    }
+
+    if (paint) {
+        for (int i = 0; i < 16; ++i) {
+            const int index = int(Bits(block, 16 + i, 1) << 1 | Bits(block, i, 1));
+            for (int c = 0; c < 3; ++c)
+                pixels[i][c] = uint8_t(colors[index][c]);
+        }
+        return;
+    }
+
+    int base[2][3];
+    for (int c = 0; c < 3; ++c) {
+        const int shift = 59 - 8 * c;
+        if (differential) {
+            const int first = int(Bits(block, shift, 5));
+            base[0][c] = Extend5(first);
+            base[1][c] = Extend5(first + Signed3(int(Bits(block, shift - 3, 3))));
+        } else {
+            base[0][c] = Extend4(int(Bits(block, shift + 1, 4)));
+            base[1][c] = Extend4(int(Bits(block, shift - 3, 4)));
+        }
+    }
+    const int tables[2] = { int(Bits(block, 37, 3)), int(Bits(block, 34, 3)) };
+    const bool flip = Bits(block, 32, 1) != 0;
+    for (int i = 0; i < 16; ++i) {
+        const int s = flip ? BlockY(i) >= 2 : BlockX(i) >= 2;
+        const int index = int(Bits(block, 16 + i, 1) << 1 | Bits(block, i, 1));
+        const int magnitude = EtcModifiers[tables[s]][index & 1];
+        const int modifier = index & 2 ? -magnitude : magnitude;
+        for (int c = 0; c < 3; ++c)
+            pixels[i][c] = uint8_t(Clamp(base[s][c] + modifier, 0, 255));
+    }
+}
+
+static void DecodeEacBlock(uint64_t block, bool r11, int values[16])
+{
+    const int base = int(Bits(block, 56, 8));
+    const int multiplier = int(Bits(block, 52, 4));
+    const int* modifiers = EacModifiers[Bits(block, 48, 4)];
+    for (int i = 0; i < 16; ++i)
+        values[i] = EacValue(base, multiplier, modifiers[Bits(block, 45 - 3 * i, 3)], r11);
+}
+
+bool DecodeEtc2(const CompressedImage& image, const ImageView& target)
+{
+    const bool r11 = image.format == CompressedFormat::EacR11;
+    if (target.format != (r11 ? PixelFormat::R16UI : PixelFormat::RGBA8) || target.width != image.width ||
+        target.height != image.height || image.blocks.size() != CompressedSize(image.format, image.width, image.height))
+        return false;
+
+    const int blocksWide = (image.width + 3) / 4;
+    const size_t blockBytes = CompressedBlockBytes(image.format);
+    const uint8_t* source = image.blocks.data();
+    for (int by = 0; by < (image.height + 3) / 4; ++by) {
+        for (int bx = 0; bx < blocksWide; ++bx, source += blockBytes) {
+            uint8_t pixels[16][4];
+            int values[16];
+            if (r11) {
+                DecodeEacBlock(LoadBlock(source), true, values);
+            } else {
+                DecodeEtcBlock(LoadBlock(source + blockBytes - 8), pixels);
+                if (image.format == CompressedFormat::Etc2Rgba8)
+                    DecodeEacBlock(LoadBlock(source), false, values);
+                for (int i = 0; i < 16; ++i)
+                    pixels[i][3] = image.format == CompressedFormat::Etc2Rgba8 ? uint8_t(values[i]) : 255;
+            }
+
+            for (int i = 0; i < 16; ++i) {
+                const int x = bx * 4 + BlockX(i);
+                const int y = by * 4 + BlockY(i);
+                if (x >= image.width || y >= image.height)
+                    continue;
+                const size_t offset = size_t(y) * image.width + x;
+                if (r11)
+                    ((uint16_t*)target.planes[0])[offset] = uint16_t(values[i]);
+                else
+                    memcpy((uint8_t*)target.planes[0] + offset * 4, pixels[i], 4);
+            }
+        }
+    }
+    return true;
+}
+
+// FNV-1a
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t format;
+    int32_t width;
+    int32_t height;
+    uint64_t hash;
+};
+
+bool LoadOrEncodeEtc2(const ImageView& source, CompressedFormat format, const char* cacheDirectory,
+    CompressedImage& image, ThreadPool* pool, bool* cached)
+{
+    if (cached)
+        *cached = false;
+    if (!source.planes[0])
+        return false;
+
+    CacheHeader expected = { { 'E', 'T', 'C', '2' }, uint32_t(format), source.width, source.height, 0 };
+    expected.hash = HashBytes(0xcbf29ce484222325ull, &expected, sizeof(expected));
+    const size_t rowBytes = PlaneBytes(source.format, 0, source.width, 1);
+    const size_t strideBytes = PlaneBytes(source.format, 0, RowLength(source, 0), 1);
+    for (int y = 0; y < source.height; ++y)
+        expected.hash = HashBytes(expected.hash, (const uint8_t*)source.planes[0] + y * strideBytes, rowBytes);
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.etc2", (unsigned long long)expected.hash);
+    const string path = string(cacheDirectory) + name;
+
+    if (FILE* file = fopen(path.c_str(), "rb")) {
+        CacheHeader header;
+        image.blocks.resize(CompressedSize(format, source.width, source.height));
+        const bool loaded = fread(&header, sizeof(header), 1, file) == 1 && memcmp(&header, &expected, sizeof(header)) == 0 &&
+            fread(image.blocks.data(), 1, image.blocks.size(), file) == image.blocks.size();
+        fclose(file);
+        if (loaded) {
+            image.format = format;
+            image.width = source.width;
+            image.height = source.height;
+            if (cached)
+                *cached = true;
+            return true;
+        }
+    }
+
+    if (!EncodeEtc2(source, format, image, pool))
+        return false;
+    if (FILE* file = fopen(path.c_str(), "wb")) {
+        fwrite(&expected, sizeof(expected), 1, file);
+        fwrite(image.blocks.data(), 1, image.blocks.size(), file);
+        fclose(file);
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef ETC2_H
+#define ETC2_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "cpu_kernels.h"
+#include "image.h"
+#include "thread_pool.h"
+
+// Block-compressed layouts every GL ES 3.0 implementation samples: 4x4
+// pixel blocks of 8 bytes (ETC2 RGB8, EAC R11) or 16 bytes (ETC2 RGBA8,
+// an EAC alpha block followed by an ETC2 RGB block). Compared with RGBA8
+// that is 8 and 4 times less texture memory and fetch bandwidth.
+enum class CompressedFormat { Etc2Rgb8, Etc2Rgba8, EacR11 };
+
+struct CompressedImage
+{
+    CompressedFormat format = CompressedFormat::Etc2Rgb8;
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> blocks;    // rows of blocks, each in big-endian byte order
+};
+
+const char* CompressedFormatName(CompressedFormat format);
+
+// Layout the GPU samples a compressed image as: RGBA8 for the ETC2
+// formats, R8 for EAC R11.
+PixelFormat DecodedFormat(CompressedFormat format);
+
+size_t CompressedBlockBytes(CompressedFormat format);
+size_t CompressedSize(CompressedFormat format, int width, int height);
+
+// Fast encoder for static sources. ETC2 blocks try the individual and
+// differential ETC1 modes in both subblock orientations, with a table
+// search per subblock around its average color, and the planar mode, fitted
+// by least squares; T and H modes are not searched. EAC blocks search
+// every table with three multipliers and three base values around the
+// block's range. Sources are RGBA8 (alpha is dropped by Etc2Rgb8) or R8
+// for EacR11; edge blocks repeat the last row and column.
+//
+// Rows of blocks are spread over pool when given. The subblock table
+// search uses SSE4.1 where kernels allows it and the host supports it; the
+// result is the same with every instruction set.
+bool EncodeEtc2(const ImageView& source, CompressedFormat format, CompressedImage& image,
+    ThreadPool* pool = nullptr, CpuKernels kernels = CpuKernels::Best);
+
+// Decodes every ETC2 and EAC mode. The target is RGBA8 for the ETC2 formats
+// (alpha 255 for Etc2Rgb8) and R16UI receiving the raw 11-bit values for
+// EacR11, at the image's size.
+bool DecodeEtc2(const CompressedImage& image, const ImageView& target);
+
+// EncodeEtc2() through a cache of encoded images in cacheDirectory, which
+// must exist. Files are named by a hash of the format, size and pixels;
+// unreadable or mismatching files are encoded again and replaced. cached,
+// if given, tells whether the image came from the cache.
+bool LoadOrEncodeEtc2(const ImageView& source, CompressedFormat format, const char* cacheDirectory,
+    CompressedImage& image, ThreadPool* pool = nullptr, bool* cached = nullptr);
+
+#endif
@@ -0,0 +1,176 @@
+#include <map>
+#include <tuple>
+
+#include "gl_image.h"
+
+using namespace std;
+
+PlaneFormat TexturePlaneFormat(PixelFormat format, int plane, ColorEncoding encoding)
+{
+    if (encoding == ColorEncoding::Srgb && format == PixelFormat::RGB8)
+        return { GL_SRGB8, GL_RGB, GL_UNSIGNED_BYTE };
+    if (encoding == ColorEncoding::Srgb && format == PixelFormat::RGBA8)
+        return { GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE };
+
+    switch (format) {
+    case PixelFormat::NV12:
+        return plane == 0 ? PlaneFormat{ GL_R8, GL_RED, GL_UNSIGNED_BYTE } : PlaneFormat{ GL_RG8, GL_RG, GL_UNSIGNED_BYTE };
+    case PixelFormat::I420:
+        return { GL_R8, GL_RED, GL_UNSIGNED_BYTE };
+    case PixelFormat::R16UI:
+        return { GL_R16UI, GL_RED_INTEGER, GL_UNSIGNED_SHORT };
+    case PixelFormat::R32F:
+        return { GL_R32F, GL_RED, GL_FLOAT };
+    case PixelFormat::R8:
+        return { GL_R8, GL_RED, GL_UNSIGNED_BYTE };
+    case PixelFormat::RG8:
+        return { GL_RG8, GL_RG, GL_UNSIGNED_BYTE };
+    case PixelFormat::RGB8:
+        return { GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE };
+    case PixelFormat::RGBA8:
+        return { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE };
+    case PixelFormat::R16F:
+        return { GL_R16F, GL_RED, GL_HALF_FLOAT };
+    case PixelFormat::RG16F:
+        return { GL_RG16F, GL_RG, GL_HALF_FLOAT };
+    case PixelFormat::RGB16F:
+        return { GL_RGB16F, GL_RGB, GL_HALF_FLOAT };
+    case PixelFormat::RGBA16F:
+        return { GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT };
+    case PixelFormat::RG32F:
+        return { GL_RG32F, GL_RG, GL_FLOAT };
+    case PixelFormat::RGB32F:
+        return { GL_RGB32F, GL_RGB, GL_FLOAT };
+    default:
+        return { GL_RGBA32F, GL_RGBA, GL_FLOAT };
+    }
+}
+
+GLenum CompressedTextureFormat(CompressedFormat format)
+{
+    switch (format) {
+    case CompressedFormat::Etc2Rgb8: return GL_COMPRESSED_RGB8_ETC2;
+    case CompressedFormat::Etc2Rgba8: return GL_COMPRESSED_RGBA8_ETC2_EAC;
+    default: return GL_COMPRESSED_R11_EAC;
+    }
+}
+
+struct GpuTexture
+{
+    GLuint name;
+    PixelFormat format;
+    ColorEncoding encoding;
+    GLenum internalFormat;
+    int width;
+    int height;
+    weak_ptr<GlImagePool::State> pool;
+};
+
+struct GlImagePool::State
+{
+    size_t cacheLimit;
+    multimap<tuple<PixelFormat, GLenum, int, int>, GLuint> cached;
+    GlImagePoolStats stats;
+};
+
+GLuint GpuImage::Texture() const
+{
+    return texture ? texture->name : 0;
+}
+
+PixelFormat GpuImage::Format() const
+{
+    return texture ? texture->format : PixelFormat::RGBA32F;
+}
+
+int GpuImage::Width() const
+{
+    return texture ? texture->width : 0;
+}
+
+int GpuImage::Height() const
+{
+    return texture ? texture->height : 0;
+}
+
+bool GpuImage::Compressed() const
+{
+    return texture && texture->internalFormat != TexturePlaneFormat(texture->format, 0, texture->encoding).internalFormat;
+}
+
+ColorEncoding GpuImage::Encoding() const
+{
+    return texture ? texture->encoding : ColorEncoding::Linear;
+}
+
+// Deleter of the last GpuImage sharing a texture
+static void RecycleTexture(GpuTexture* texture)
+{
+    auto state = texture->pool.lock();
+    if (state && state->cached.size() < state->cacheLimit)
+        state->cached.emplace(make_tuple(texture->format, texture->internalFormat, texture->width, texture->height), texture->name);
+    else
+        glDeleteTextures(1, &texture->name);
+    delete texture;
+}
+
+GlImagePool::GlImagePool(size_t cacheLimit)
+    : state(make_shared<State>())
+{
+    state->cacheLimit = cacheLimit;
+}
+
+GlImagePool::~GlImagePool()
+{
+    Trim();
+}
+
+GpuImage GlImagePool::Acquire(PixelFormat format, int width, int height, ColorEncoding encoding)
+{
+    if (PlaneCount(format) != 1)
+        return GpuImage();
+    return Acquire(format, encoding, TexturePlaneFormat(format, 0, encoding).internalFormat, width, height);
+}
+
+GpuImage GlImagePool::AcquireCompressed(CompressedFormat format, int width, int height)
+{
+    return Acquire(DecodedFormat(format), ColorEncoding::Linear, CompressedTextureFormat(format), width, height);
+}
+
+GpuImage GlImagePool::Acquire(PixelFormat format, ColorEncoding encoding, GLenum internalFormat, int width, int height)
+{
+    GpuImage image;
+    GLuint name = 0;
+    auto cached = state->cached.find(make_tuple(format, internalFormat, width, height));
+    if (cached != state->cached.end()) {
+        name = cached->second;
+        state->cached.erase(cached);
+        ++state->stats.reuses;
+    } else {
+        // Immutable storage, as a pooled texture never changes format
+        glGenTextures(1, &name);
+        glBindTexture(GL_TEXTURE_2D, name);
+        glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        ++state->stats.allocations;
+    }
+
+    image.texture = shared_ptr<GpuTexture>(new GpuTexture{ name, format, encoding, internalFormat, width, height, state }, RecycleTexture);
+    return image;
+}
+
+void GlImagePool::Trim()
+{
+    for (auto& cached : state->cached)
+        glDeleteTextures(1, &cached.second);
+    state->cached.clear();
+}
+
+GlImagePoolStats GlImagePool::Stats() const
+{
+    GlImagePoolStats stats = state->stats;
+    stats.cachedTextures = state->cached.size();
+    return stats;
+}
@@ -0,0 +1,96 @@
+#ifndef GL_IMAGE_H
+#define GL_IMAGE_H
+
+#include <stddef.h>
+
+#include <memory>
+
+#include "glad/glad.h"
+#include "etc2.h"
+#include "image.h"
+
+struct PlaneFormat
+{
+    GLenum internalFormat;
+    GLenum format;
+    GLenum type;
+};
+
+// Texture format and upload type of one plane of an image. R16UI becomes
+// an integer texture; multi-channel 16-bit integers are not supported.
+// Srgb RGB8 and RGBA8 become sRGB textures, which the GPU linearizes when
+// sampling and, as render targets, encodes when writing.
+PlaneFormat TexturePlaneFormat(PixelFormat format, int plane, ColorEncoding encoding = ColorEncoding::Linear);
+
+GLenum CompressedTextureFormat(CompressedFormat format);
+
+class GlImagePool;
+struct GpuTexture;
+
+// Single-plane image resident in a texture from a GlImagePool. Copies share
+// the texture; it goes back to the pool when the last copy is destroyed.
+// GL thread only.
+class GpuImage
+{
+public:
+    GpuImage() = default;
+
+    GLuint Texture() const;
+    PixelFormat Format() const;
+    int Width() const;
+    int Height() const;
+    // Block-compressed textures sample like Format() but cannot be
+    // rendered to or read back
+    bool Compressed() const;
+    ColorEncoding Encoding() const;
+    long UseCount() const { return texture.use_count(); }
+    explicit operator bool() const { return texture != nullptr; }
+
+    void Release() { texture.reset(); }
+
+private:
+    friend class GlImagePool;
+
+    std::shared_ptr<GpuTexture> texture;
+};
+
+struct GlImagePoolStats
+{
+    size_t allocations = 0;     // textures created
+    size_t reuses = 0;          // requests served from recycled textures
+    size_t cachedTextures = 0;  // held for reuse right now
+};
+
+// Recycles textures of the same format and size across operations, so
+// chained GPU steps do not allocate per step. Up to cacheLimit released
+// textures are kept. Images may outlive the pool; their textures are then
+// deleted when released. GL thread only.
+class GlImagePool
+{
+public:
+    explicit GlImagePool(size_t cacheLimit = 32);
+    ~GlImagePool();
+
+    GlImagePool(const GlImagePool&) = delete;
+    GlImagePool& operator=(const GlImagePool&) = delete;
+
+    // Returns an empty image for multi-planar formats.
+    GpuImage Acquire(PixelFormat format, int width, int height, ColorEncoding encoding = ColorEncoding::Linear);
+
+    // Storage for a block-compressed image, sampled as DecodedFormat().
+    GpuImage AcquireCompressed(CompressedFormat format, int width, int height);
+
+    // Deletes every cached texture.
+    void Trim();
+
+    GlImagePoolStats Stats() const;
+
+    struct State;
+
+private:
+    GpuImage Acquire(PixelFormat format, ColorEncoding encoding, GLenum internalFormat, int width, int height);
+
+    std::shared_ptr<State> state;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include <stdio.h>
+
+#include "gl_program.h"
+#include "trace.h"
+
+using namespace std;
+
+const string sFullscreenVertex = R"delim(
+#version 310 es
+
+void main()
+{
+    gl_Position = vec4(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0, 0, 1);
+}
+)delim";
+
+GLint CompileShader(const GLuint shaderID, const string& shaderCode)
+{
+    GLint Result = GL_FALSE;
+
+    // Compile Shader
+    char const* ShaderSourcePointer = shaderCode.c_str();
+    glShaderSource(shaderID, 1, &ShaderSourcePointer, NULL);
+    glCompileShader(shaderID);
+
+    // Check Shader
+    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &Result);
+    if (Result == GL_FALSE) {
+        int InfoLogLength;
+        glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+        vector<char> ShaderErrorMessage(InfoLogLength + 1);
+        glGetShaderInfoLog(shaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+        printf("%s\n", &ShaderErrorMessage[0]);
+    }
+    return Result;
+}
+
+GLuint CreateAndLinkProgram(const vector<GLuint> shaderIDs)
+{
+    GLuint ProgramID = glCreateProgram();
+    for (auto& sID : shaderIDs)
+    {
+        glAttachShader(ProgramID, sID);
+    }
+
+    glLinkProgram(ProgramID);
+
+    // Check the program
+    GLint Result = GL_FALSE;
+    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+    if (Result == GL_FALSE) {
+        int InfoLogLength;
+        glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+        vector<char> ProgramErrorMessage(InfoLogLength + 1);
+        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+        printf("%s\n", &ProgramErrorMessage[0]);
+    }
+
+    for (auto& sID : shaderIDs)
+    {
+        glDetachShader(ProgramID, sID);
+        glDeleteShader(sID);
+    }
+
+    return ProgramID;
+}
+
+GLuint LoadShaders(const string& sVertex, const string& sFragment)
+{
+    TRACE_SCOPE("LoadShaders");
+    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+
+    CompileShader(VertexShaderID, sVertex);
+    CompileShader(FragmentShaderID, sFragment);
+    vector<GLuint> shaderIDs = { VertexShaderID, FragmentShaderID };
+    auto ProgramID = CreateAndLinkProgram(shaderIDs);
+    return ProgramID;
+}
+
+GLuint LoadComputeShader(const string& sCompute)
+{
+    TRACE_SCOPE("LoadShaders");
+    GLuint ComputeShaderID = glCreateShader(GL_COMPUTE_SHADER);
+    CompileShader(ComputeShaderID, sCompute);
+    vector<GLuint> shaderIDs = { ComputeShaderID };
+    return CreateAndLinkProgram(shaderIDs);
+}
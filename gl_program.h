@@ -0,0 +1,18 @@
+#ifndef GL_PROGRAM_H
+#define GL_PROGRAM_H
+
+#include <vector>
+#include <string>
+
+#include "glad/glad.h"
+
+GLint CompileShader(const GLuint shaderID, const std::string& shaderCode);
+GLuint CreateAndLinkProgram(const std::vector<GLuint> shaderIDs);
+GLuint LoadShaders(const std::string& sVertex, const std::string& sFragment);
+GLuint LoadComputeShader(const std::string& sCompute);
+
+// Covers the viewport with one triangle, for passes drawn with
+// glDrawArrays(GL_TRIANGLES, 0, 3) from a VAO without attributes.
+extern const std::string sFullscreenVertex;
+
+#endif
@@ -0,0 +1,272 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "gl_pyramid.h"
+#include "gl_program.h"
+#include "trace.h"
+
+using namespace std;
+
+// Units 4 and 5 leave the warp engine's source and pack bindings alone
+static const string sReduceFragment = R"delim(
+#version 310 es
+precision highp float;
+precision highp sampler2D;
+
+layout(binding = 4) uniform sampler2D Source;
+
+// (1, 0) halves the width, (0, 1) the height
+uniform ivec2 Step;
+
+out vec4 fragColor;
+
+void main()
+{
+    const float Weights[5] = float[5](1.0, 4.0, 6.0, 4.0, 1.0);
+    ivec2 center = ivec2(gl_FragCoord.xy) * (ivec2(1) + Step);
+    ivec2 last = textureSize(Source, 0) - 1;
+    vec4 sum = vec4(0.0);
+    for (int k = -2; k <= 2; ++k)
+        sum += Weights[k + 2] * texelFetch(Source, clamp(center + k * Step, ivec2(0), last), 0);
+    fragColor = sum / 16.0;
+}
+)delim";
+
+// Expanding inserts zeros between coarse texels and filters with twice the
+// kernel, so even pixels see coarse weights (1, 6, 1) / 8 and odd pixels
+// (4, 4) / 8.
+static const string sStoreFragment = R"delim(
+#version 310 es
+precision highp float;
+precision highp sampler2D;
+
+layout(binding = 4) uniform sampler2D Fine;
+layout(binding = 5) uniform sampler2D Coarse;
+
+uniform ivec2 Origin;
+uniform bool Laplacian;
+
+out vec4 fragColor;
+
+vec3 ExpandWeights(int x)
+{
+    return (x & 1) == 0 ? vec3(1.0, 6.0, 1.0) / 8.0 : vec3(4.0, 4.0, 0.0) / 8.0;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy) - Origin;
+    fragColor = texelFetch(Fine, pixel, 0);
+    if (!Laplacian)
+        return;
+
+    // Even pixels center on coarse texel x / 2 and odd ones sit between
+    // (x - 1) / 2 and (x + 1) / 2, so three taps from (x + 1) / 2 - 1 cover
+    // both
+    ivec2 first = (pixel + 1) / 2 - 1;
+    ivec2 last = textureSize(Coarse, 0) - 1;
+    vec3 wx = ExpandWeights(pixel.x);
+    vec3 wy = ExpandWeights(pixel.y);
+    vec4 expanded = vec4(0.0);
+    for (int j = 0; j < 3; ++j) {
+        vec4 row = vec4(0.0);
+        for (int i = 0; i < 3; ++i)
+            row += wx[i] * texelFetch(Coarse, clamp(first + ivec2(i, j), ivec2(0), last), 0);
+        expanded += wy[j] * row;
+    }
+    fragColor -= expanded;
+}
+)delim";
+
+static GLuint CreateTexture(int width, int height, const void* data)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+GlPyramidBuilder::GlPyramidBuilder()
+{
+    glGenVertexArrays(1, &Vao);
+    glGenFramebuffers(1, &Fbo);
+}
+
+GlPyramidBuilder::~GlPyramidBuilder()
+{
+    PrepareLevels(0, 0, 0);
+    glDeleteProgram(ReduceProgram);
+    glDeleteProgram(StoreProgram);
+    glDeleteVertexArrays(1, &Vao);
+    glDeleteFramebuffers(1, &Fbo);
+}
+
+// The atlas holds level 0 on the left and stacks the others to its right,
+// so it is about 1.5 times as wide as the source.
+static void AtlasSize(int width, int height, int levelCount, int& atlasWidth, int& atlasHeight)
+{
+    atlasWidth = width;
+    atlasHeight = height;
+    int levelWidth = width, levelHeight = height, y = 0;
+    for (int i = 1; i < levelCount; ++i) {
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+        y += levelHeight;
+        atlasWidth = max(atlasWidth, width + levelWidth);
+        atlasHeight = max(atlasHeight, y);
+    }
+}
+
+// Levels are only reallocated when the source size or level count changes.
+void GlPyramidBuilder::PrepareLevels(int width, int height, int levelCount)
+{
+    if (!levels.empty() && levels[0].width == width && levels[0].height == height && int(levels.size()) == levelCount)
+        return;
+
+    for (auto& level : levels) {
+        glDeleteTextures(1, &level.texture);
+        glDeleteTextures(1, &level.rows);
+    }
+    glDeleteTextures(1, &AtlasTexture);
+    AtlasTexture = 0;
+    levels.assign(levelCount, Level());
+    if (levelCount == 0)
+        return;
+
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].texture = CreateTexture(width, height, nullptr);
+    AtlasSize(width, height, levelCount, atlasWidth, atlasHeight);
+    int y = 0;
+    for (int i = 1; i < levelCount; ++i) {
+        Level& level = levels[i];
+        level.width = (levels[i - 1].width + 1) / 2;
+        level.height = (levels[i - 1].height + 1) / 2;
+        level.x = width;
+        level.y = y;
+        level.texture = CreateTexture(level.width, level.height, nullptr);
+        level.rows = CreateTexture(level.width, levels[i - 1].height, nullptr);
+        y += level.height;
+    }
+    AtlasTexture = CreateTexture(atlasWidth, atlasHeight, nullptr);
+}
+
+void GlPyramidBuilder::Reduce(int level)
+{
+    const Level& fine = levels[level - 1];
+    const Level& coarse = levels[level];
+    const GLint step = glGetUniformLocation(ReduceProgram, "Step");
+    glUseProgram(ReduceProgram);
+
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, fine.texture);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, coarse.rows, 0);
+    glViewport(0, 0, coarse.width, fine.height);
+    glUniform2i(step, 1, 0);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindTexture(GL_TEXTURE_2D, coarse.rows);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, coarse.texture, 0);
+    glViewport(0, 0, coarse.width, coarse.height);
+    glUniform2i(step, 0, 1);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void GlPyramidBuilder::Store(int level, bool laplacian)
+{
+    const Level& fine = levels[level];
+    glUseProgram(StoreProgram);
+    glUniform2i(glGetUniformLocation(StoreProgram, "Origin"), fine.x, fine.y);
+    glUniform1i(glGetUniformLocation(StoreProgram, "Laplacian"), laplacian);
+
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, fine.texture);
+    if (laplacian) {
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, levels[level + 1].texture);
+    }
+    glViewport(fine.x, fine.y, fine.width, fine.height);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// One readback of the whole atlas, then the levels are copied out row by
+// row; the atlas corner right of level 0 that no level covers is wasted.
+bool GlPyramidBuilder::Readback(Pyramid& pyramid, HostArena& arena)
+{
+    const size_t pixelBytes = 4 * sizeof(float);
+    HostBuffer atlas = arena.Acquire(size_t(atlasWidth) * atlasHeight * pixelBytes);
+    if (!atlas)
+        return false;
+    {
+        GPU_TRACE_SCOPE("pyramid readback");
+        glReadPixels(0, 0, atlasWidth, atlasHeight, GL_RGBA, GL_FLOAT, atlas.Data());
+    }
+
+    size_t bytes = 0;
+    for (auto& level : levels)
+        bytes += size_t(level.width) * level.height * pixelBytes;
+    pyramid.buffer = arena.Acquire(bytes);
+    pyramid.levels.clear();
+    if (!pyramid.buffer)
+        return false;
+
+    unsigned char* target = pyramid.buffer.As<unsigned char>();
+    const unsigned char* rows = atlas.As<unsigned char>();
+    for (auto& level : levels) {
+        pyramid.levels.push_back(MakeImageView(PixelFormat::RGBA32F, level.width, level.height, target));
+        const size_t rowBytes = level.width * pixelBytes;
+        for (int y = 0; y < level.height; ++y) {
+            memcpy(target, rows + ((size_t(level.y) + y) * atlasWidth + level.x) * pixelBytes, rowBytes);
+            target += rowBytes;
+        }
+    }
+    return true;
+}
+
+bool GlPyramidBuilder::Build(const ImageView& source, int levelCount, bool laplacian, Pyramid& pyramid, HostArena& arena)
+{
+    if (source.format != PixelFormat::RGBA32F || levelCount < 1 || RowLength(source, 0) < source.width)
+        return false;
+
+    int neededWidth, neededHeight;
+    AtlasSize(source.width, source.height, levelCount, neededWidth, neededHeight);
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (neededWidth > maxSize || neededHeight > maxSize)
+        return false;
+
+    TRACE_SCOPE("GL pyramid");
+    if (!ReduceProgram) {
+        ReduceProgram = LoadShaders(sFullscreenVertex, sReduceFragment);
+        StoreProgram = LoadShaders(sFullscreenVertex, sStoreFragment);
+    }
+    PrepareLevels(source.width, source.height, levelCount);
+
+    {
+        GPU_TRACE_SCOPE("pyramid levels");
+        glBindTexture(GL_TEXTURE_2D, levels[0].texture);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, source.rowLengths[0]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, source.width, source.height, GL_RGBA, GL_FLOAT, source.planes[0]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+        glBindVertexArray(Vao);
+        glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+        for (int level = 1; level < levelCount; ++level)
+            Reduce(level);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, AtlasTexture, 0);
+        for (int level = 0; level < levelCount; ++level)
+            Store(level, laplacian && level + 1 < levelCount);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    const bool readBack = Readback(pyramid, arena);
+    if (TraceEnabled())
+        TraceCollectGpu();
+    return readBack;
+}
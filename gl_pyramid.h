@@ -0,0 +1,67 @@
+#ifndef GL_PYRAMID_H
+#define GL_PYRAMID_H
+
+#include <vector>
+
+#include "glad/glad.h"
+#include "host_buffer.h"
+#include "image.h"
+
+// Levels of a pyramid, all RGBA32F and stored one after another in buffer.
+// Level 0 has the source size and each next level half the size of the
+// previous one, rounded up.
+struct Pyramid
+{
+    HostBuffer buffer;
+    std::vector<ImageView> levels;
+};
+
+// Builds Gaussian or Laplacian pyramids on the current GL ES 3.1 context.
+// Each level is reduced from the previous one with the separable 5-tap
+// binomial kernel [1 4 6 4 1] / 16 in two passes, borders clamped. A
+// Laplacian band is a Gaussian level minus the expanded next level; the
+// last level holds the Gaussian residual, so collapsing the bands from the
+// top reproduces the source.
+//
+// Intermediate levels stay on the GPU: every level is rendered into one
+// atlas texture, read back with a single glReadPixels.
+class GlPyramidBuilder
+{
+public:
+    GlPyramidBuilder();
+    ~GlPyramidBuilder();
+
+    // Builds levelCount levels of an RGBA32F source into pyramid, whose
+    // buffer comes from arena. Returns false for other source formats, for
+    // sources whose atlas would exceed GL_MAX_TEXTURE_SIZE and when the
+    // host buffers cannot be allocated.
+    bool Build(const ImageView& source, int levelCount, bool laplacian, Pyramid& pyramid,
+        HostArena& arena = DefaultHostArena());
+
+private:
+    void PrepareLevels(int width, int height, int levelCount);
+    void Reduce(int level);
+    void Store(int level, bool laplacian);
+    bool Readback(Pyramid& pyramid, HostArena& arena);
+
+    struct Level
+    {
+        int width = 0;
+        int height = 0;
+        int x = 0;              // origin in the atlas
+        int y = 0;
+        GLuint texture = 0;     // level 0 is the uploaded source
+        GLuint rows = 0;        // reduced horizontally, at the previous level's height
+    };
+
+    GLuint ReduceProgram = 0;
+    GLuint StoreProgram = 0;
+    GLuint Vao = 0;
+    GLuint Fbo = 0;
+    GLuint AtlasTexture = 0;
+    int atlasWidth = 0;
+    int atlasHeight = 0;
+    std::vector<Level> levels;
+};
+
+#endif
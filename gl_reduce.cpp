@@ -0,0 +1,345 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "gl_reduce.h"
+#include "gl_program.h"
+#include "trace.h"
+
+using namespace std;
+
+// One workgroup per term: each lane reduces a strided subset of the rows,
+// then the lanes are combined as a tree.
+static const string sReduceCompute = R"delim(
+#version 310 es
+layout(local_size_x = 64) in;
+
+layout(std430, binding = 3) readonly buffer Partials { float partials[]; };
+layout(std430, binding = 4) writeonly buffer Results { float results[]; };
+
+uniform int Rows;
+uniform int Terms;
+uniform int Ops[64];   // 0 sum, 1 min, 2 max
+
+shared float lanes[64];
+
+float Combine(int op, float a, float b)
+{
+    return op == 0 ? a + b : op == 1 ? min(a, b) : max(a, b);
+}
+
+void main()
+{
+    int term = int(gl_WorkGroupID.x);
+    int lane = int(gl_LocalInvocationIndex);
+    int op = Ops[term];
+    float value = op == 0 ? 0.0 : partials[term];
+    for (int row = lane; row < Rows; row += 64)
+        value = Combine(op, value, partials[row * Terms + term]);
+    lanes[lane] = value;
+    for (int stride = 32; stride > 0; stride /= 2) {
+        barrier();
+        if (lane < stride)
+            lanes[lane] = Combine(op, lanes[lane], lanes[lane + stride]);
+    }
+    if (lane == 0)
+        results[term] = lanes[0];
+}
+)delim";
+
+// Each 8x8 workgroup covers 32x32 pixels, 4x4 per lane, and writes min,
+// max, sum and sum of squares of the RGBA difference as one row of 16
+// terms; pixels over the threshold are counted with an atomic. Units 7 and
+// 8 leave the warp and pyramid bindings alone.
+static const string sCompareCompute = R"delim(
+#version 310 es
+layout(local_size_x = 8, local_size_y = 8) in;
+precision highp float;
+precision highp sampler2D;
+
+layout(binding = 7) uniform sampler2D Image;
+layout(binding = 8) uniform sampler2D Reference;
+layout(std430, binding = 3) writeonly buffer Partials { float partials[]; };
+layout(std430, binding = 5) buffer Counts { uint over; };
+
+uniform float Threshold;
+
+shared vec4 lanes[4][64];
+
+void main()
+{
+    ivec2 size = textureSize(Image, 0);
+    ivec2 first = ivec2(gl_GlobalInvocationID.xy) * 4;
+    int lane = int(gl_LocalInvocationIndex);
+    // Pixels outside the image keep the identity of each reduction
+    vec4 low = vec4(3.0e38), high = vec4(-3.0e38), sum = vec4(0.0), squares = vec4(0.0);
+    uint count = 0u;
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            ivec2 pixel = first + ivec2(x, y);
+            if (any(greaterThanEqual(pixel, size)))
+                continue;
+            vec4 d = texelFetch(Image, pixel, 0) - texelFetch(Reference, pixel, 0);
+            low = min(low, d);
+            high = max(high, d);
+            sum += d;
+            squares += d * d;
+            if (any(greaterThan(abs(d), vec4(Threshold))))
+                ++count;
+        }
+    }
+    if (count != 0u)
+        atomicAdd(over, count);
+    lanes[0][lane] = low;
+    lanes[1][lane] = high;
+    lanes[2][lane] = sum;
+    lanes[3][lane] = squares;
+    for (int stride = 32; stride > 0; stride /= 2) {
+        barrier();
+        if (lane < stride) {
+            lanes[0][lane] = min(lanes[0][lane], lanes[0][lane + stride]);
+            lanes[1][lane] = max(lanes[1][lane], lanes[1][lane + stride]);
+            lanes[2][lane] += lanes[2][lane + stride];
+            lanes[3][lane] += lanes[3][lane + stride];
+        }
+    }
+    if (lane == 0) {
+        int row = int(gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * 16;
+        for (int k = 0; k < 4; ++k)
+            for (int c = 0; c < 4; ++c)
+                partials[row + k * 4 + c] = lanes[k][0][c];
+    }
+}
+)delim";
+
+// Lanes count 4x4 pixels each. Bins are counted in shared memory per
+// workgroup and then added to the global counts, except 4096 bins, which
+// would fill the guaranteed 16 KB of shared memory and go straight to the
+// global counts.
+static const string sHistogramCompute = R"delim(
+layout(local_size_x = 8, local_size_y = 8) in;
+precision highp float;
+precision highp sampler2D;
+
+layout(binding = 7) uniform sampler2D Image;
+layout(std430, binding = 5) buffer Counts { uint counts[]; };
+
+uniform int Channel;
+uniform float Low;
+uniform float Scale;    // bins per unit
+
+#if defined(LOCAL_BINS)
+shared uint bins[BINS];
+#endif
+
+void main()
+{
+    int lane = int(gl_LocalInvocationIndex);
+#if defined(LOCAL_BINS)
+    for (int i = lane; i < BINS; i += 64)
+        bins[i] = 0u;
+    barrier();
+#endif
+    ivec2 size = textureSize(Image, 0);
+    ivec2 first = ivec2(gl_GlobalInvocationID.xy) * 4;
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            ivec2 pixel = first + ivec2(x, y);
+            if (any(greaterThanEqual(pixel, size)))
+                continue;
+            float value = texelFetch(Image, pixel, 0)[Channel];
+            int bin = clamp(int(floor((value - Low) * Scale)), 0, BINS - 1);
+#if defined(LOCAL_BINS)
+            atomicAdd(bins[bin], 1u);
+#else
+            atomicAdd(counts[bin], 1u);
+#endif
+        }
+    }
+#if defined(LOCAL_BINS)
+    barrier();
+    for (int i = lane; i < BINS; i += 64)
+        if (bins[i] != 0u)
+            atomicAdd(counts[i], bins[i]);
+#endif
+}
+)delim";
+
+GlReducer::GlReducer()
+{
+    glGenBuffers(1, &ResultBuffer);
+    glGenBuffers(1, &PartialBuffer);
+    glGenBuffers(1, &CountBuffer);
+}
+
+GlReducer::~GlReducer()
+{
+    glDeleteProgram(ReduceProgram);
+    glDeleteProgram(CompareProgram);
+    for (auto& program : histogramPrograms)
+        glDeleteProgram(program.second);
+    glDeleteBuffers(1, &ResultBuffer);
+    glDeleteBuffers(1, &PartialBuffer);
+    glDeleteBuffers(1, &CountBuffer);
+}
+
+bool GlReducer::ReduceRows(GLuint partials, GLuint rows, const vector<ReduceOp>& ops, float* results)
+{
+    const int terms = int(ops.size());
+    if (terms == 0 || terms > MaxTerms || rows == 0)
+        return false;
+    if (!ReduceProgram) {
+        ReduceProgram = LoadComputeShader(sReduceCompute);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ResultBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, MaxTerms * sizeof(float), nullptr, GL_STREAM_READ);
+    }
+
+    GPU_TRACE_SCOPE("reduce rows");
+    GLint opCodes[MaxTerms];
+    for (int k = 0; k < terms; ++k)
+        opCodes[k] = GLint(ops[k]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, partials);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, ResultBuffer);
+
+    glUseProgram(ReduceProgram);
+    glUniform1i(glGetUniformLocation(ReduceProgram, "Rows"), GLint(rows));
+    glUniform1i(glGetUniformLocation(ReduceProgram, "Terms"), terms);
+    glUniform1iv(glGetUniformLocation(ReduceProgram, "Ops"), terms, opCodes);
+    glDispatchCompute(GLuint(terms), 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ResultBuffer);
+    const void* mapped = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, terms * sizeof(float), GL_MAP_READ_BIT);
+    if (mapped)
+        memcpy(results, mapped, terms * sizeof(float));
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return mapped != nullptr;
+}
+
+bool GlReducer::SumRows(GLuint partials, GLuint rows, int terms, float* sums)
+{
+    return ReduceRows(partials, rows, vector<ReduceOp>(max(terms, 0), ReduceOp::Sum), sums);
+}
+
+// Maps the first count counters; they are zeroed for the next use.
+bool GlReducer::ReadCounts(size_t count, unsigned* counts)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, CountBuffer);
+    const void* mapped = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GLuint), GL_MAP_READ_BIT);
+    if (mapped)
+        memcpy(counts, mapped, count * sizeof(GLuint));
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return mapped != nullptr;
+}
+
+// Zeroed counters for count values, bound to binding 5.
+static void ClearCounts(GLuint buffer, size_t count, size_t& capacity)
+{
+    const vector<GLuint> zeros(count, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    if (count * sizeof(GLuint) > capacity) {
+        capacity = count * sizeof(GLuint);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, zeros.data(), GL_DYNAMIC_READ);
+    } else {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GLuint), zeros.data());
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, buffer);
+}
+
+bool GlReducer::Compare(GLuint image, GLuint reference, int width, int height, float threshold, ImageDifference& difference)
+{
+    if (width <= 0 || height <= 0)
+        return false;
+    if (!CompareProgram)
+        CompareProgram = LoadComputeShader(sCompareCompute);
+
+    TRACE_SCOPE("GL compare");
+    const GLuint groupsX = GLuint((width + 31) / 32);
+    const GLuint groupsY = GLuint((height + 31) / 32);
+    float results[16];
+    unsigned over = 0;
+    {
+        GPU_TRACE_SCOPE("compare");
+        const size_t bytes = size_t(groupsX) * groupsY * 16 * sizeof(float);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, PartialBuffer);
+        if (bytes > partialBytes) {
+            glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+            partialBytes = bytes;
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, PartialBuffer);
+        ClearCounts(CountBuffer, 1, countBytes);
+
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, image);
+        glActiveTexture(GL_TEXTURE8);
+        glBindTexture(GL_TEXTURE_2D, reference);
+        glActiveTexture(GL_TEXTURE0);
+
+        glUseProgram(CompareProgram);
+        glUniform1f(glGetUniformLocation(CompareProgram, "Threshold"), threshold);
+        glDispatchCompute(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        vector<ReduceOp> ops(16, ReduceOp::Sum);
+        fill(ops.begin(), ops.begin() + 4, ReduceOp::Min);
+        fill(ops.begin() + 4, ops.begin() + 8, ReduceOp::Max);
+        if (!ReduceRows(PartialBuffer, groupsX * groupsY, ops, results) || !ReadCounts(1, &over))
+            return false;
+    }
+
+    for (int c = 0; c < 4; ++c) {
+        difference.min[c] = results[c];
+        difference.max[c] = results[4 + c];
+        difference.sum[c] = results[8 + c];
+        difference.sumSquares[c] = results[12 + c];
+    }
+    difference.pixels = size_t(width) * height;
+    difference.pixelsOver = over;
+    if (TraceEnabled())
+        TraceCollectGpu();
+    return true;
+}
+
+GLuint GlReducer::HistogramProgram(int bins)
+{
+    auto it = histogramPrograms.find(bins);
+    if (it != histogramPrograms.end())
+        return it->second;
+
+    string defines = "#version 310 es\n#define BINS " + to_string(bins) + "\n";
+    if (bins <= 256)
+        defines += "#define LOCAL_BINS\n";
+    return histogramPrograms[bins] = LoadComputeShader(defines + sHistogramCompute);
+}
+
+bool GlReducer::Histogram(GLuint texture, int width, int height, int channel, int bins, float low, float high,
+    vector<unsigned>& counts)
+{
+    if ((bins != 256 && bins != 4096) || channel < 0 || channel > 3 || !(high > low) || width <= 0 || height <= 0)
+        return false;
+
+    TRACE_SCOPE("GL histogram");
+    const GLuint ProgramID = HistogramProgram(bins);
+    counts.resize(bins);
+    {
+        GPU_TRACE_SCOPE("histogram");
+        ClearCounts(CountBuffer, bins, countBytes);
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+
+        glUseProgram(ProgramID);
+        glUniform1i(glGetUniformLocation(ProgramID, "Channel"), channel);
+        glUniform1f(glGetUniformLocation(ProgramID, "Low"), low);
+        glUniform1f(glGetUniformLocation(ProgramID, "Scale"), bins / (high - low));
+        glDispatchCompute(GLuint((width + 31) / 32), GLuint((height + 31) / 32), 1);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        if (!ReadCounts(bins, counts.data()))
+            return false;
+    }
+    if (TraceEnabled())
+        TraceCollectGpu();
+    return true;
+}
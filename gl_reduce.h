@@ -0,0 +1,75 @@
+#ifndef GL_REDUCE_H
+#define GL_REDUCE_H
+
+#include <stddef.h>
+
+#include <map>
+#include <vector>
+
+#include "glad/glad.h"
+
+// Statistics of image - reference per RGBA channel.
+struct ImageDifference
+{
+    float min[4] = {};
+    float max[4] = {};
+    double sum[4] = {};
+    double sumSquares[4] = {};
+    size_t pixels = 0;
+    size_t pixelsOver = 0;      // pixels with a channel differing by more than the threshold
+
+    // With a threshold of 0, true only if every texel matches exactly
+    bool Equal() const { return pixelsOver == 0; }
+};
+
+enum class ReduceOp { Sum, Min, Max };
+
+// Reductions in compute shaders: kernels write one row of partial results
+// per workgroup, and only the reduced columns come back to the host, so
+// validating a frame reads back a few numbers instead of the frame. GL
+// thread only.
+class GlReducer
+{
+public:
+    // Row reductions take at most this many terms
+    static const int MaxTerms = 64;
+
+    GlReducer();
+    ~GlReducer();
+
+    GlReducer(const GlReducer&) = delete;
+    GlReducer& operator=(const GlReducer&) = delete;
+
+    // Reduces rows of ops.size() floats in the shader storage buffer
+    // partials, column k with ops[k], into results.
+    bool ReduceRows(GLuint partials, GLuint rows, const std::vector<ReduceOp>& ops, float* results);
+
+    // Adds up rows of terms floats into sums.
+    bool SumRows(GLuint partials, GLuint rows, int terms, float* sums);
+
+    // Compares two textures of the same size that sample as floats, i.e.
+    // not integer formats. threshold applies to the absolute difference.
+    bool Compare(GLuint image, GLuint reference, int width, int height, float threshold, ImageDifference& difference);
+
+    // Counts the values of one channel in bins equal intervals of
+    // [low, high); values outside go to the first or last bin. bins is 256
+    // or 4096.
+    bool Histogram(GLuint texture, int width, int height, int channel, int bins, float low, float high,
+        std::vector<unsigned>& counts);
+
+private:
+    GLuint HistogramProgram(int bins);
+    bool ReadCounts(size_t count, unsigned* counts);
+
+    GLuint ReduceProgram = 0;
+    GLuint CompareProgram = 0;
+    std::map<int, GLuint> histogramPrograms;
+
+    GLuint ResultBuffer = 0;
+    GLuint PartialBuffer = 0;   // rows written by Compare()
+    GLuint CountBuffer = 0;     // atomic counters and histogram bins
+    size_t partialBytes = 0;
+    size_t countBytes = 0;
+};
+
+#endif
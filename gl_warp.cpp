@@ -0,0 +1,1223 @@
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "gl_warp.h"
+#include "demosaic.h"
+#include "gl_program.h"
+#include "trace.h"
+
+using namespace std;
+
+static const std::string sVertex = R"delim(
+#version 310 es
+
+layout(location = 0) in vec2 TextureCoord;
+layout(location = 1) in vec2 ClipSpaceCoord;
+
+out vec2 UV;
+
+void main()
+{
+    gl_Position = vec4(ClipSpaceCoord, 0, 1);
+    UV = TextureCoord;
+}
+)delim";
+
+// Compiled once per source format and filter; the SOURCE_* and FILTER_*
+// defines selected in Program() pick the sampling function. Shared by the
+// warp's fragment shader and the point sampling compute shader.
+static const std::string sSampling = R"delim(
+precision highp float;
+precision highp sampler2D;
+
+#if defined(SOURCE_RGBA)
+layout(binding = 0) uniform sampler2D Texture;
+
+vec4 FetchTexel(ivec2 texel)
+{
+    return texelFetch(Texture, texel, 0);
+}
+
+#if !defined(MANUAL_FILTER) && !defined(GATHER_FILTER)
+vec4 SampleSource(vec2 texCoord)
+{
+    return texture(Texture, texCoord);
+}
+#endif
+#elif defined(SOURCE_RED)
+// Single-channel float or UNORM, replicated to RGB like the CPU engine
+layout(binding = 0) uniform sampler2D Texture;
+
+vec4 FetchTexel(ivec2 texel)
+{
+    return vec4(vec3(texelFetch(Texture, texel, 0).r), 1.0);
+}
+
+#if !defined(MANUAL_FILTER) && !defined(GATHER_FILTER)
+vec4 SampleSource(vec2 texCoord)
+{
+    return vec4(vec3(texture(Texture, texCoord).r), 1.0);
+}
+#endif
+#elif defined(SOURCE_R16UI)
+// Integer textures cannot be filtered by the sampler, so they always take
+// the manual path below. Samples are raw counts, not normalized.
+layout(binding = 0) uniform highp usampler2D Texture;
+
+vec4 FetchTexel(ivec2 texel)
+{
+    return vec4(vec3(float(texelFetch(Texture, texel, 0).r)), 1.0);
+}
+#elif defined(SOURCE_BAYER)
+// Raw mosaic, demosaiced at every texel the filter reads, so the warp needs
+// no RGB intermediate. RedOrigin is the red site of the 2x2 pattern.
+// Neighbours beyond the edges are mirrored, which keeps the pattern's
+// phase; R16UI samples stay raw counts.
+#if defined(MOSAIC_UINT)
+layout(binding = 0) uniform highp usampler2D Texture;
+#else
+layout(binding = 0) uniform sampler2D Texture;
+#endif
+
+uniform ivec2 RedOrigin;
+
+float Mosaic(ivec2 texel)
+{
+    ivec2 last = textureSize(Texture, 0) - 1;
+    return float(texelFetch(Texture, max(last - abs(last - abs(texel)), 0), 0).r);
+}
+
+// Demosaics a site from the sums of its neighbours at distance 1 along the
+// row and column, on the diagonals and at distance 2 along the row and
+// column
+vec4 DemosaicSite(ivec2 texel, float c, float h1, float v1, float d, float h2, float v2)
+{
+#if defined(DEMOSAIC_MALVAR)
+    float green = (4.0 * c + 2.0 * (h1 + v1) - (h2 + v2)) / 8.0;
+    float across = (6.0 * c + 2.0 * d - 1.5 * (h2 + v2)) / 8.0;
+    float alongRow = (5.0 * c + 4.0 * h1 - d - h2 + 0.5 * v2) / 8.0;
+    float alongColumn = (5.0 * c + 4.0 * v1 - d - v2 + 0.5 * h2) / 8.0;
+#else
+    float green = (h1 + v1) / 4.0;
+    float across = d / 4.0;
+    float alongRow = h1 / 2.0;
+    float alongColumn = v1 / 2.0;
+#endif
+
+    // Red and blue sites get green and the opposite color from the
+    // diagonals; green sites take one color along their row, the other
+    // along their column
+    ivec2 phase = (texel - RedOrigin) & 1;
+    vec3 rgb;
+    if (phase.x == phase.y)
+        rgb = phase.x == 0 ? vec3(c, green, across) : vec3(across, green, c);
+    else
+        rgb = phase.y == 0 ? vec3(alongRow, c, alongColumn) : vec3(alongColumn, c, alongRow);
+    return vec4(rgb, 1.0);
+}
+
+vec4 FetchTexel(ivec2 texel)
+{
+    float h2 = 0.0, v2 = 0.0;
+#if defined(DEMOSAIC_MALVAR)
+    h2 = Mosaic(texel + ivec2(-2, 0)) + Mosaic(texel + ivec2(2, 0));
+    v2 = Mosaic(texel + ivec2(0, -2)) + Mosaic(texel + ivec2(0, 2));
+#endif
+    return DemosaicSite(texel, Mosaic(texel),
+        Mosaic(texel + ivec2(-1, 0)) + Mosaic(texel + ivec2(1, 0)),
+        Mosaic(texel + ivec2(0, -1)) + Mosaic(texel + ivec2(0, 1)),
+        Mosaic(texel + ivec2(-1, -1)) + Mosaic(texel + ivec2(1, -1)) + Mosaic(texel + ivec2(-1, 1)) + Mosaic(texel + ivec2(1, 1)),
+        h2, v2);
+}
+#else
+// Chroma planes are sampled at the luma coordinate, so the sampler filter
+// does the 4:2:0 upsampling. The conversion is affine, hence it commutes
+// with bilinear filtering and can be applied after it.
+layout(binding = 0) uniform sampler2D LumaTexture;
+layout(binding = 1) uniform sampler2D ChromaTexture;
+#if defined(SOURCE_I420)
+layout(binding = 2) uniform sampler2D ChromaVTexture;
+#endif
+
+uniform mat3 YuvToRgb;
+uniform vec3 YuvOffset;
+
+vec4 SampleSource(vec2 texCoord)
+{
+    vec3 yuv;
+    yuv.x = texture(LumaTexture, texCoord).r;
+#if defined(SOURCE_I420)
+    yuv.y = texture(ChromaTexture, texCoord).r;
+    yuv.z = texture(ChromaVTexture, texCoord).r;
+#else
+    yuv.yz = texture(ChromaTexture, texCoord).rg;
+#endif
+    return vec4(YuvToRgb * (yuv - YuvOffset), 1.0);
+}
+#endif
+
+#if defined(MANUAL_FILTER) || defined(GATHER_FILTER)
+// Filtering with fp32 weights. Texel centers sit at (i + 0.5) / size and
+// coordinates wrap like GL_REPEAT, as in the sampler.
+ivec2 WrapTexel(ivec2 texel)
+{
+    return ivec2(mod(vec2(texel), vec2(textureSize(Texture, 0))));
+}
+
+vec4 Fetch(ivec2 texel)
+{
+    return FetchTexel(WrapTexel(texel));
+}
+
+#if defined(GATHER_FILTER)
+// Each textureGather returns one channel of a 2x2 footprint in the order
+// (i0, j1), (i1, j1), (i1, j0), (i0, j0). Gathering at the footprint's
+// center keeps the unit's own fixed-point footprint selection in agreement
+// with SplitCoord.
+void Footprint(ivec2 texel, out vec4 t00, out vec4 t10, out vec4 t01, out vec4 t11)
+{
+    vec2 texCoord = (vec2(texel) + 1.0) / vec2(textureSize(Texture, 0));
+#if defined(SOURCE_RGBA)
+    vec4 r = textureGather(Texture, texCoord, 0);
+    vec4 g = textureGather(Texture, texCoord, 1);
+    vec4 b = textureGather(Texture, texCoord, 2);
+    vec4 a = textureGather(Texture, texCoord, 3);
+    t00 = vec4(r.w, g.w, b.w, a.w);
+    t10 = vec4(r.z, g.z, b.z, a.z);
+    t01 = vec4(r.x, g.x, b.x, a.x);
+    t11 = vec4(r.y, g.y, b.y, a.y);
+#else
+    vec4 v = vec4(textureGather(Texture, texCoord));
+    t00 = vec4(vec3(v.w), 1.0);
+    t10 = vec4(vec3(v.z), 1.0);
+    t01 = vec4(vec3(v.x), 1.0);
+    t11 = vec4(vec3(v.y), 1.0);
+#endif
+}
+#elif defined(SOURCE_BAYER)
+// The four demosaics of a 2x2 footprint share most of their samples, so
+// the window around it is read once: 24 fetches instead of 52 for Malvar,
+// 16 instead of 36 for bilinear. Footprints across the wrap take the
+// general path.
+vec4 MosaicRow(ivec2 texel)
+{
+    return vec4(Mosaic(texel + ivec2(-1, 0)), Mosaic(texel), Mosaic(texel + ivec2(1, 0)), Mosaic(texel + ivec2(2, 0)));
+}
+
+void Footprint(ivec2 texel, out vec4 t00, out vec4 t10, out vec4 t01, out vec4 t11)
+{
+    if (any(lessThan(texel, ivec2(0))) || any(greaterThanEqual(texel + 1, textureSize(Texture, 0)))) {
+        t00 = Fetch(texel);
+        t10 = Fetch(texel + ivec2(1, 0));
+        t01 = Fetch(texel + ivec2(0, 1));
+        t11 = Fetch(texel + ivec2(1, 1));
+        return;
+    }
+
+    // Rows -1 to 2 of columns -1 to 2, and the samples two away along the
+    // footprint's rows and columns
+    vec4 r0 = MosaicRow(texel + ivec2(0, -1));
+    vec4 r1 = MosaicRow(texel);
+    vec4 r2 = MosaicRow(texel + ivec2(0, 1));
+    vec4 r3 = MosaicRow(texel + ivec2(0, 2));
+    vec4 h2 = vec4(0.0), v2 = vec4(0.0);
+#if defined(DEMOSAIC_MALVAR)
+    vec2 left = vec2(Mosaic(texel + ivec2(-2, 0)), Mosaic(texel + ivec2(-2, 1)));
+    vec2 right = vec2(Mosaic(texel + ivec2(3, 0)), Mosaic(texel + ivec2(3, 1)));
+    vec2 top = vec2(Mosaic(texel + ivec2(0, -2)), Mosaic(texel + ivec2(1, -2)));
+    vec2 bottom = vec2(Mosaic(texel + ivec2(0, 3)), Mosaic(texel + ivec2(1, 3)));
+    h2 = vec4(left.x + r1.w, r1.x + right.x, left.y + r2.w, r2.x + right.y);
+    v2 = vec4(top.x + r3.y, top.y + r3.z, r0.y + bottom.x, r0.z + bottom.y);
+#endif
+    t00 = DemosaicSite(texel, r1.y, r1.x + r1.z, r0.y + r2.y, r0.x + r0.z + r2.x + r2.z, h2.x, v2.x);
+    t10 = DemosaicSite(texel + ivec2(1, 0), r1.z, r1.y + r1.w, r0.z + r2.z, r0.y + r0.w + r2.y + r2.w, h2.y, v2.y);
+    t01 = DemosaicSite(texel + ivec2(0, 1), r2.y, r2.x + r2.z, r1.y + r3.y, r1.x + r1.z + r3.x + r3.z, h2.z, v2.z);
+    t11 = DemosaicSite(texel + ivec2(1, 1), r2.z, r2.y + r2.w, r1.z + r3.z, r1.y + r1.w + r3.y + r3.w, h2.w, v2.w);
+}
+#else
+void Footprint(ivec2 texel, out vec4 t00, out vec4 t10, out vec4 t01, out vec4 t11)
+{
+    t00 = Fetch(texel);
+    t10 = Fetch(texel + ivec2(1, 0));
+    t01 = Fetch(texel + ivec2(0, 1));
+    t11 = Fetch(texel + ivec2(1, 1));
+}
+#endif
+
+// The fraction is snapped to 1/65536 texel, so rasterizer rounding noise
+// around texel centers cannot move the footprint by one texel.
+ivec2 SplitCoord(vec2 coord, out vec2 f)
+{
+    vec2 base = floor(coord);
+    f = round((coord - base) * 65536.0) / 65536.0;
+    base += floor(f);
+    f = fract(f);
+    return ivec2(base);
+}
+
+vec4 CubicWeights(float f)
+{
+    // Keys kernel, a = -0.5
+    float f2 = f * f;
+    float f3 = f2 * f;
+    return vec4(
+        -0.5 * f3 + f2 - 0.5 * f,
+        1.5 * f3 - 2.5 * f2 + 1.0,
+        -1.5 * f3 + 2.0 * f2 + 0.5 * f,
+        0.5 * f3 - 0.5 * f2);
+}
+
+// 4x4 taps from texel - 1, as four 2x2 footprints
+void CubicTaps(ivec2 texel, out vec4 taps[16])
+{
+    Footprint(texel + ivec2(-1, -1), taps[0], taps[1], taps[4], taps[5]);
+    Footprint(texel + ivec2(1, -1), taps[2], taps[3], taps[6], taps[7]);
+    Footprint(texel + ivec2(-1, 1), taps[8], taps[9], taps[12], taps[13]);
+    Footprint(texel + ivec2(1, 1), taps[10], taps[11], taps[14], taps[15]);
+}
+
+vec4 SampleSource(vec2 texCoord)
+{
+    vec2 size = vec2(textureSize(Texture, 0));
+#if defined(FILTER_NEAREST)
+    return Fetch(ivec2(floor(texCoord * size)));
+#else
+    vec2 f;
+    ivec2 texel = SplitCoord(texCoord * size - 0.5, f);
+#if defined(FILTER_CUBIC)
+    vec4 taps[16];
+    CubicTaps(texel, taps);
+
+    vec4 wx = CubicWeights(f.x);
+    vec4 wy = CubicWeights(f.y);
+    vec4 result = vec4(0.0);
+    for (int j = 0; j < 4; ++j) {
+        vec4 row = wx.x * taps[j * 4] + wx.y * taps[j * 4 + 1] + wx.z * taps[j * 4 + 2] + wx.w * taps[j * 4 + 3];
+        result += wy[j] * row;
+    }
+    return result;
+#else
+    vec4 t00, t10, t01, t11;
+    Footprint(texel, t00, t10, t01, t11);
+#if defined(FILTER_MIN)
+    return min(min(t00, t10), min(t01, t11));
+#elif defined(FILTER_MAX)
+    return max(max(t00, t10), max(t01, t11));
+#else
+    return mix(mix(t00, t10, f.x), mix(t01, t11, f.x), f.y);
+#endif
+#endif
+#endif
+}
+
+#if defined(GRADIENT)
+// Derivatives of CubicWeights() with respect to f
+vec4 CubicDerivatives(float f)
+{
+    float f2 = f * f;
+    return vec4(
+        -1.5 * f2 + 2.0 * f - 0.5,
+        4.5 * f2 - 5.0 * f,
+        -4.5 * f2 + 4.0 * f + 0.5,
+        1.5 * f2 - f);
+}
+
+// The filtered value with its analytic derivatives along x and y, per
+// source texel. Linear and Cubic only.
+vec4 SampleGradient(vec2 texCoord, out vec4 dx, out vec4 dy)
+{
+    vec2 size = vec2(textureSize(Texture, 0));
+    vec2 f;
+    ivec2 texel = SplitCoord(texCoord * size - 0.5, f);
+#if defined(FILTER_CUBIC)
+    vec4 taps[16];
+    CubicTaps(texel, taps);
+
+    vec4 wx = CubicWeights(f.x);
+    vec4 wy = CubicWeights(f.y);
+    vec4 dwx = CubicDerivatives(f.x);
+    vec4 dwy = CubicDerivatives(f.y);
+    vec4 result = vec4(0.0);
+    dx = vec4(0.0);
+    dy = vec4(0.0);
+    for (int j = 0; j < 4; ++j) {
+        vec4 row = wx.x * taps[j * 4] + wx.y * taps[j * 4 + 1] + wx.z * taps[j * 4 + 2] + wx.w * taps[j * 4 + 3];
+        vec4 rowDx = dwx.x * taps[j * 4] + dwx.y * taps[j * 4 + 1] + dwx.z * taps[j * 4 + 2] + dwx.w * taps[j * 4 + 3];
+        result += wy[j] * row;
+        dx += wy[j] * rowDx;
+        dy += dwy[j] * row;
+    }
+    return result;
+#else
+    vec4 t00, t10, t01, t11;
+    Footprint(texel, t00, t10, t01, t11);
+    vec4 top = mix(t00, t10, f.x);
+    vec4 bottom = mix(t01, t11, f.x);
+    dx = mix(t10 - t00, t11 - t01, f.y);
+    dy = bottom - top;
+    return mix(top, bottom, f.y);
+#endif
+}
+#endif
+#endif
+)delim";
+
+static const std::string sFragment = R"delim(
+in vec2 UV;
+
+out vec4 fragColor;
+
+#if defined(DITHER)
+// 4x4 Bayer matrix, scaled below to offsets within half an 8-bit step
+const float Bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+#endif
+
+void main()
+{
+	//vec2 texCoord = UV + vec2(1.0 / 4194304.0, 1.0 / 4194304.0);
+	vec2 texCoord = UV + vec2(0, 0);
+	fragColor = SampleSource(texCoord);
+#if defined(DITHER)
+	ivec2 cell = ivec2(gl_FragCoord.xy) & 3;
+	fragColor += ((Bayer[cell.y * 4 + cell.x] + 0.5) / 16.0 - 0.5) / 255.0;
+#endif
+}
+)delim";
+
+// Packs four R8 texels of a row into one RGBA8 texel; the last texel of a
+// row repeats the last pixel.
+static const std::string sPackFragment = R"delim(
+#version 310 es
+precision highp float;
+precision highp sampler2D;
+
+layout(binding = 3) uniform sampler2D Rows;
+
+out vec4 fragColor;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    int width = textureSize(Rows, 0).x;
+    vec4 texels;
+    for (int i = 0; i < 4; ++i)
+        texels[i] = texelFetch(Rows, ivec2(min(texel.x * 4 + i, width - 1), texel.y), 0).r;
+    fragColor = texels;
+}
+)delim";
+
+// Multi-channel integer sources would need their own shader path
+static bool IsSupportedSource(PixelFormat format)
+{
+    switch (format) {
+    case PixelFormat::RG16UI:
+    case PixelFormat::RGB16UI:
+    case PixelFormat::RGBA16UI:
+        return false;
+    default:
+        return true;
+    }
+}
+
+static bool IsSupportedTarget(PixelFormat format)
+{
+    switch (format) {
+    case PixelFormat::RGBA32F:
+    case PixelFormat::RGBA16F:
+    case PixelFormat::RGBA8:
+    case PixelFormat::R8:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The GPU converts sRGB only for RGB8 and RGBA8 textures, and renders only
+// to RGBA8 ones
+static bool IsSupportedEncoding(const ImageView& image, bool target)
+{
+    if (image.encoding == ColorEncoding::Linear)
+        return true;
+    return image.format == PixelFormat::RGBA8 || (!target && image.format == PixelFormat::RGB8);
+}
+
+// Mosaics are single-channel, and their pattern is only known to jobs, not
+// to resident images
+static bool IsSupportedMosaic(const ImageView& image)
+{
+    if (image.bayer == BayerPattern::None)
+        return true;
+    return (image.format == PixelFormat::R8 || image.format == PixelFormat::R16UI) && image.encoding == ColorEncoding::Linear;
+}
+
+// Rows may be spaced wider than the image, never narrower
+static bool IsSupportedLayout(const ImageView& image)
+{
+    for (int plane = 0; plane < PlaneCount(image.format); ++plane) {
+        int w, h;
+        PlaneSize(image.format, plane, image.width, image.height, w, h);
+        if (image.rowLengths[plane] != 0 && image.rowLengths[plane] < w)
+            return false;
+    }
+    return true;
+}
+
+static bool IsYuv(PixelFormat format)
+{
+    return format == PixelFormat::NV12 || format == PixelFormat::I420;
+}
+
+// Integer sources, mosaics, filters the sampler cannot do and jobs not
+// asking for Sampling::Hardware are filtered in the shader; YUV planes only
+// support sampler filtering.
+static bool ManualFiltering(const WarpJob& job)
+{
+    return job.source.format == PixelFormat::R16UI || job.source.bayer != BayerPattern::None ||
+        job.sampling != Sampling::Hardware || job.filter == Filter::Cubic || job.filter == Filter::Min ||
+        job.filter == Filter::Max;
+}
+
+// Nearest needs one texel, so it stays on texelFetch, and a mosaic texel
+// is a neighbourhood of samples
+static bool GatherFiltering(const WarpJob& job)
+{
+    return job.sampling == Sampling::Gather && job.filter != Filter::Nearest && job.source.bayer == BayerPattern::None;
+}
+
+GlWarpEngine::GlWarpEngine()
+{
+    glGenVertexArrays(1, &Vao);
+    glBindVertexArray(Vao);
+
+    glGenBuffers(1, &SourceGridBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, SourceGridBuffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glGenBuffers(1, &TargetGridBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, TargetGridBuffer);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glGenBuffers(1, &IndexVertices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexVertices);
+
+    glGenTextures(3, SourceTextures);
+    glGenTextures(1, &TargetTexture);
+    glGenFramebuffers(1, &Fbo);
+    glGenTextures(1, &PackedTexture);
+    glGenFramebuffers(1, &PackFbo);
+    glGenVertexArrays(1, &PackVao);
+    glGenBuffers(1, &PointBuffer);
+    glGenBuffers(1, &ValueBuffer);
+    glGenBuffers(1, &AlignPartials);
+
+    // Otherwise the implementation may dither 8-bit targets on its own
+    glDisable(GL_DITHER);
+
+    // 8-bit planes are rarely a multiple of 4 bytes wide
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+}
+
+GlWarpEngine::~GlWarpEngine()
+{
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glUseProgram(0);
+
+    for (auto& program : programs)
+    {
+        glDeleteProgram(program.second);
+    }
+    glDeleteProgram(PackProgram);
+    glDeleteVertexArrays(1, &Vao);
+    glDeleteVertexArrays(1, &PackVao);
+    glDeleteFramebuffers(1, &Fbo);
+    glDeleteFramebuffers(1, &PackFbo);
+    glDeleteBuffers(1, &IndexVertices);
+    glDeleteBuffers(1, &SourceGridBuffer);
+    glDeleteBuffers(1, &TargetGridBuffer);
+    glDeleteBuffers(1, &PointBuffer);
+    glDeleteBuffers(1, &ValueBuffer);
+    glDeleteBuffers(1, &AlignPartials);
+    glDeleteTextures(3, SourceTextures);
+    glDeleteTextures(1, &TargetTexture);
+    glDeleteTextures(1, &PackedTexture);
+}
+
+// Evaluates SampleSource() at a list of normalized coordinates. Offset lets
+// lists longer than one dispatch allows be split.
+static const std::string sPointsCompute = R"delim(
+layout(local_size_x = 64) in;
+
+layout(std430, binding = 0) readonly buffer Coordinates { vec2 coordinates[]; };
+layout(std430, binding = 1) writeonly buffer Values { vec4 values[]; };
+
+uniform uint Offset;
+uniform uint Count;
+
+void main()
+{
+    uint i = Offset + gl_GlobalInvocationID.x;
+    if (i >= Count)
+        return;
+#if defined(GRADIENT)
+    vec4 dx, dy;
+    values[i * 3u] = SampleGradient(coordinates[i], dx, dy);
+    values[i * 3u + 1u] = dx;
+    values[i * 3u + 2u] = dy;
+#else
+    values[i] = SampleSource(coordinates[i]);
+#endif
+}
+)delim";
+
+// One Gauss-Newton step of aligning the source to Template over an affine
+// warp. Each template pixel adds the upper triangle of J^T J (21 terms),
+// J^T r (6), r^2 and a count for its RGB channels, where J is the
+// derivative of the sampled source by the six parameters; pixels mapping
+// outside the source add nothing. Each workgroup writes its sums to
+// Partials, which GlReducer adds up.
+static const std::string sAlignCompute = R"delim(
+layout(local_size_x = 64) in;
+
+layout(binding = 6) uniform sampler2D Template;
+layout(std430, binding = 2) writeonly buffer Partials { float partials[]; };
+
+uniform float Affine[6];
+
+const int Terms = 29;
+shared float sums[64 * Terms];
+
+void main()
+{
+    float local[Terms];
+    for (int k = 0; k < Terms; ++k)
+        local[k] = 0.0;
+
+    ivec2 size = textureSize(Template, 0);
+    int index = int(gl_GlobalInvocationID.x);
+    if (index < size.x * size.y) {
+        ivec2 pixel = ivec2(index % size.x, index / size.x);
+        vec2 uv = (vec2(pixel) + 0.5) / vec2(size);
+        vec2 coord = vec2(Affine[0] * uv.x + Affine[1] * uv.y + Affine[2], Affine[3] * uv.x + Affine[4] * uv.y + Affine[5]);
+        if (all(greaterThanEqual(coord, vec2(0.0))) && all(lessThanEqual(coord, vec2(1.0)))) {
+            vec4 dx, dy;
+            vec4 residual = SampleGradient(coord, dx, dy) - texelFetch(Template, pixel, 0);
+            // Per texel to per normalized unit
+            vec2 sourceSize = vec2(textureSize(Texture, 0));
+            for (int c = 0; c < 3; ++c) {
+                float gx = dx[c] * sourceSize.x;
+                float gy = dy[c] * sourceSize.y;
+                float J[6] = float[6](gx * uv.x, gx * uv.y, gx, gy * uv.x, gy * uv.y, gy);
+                int k = 0;
+                for (int a = 0; a < 6; ++a)
+                    for (int b = a; b < 6; ++b)
+                        local[k++] += J[a] * J[b];
+                for (int a = 0; a < 6; ++a)
+                    local[21 + a] += J[a] * residual[c];
+                local[27] += residual[c] * residual[c];
+            }
+            local[28] = 1.0;
+        }
+    }
+
+    int lane = int(gl_LocalInvocationIndex);
+    for (int k = 0; k < Terms; ++k)
+        sums[lane * Terms + k] = local[k];
+    for (int stride = 32; stride > 0; stride /= 2) {
+        barrier();
+        if (lane < stride)
+            for (int k = 0; k < Terms; ++k)
+                sums[lane * Terms + k] += sums[(lane + stride) * Terms + k];
+    }
+    if (lane == 0)
+        for (int k = 0; k < Terms; ++k)
+            partials[int(gl_WorkGroupID.x) * Terms + k] = sums[k];
+}
+)delim";
+
+GLuint GlWarpEngine::Program(const WarpJob& job, Kernel kernel)
+{
+    string defines;
+    if (job.source.bayer != BayerPattern::None) {
+        defines += "#define SOURCE_BAYER\n";
+        if (job.source.format == PixelFormat::R16UI)
+            defines += "#define MOSAIC_UINT\n";
+        if (job.demosaic == Demosaic::Malvar)
+            defines += "#define DEMOSAIC_MALVAR\n";
+    } else switch (job.source.format) {
+    case PixelFormat::NV12: defines += "#define SOURCE_NV12\n"; break;
+    case PixelFormat::I420: defines += "#define SOURCE_I420\n"; break;
+    case PixelFormat::R16UI: defines += "#define SOURCE_R16UI\n"; break;
+    case PixelFormat::R8:
+    case PixelFormat::R16F:
+    case PixelFormat::R32F: defines += "#define SOURCE_RED\n"; break;
+    default: defines += "#define SOURCE_RGBA\n"; break;
+    }
+
+    // Gradients come from the manual filters
+    if (ManualFiltering(job) || kernel == Kernel::Gradients || kernel == Kernel::Align) {
+        defines += GatherFiltering(job) ? "#define GATHER_FILTER\n" : "#define MANUAL_FILTER\n";
+        switch (job.filter) {
+        case Filter::Nearest: defines += "#define FILTER_NEAREST\n"; break;
+        case Filter::Linear: defines += "#define FILTER_LINEAR\n"; break;
+        case Filter::Cubic: defines += "#define FILTER_CUBIC\n"; break;
+        case Filter::Min: defines += "#define FILTER_MIN\n"; break;
+        case Filter::Max: defines += "#define FILTER_MAX\n"; break;
+        }
+    }
+
+    // Dithering a float target would only add noise, and sRGB targets are
+    // quantized after the shader encodes them
+    if (job.dither && kernel == Kernel::Warp && job.target.encoding == ColorEncoding::Linear &&
+        (job.target.format == PixelFormat::RGBA8 || job.target.format == PixelFormat::R8))
+        defines += "#define DITHER\n";
+    switch (kernel) {
+    case Kernel::Warp: break;
+    case Kernel::Points: defines += "#define POINTS\n"; break;
+    case Kernel::Gradients: defines += "#define POINTS\n#define GRADIENT\n"; break;
+    case Kernel::Align: defines += "#define ALIGN\n#define GRADIENT\n"; break;
+    }
+
+    auto it = programs.find(defines);
+    if (it != programs.end())
+        return it->second;
+
+    GLuint ProgramID;
+    if (kernel == Kernel::Warp)
+        ProgramID = LoadShaders(sVertex, "#version 310 es\n" + defines + sSampling + sFragment);
+    else
+        ProgramID = LoadComputeShader("#version 310 es\n" + defines + sSampling + (kernel == Kernel::Align ? sAlignCompute : sPointsCompute));
+    programs[defines] = ProgramID;
+    return ProgramID;
+}
+
+// Source uniforms and sampler filters for a draw or dispatch reading the
+// planes bound to units 0 to 2.
+void GlWarpEngine::PrepareSampling(const WarpJob& job, GLuint ProgramID)
+{
+    if (IsYuv(job.source.format)) {
+        float coefficients[9], offset[3];
+        YuvToRgbCoefficients(job.source.matrix, job.source.range, coefficients, offset);
+        glUniformMatrix3fv(glGetUniformLocation(ProgramID, "YuvToRgb"), 1, GL_TRUE, coefficients);
+        glUniform3fv(glGetUniformLocation(ProgramID, "YuvOffset"), 1, offset);
+    }
+    if (job.source.bayer != BayerPattern::None) {
+        int x, y;
+        BayerRedOrigin(job.source.bayer, x, y);
+        glUniform2i(glGetUniformLocation(ProgramID, "RedOrigin"), x, y);
+    }
+
+    // texelFetch ignores the sampler filter, but a float texture set to
+    // GL_LINEAR may be incomplete without OES_texture_float_linear
+    const GLint glFilter = job.filter == Filter::Linear && !ManualFiltering(job) ? GL_LINEAR : GL_NEAREST;
+    for (int plane = 0; plane < PlaneCount(job.source.format); ++plane)
+    {
+        glActiveTexture(GL_TEXTURE0 + plane);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, glFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, glFilter);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void GlWarpEngine::UploadMesh(const WarpMesh& mesh)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, SourceGridBuffer);
+    glBufferData(GL_ARRAY_BUFFER, mesh.sourceGrid.size() * sizeof(float), mesh.sourceGrid.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, TargetGridBuffer);
+    glBufferData(GL_ARRAY_BUFFER, mesh.targetGrid.size() * sizeof(float), mesh.targetGrid.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * mesh.indices.size(), mesh.indices.data(), GL_STREAM_DRAW);
+    indexCount = GLsizei(mesh.indices.size());
+}
+
+void GlWarpEngine::UploadSource(const ImageView& source)
+{
+    const bool reallocate = source.format != sourceFormat || source.encoding != sourceEncoding ||
+        source.width != sourceWidth || source.height != sourceHeight;
+
+    for (int plane = 0; plane < PlaneCount(source.format); ++plane)
+    {
+        int w, h;
+        PlaneSize(source.format, plane, source.width, source.height, w, h);
+        const PlaneFormat pf = TexturePlaneFormat(source.format, plane, source.encoding);
+
+        glActiveTexture(GL_TEXTURE0 + plane);
+        glBindTexture(GL_TEXTURE_2D, SourceTextures[plane]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, source.rowLengths[plane]);
+        if (reallocate)
+            glTexImage2D(GL_TEXTURE_2D, 0, pf.internalFormat, w, h, 0, pf.format, pf.type, source.planes[plane]);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, pf.format, pf.type, source.planes[plane]);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    sourceFormat = source.format;
+    sourceEncoding = source.encoding;
+    sourceWidth = source.width;
+    sourceHeight = source.height;
+}
+
+void GlWarpEngine::PrepareTarget(const ImageView& target)
+{
+    // Resident warps attach their own targets to Fbo, so attach every time
+    glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+    if (target.format != targetFormat || target.encoding != targetEncoding || target.width != targetWidth ||
+        target.height != targetHeight) {
+        // The pack pass samples R8 targets with texelFetch, which needs a
+        // complete texture, hence no mipmap filter
+        const PlaneFormat pf = TexturePlaneFormat(target.format, 0, target.encoding);
+        glBindTexture(GL_TEXTURE_2D, TargetTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, pf.internalFormat, target.width, target.height, 0, pf.format, pf.type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        targetFormat = target.format;
+        targetEncoding = target.encoding;
+        targetWidth = target.width;
+        targetHeight = target.height;
+    }
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TargetTexture, 0);
+}
+
+bool GlWarpEngine::Upload(const WarpJob& job)
+{
+    if (!job.mesh || !IsSupportedTarget(job.target.format) || !IsSupportedSource(job.source.format) ||
+        !IsSupportedEncoding(job.source, false) || !IsSupportedEncoding(job.target, true) ||
+        !IsSupportedMosaic(job.source) || !IsSupportedLayout(job.source) || !IsSupportedLayout(job.target))
+        return false;
+    if (IsYuv(job.source.format) && ManualFiltering(job))
+        return false;
+
+    TRACE_SCOPE("GL upload");
+    GPU_TRACE_SCOPE("upload");
+    glBindVertexArray(Vao);
+    UploadMesh(*job.mesh);
+    PrepareTarget(job.target);
+    UploadSource(job.source);
+    return true;
+}
+
+void GlWarpEngine::Draw(const WarpJob& job)
+{
+    TRACE_SCOPE("GL draw");
+    GPU_TRACE_SCOPE("draw");
+    GLuint ProgramID = Program(job);
+    glUseProgram(ProgramID);
+    PrepareSampling(job, ProgramID);
+
+    glBindVertexArray(Vao);
+    glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+    glViewport(0, 0, job.target.width, job.target.height);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, nullptr);
+}
+
+void GlWarpEngine::PackRows(GLuint texture, int width, int height)
+{
+    GPU_TRACE_SCOPE("pack rows");
+    if (!PackProgram)
+        PackProgram = LoadShaders(sFullscreenVertex, sPackFragment);
+
+    const int packedWidth = (width + 3) / 4;
+    glBindFramebuffer(GL_FRAMEBUFFER, PackFbo);
+    if (packedWidth != this->packedWidth || height != packedHeight) {
+        glBindTexture(GL_TEXTURE_2D, PackedTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, packedWidth, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, PackedTexture, 0);
+        this->packedWidth = packedWidth;
+        packedHeight = height;
+    }
+
+    // Unit 3 is free, so the source planes stay bound for further draws
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUseProgram(PackProgram);
+    glBindVertexArray(PackVao);
+    glViewport(0, 0, packedWidth, height);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// Reads texture, attached to Fbo, into target of the same format and size.
+void GlWarpEngine::ReadTexture(GLuint texture, const ImageView& target)
+{
+    {
+        TRACE_SCOPE("GL readback");
+        const int width = target.width;
+        const int height = target.height;
+        const int rowLength = RowLength(target, 0);
+
+        if (target.format == PixelFormat::R8) {
+            PackRows(texture, width, height);
+            GPU_TRACE_SCOPE("readback");
+            const int packedWidth = (width + 3) / 4;
+            if (packedWidth * 4 == width && rowLength % 4 == 0) {
+                glPixelStorei(GL_PACK_ROW_LENGTH, rowLength / 4);
+                glReadPixels(0, 0, packedWidth, height, GL_RGBA, GL_UNSIGNED_BYTE, target.planes[0]);
+                glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+            } else {
+                // Rows are padded to whole texels on the GPU
+                readbackRows.resize(size_t(packedWidth) * 4 * height);
+                glReadPixels(0, 0, packedWidth, height, GL_RGBA, GL_UNSIGNED_BYTE, readbackRows.data());
+                unsigned char* rows = (unsigned char*)target.planes[0];
+                for (int y = 0; y < height; ++y)
+                    memcpy(rows + size_t(y) * rowLength, &readbackRows[size_t(y) * packedWidth * 4], width);
+            }
+        } else {
+            GPU_TRACE_SCOPE("readback");
+            glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+            glPixelStorei(GL_PACK_ROW_LENGTH, target.rowLengths[0]);
+            if (target.format == PixelFormat::RGBA8) {
+                glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, target.planes[0]);
+            } else if (target.format == PixelFormat::RGBA16F) {
+                // RGBA/FLOAT is the only pair guaranteed for float buffers;
+                // most implementations also offer half floats
+                GLint readFormat = 0, readType = 0;
+                glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &readFormat);
+                glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &readType);
+                if (readFormat == GL_RGBA && readType == GL_HALF_FLOAT) {
+                    glReadPixels(0, 0, width, height, GL_RGBA, GL_HALF_FLOAT, target.planes[0]);
+                } else {
+                    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+                    readbackFloats.resize(size_t(width) * height * 4);
+                    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, readbackFloats.data());
+                    for (int y = 0; y < height; ++y) {
+                        unsigned short* halves = (unsigned short*)target.planes[0] + size_t(y) * rowLength * 4;
+                        const float* floats = &readbackFloats[size_t(y) * width * 4];
+                        for (int i = 0; i < width * 4; ++i)
+                            halves[i] = FloatToHalf(floats[i]);
+                    }
+                }
+            } else {
+                glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, target.planes[0]);
+            }
+            glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+        }
+    }
+
+    // The readback waited for the GPU anyway
+    if (TraceEnabled())
+        TraceCollectGpu();
+}
+
+void GlWarpEngine::Readback(const WarpJob& job)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+    ReadTexture(TargetTexture, job.target);
+}
+
+GpuImage GlWarpEngine::UploadImage(const ImageView& image)
+{
+    GpuImage resident;
+    if (PlaneCount(image.format) != 1 || !IsSupportedSource(image.format) || !IsSupportedEncoding(image, false) ||
+        image.bayer != BayerPattern::None || !IsSupportedLayout(image))
+        return resident;
+
+    TRACE_SCOPE("GL upload");
+    GPU_TRACE_SCOPE("upload");
+    resident = imagePool.Acquire(image.format, image.width, image.height, image.encoding);
+    const PlaneFormat pf = TexturePlaneFormat(image.format, 0, image.encoding);
+    glBindTexture(GL_TEXTURE_2D, resident.Texture());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image.rowLengths[0]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, pf.format, pf.type, image.planes[0]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    return resident;
+}
+
+// Block-compressed sources sample like RGBA8 or R8 images, so a static
+// source compressed once can be warped many times at a fraction of the
+// memory and fetch bandwidth.
+GpuImage GlWarpEngine::UploadImage(const CompressedImage& image)
+{
+    GpuImage resident;
+    if (image.blocks.size() != CompressedSize(image.format, image.width, image.height))
+        return resident;
+
+    TRACE_SCOPE("GL upload");
+    GPU_TRACE_SCOPE("compressed upload");
+    resident = imagePool.AcquireCompressed(image.format, image.width, image.height);
+    glBindTexture(GL_TEXTURE_2D, resident.Texture());
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, CompressedTextureFormat(image.format),
+        GLsizei(image.blocks.size()), image.blocks.data());
+    return resident;
+}
+
+GpuImage GlWarpEngine::Warp(const WarpJob& job, const GpuImage& source)
+{
+    GpuImage target;
+    if (!source || !job.mesh || !IsSupportedTarget(job.target.format) || !IsSupportedEncoding(job.target, true))
+        return target;
+
+    WarpJob resident = job;
+    resident.source = MakeImageView(source.Format(), source.Width(), source.Height(), nullptr);
+    target = imagePool.Acquire(job.target.format, job.target.width, job.target.height, job.target.encoding);
+
+    TRACE_SCOPE("GL resident warp");
+    glBindVertexArray(Vao);
+    UploadMesh(*job.mesh);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source.Texture());
+    glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.Texture(), 0);
+    Draw(resident);
+    return target;
+}
+
+bool GlWarpEngine::ReadImage(const GpuImage& image, const ImageView& target)
+{
+    if (!image || image.Compressed() || !IsSupportedTarget(image.Format()) || target.format != image.Format() ||
+        target.width != image.Width() || target.height != image.Height() || !IsSupportedLayout(target))
+        return false;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, image.Texture(), 0);
+    ReadTexture(image.Texture(), target);
+    return true;
+}
+
+bool GlWarpEngine::SamplePoints(const WarpJob& job, const float* coordinates, size_t count, float* values)
+{
+    if (!IsSupportedSource(job.source.format) || !IsSupportedEncoding(job.source, false) || !IsSupportedMosaic(job.source) ||
+        !IsSupportedLayout(job.source) || (IsYuv(job.source.format) && ManualFiltering(job)))
+        return false;
+    if (count == 0)
+        return true;
+
+    TRACE_SCOPE("GL point sampling");
+    UploadSource(job.source);
+    return DispatchPoints(job, Kernel::Points, coordinates, count, values);
+}
+
+bool GlWarpEngine::SamplePoints(const WarpJob& job, const GpuImage& source, const float* coordinates, size_t count, float* values)
+{
+    if (!source)
+        return false;
+    if (count == 0)
+        return true;
+
+    TRACE_SCOPE("GL point sampling");
+    WarpJob resident = job;
+    resident.source = MakeImageView(source.Format(), source.Width(), source.Height(), nullptr);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source.Texture());
+    return DispatchPoints(resident, Kernel::Points, coordinates, count, values);
+}
+
+// Samples the planes bound to units 0 to 2; gradient kernels write three
+// values per point.
+bool GlWarpEngine::DispatchPoints(const WarpJob& job, Kernel kernel, const float* coordinates, size_t count, float* values)
+{
+    // Guaranteed minimum of GL_MAX_COMPUTE_WORK_GROUP_COUNT
+    const size_t MaxGroups = 65535;
+    const size_t groups = (count + 63) / 64;
+    const size_t valueBytes = count * (kernel == Kernel::Gradients ? 12 : 4) * sizeof(float);
+    {
+        GPU_TRACE_SCOPE("point sampling");
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, PointBuffer);
+        if (count > pointCapacity) {
+            glBufferData(GL_SHADER_STORAGE_BUFFER, count * 2 * sizeof(float), coordinates, GL_STREAM_DRAW);
+            pointCapacity = count;
+        } else {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * 2 * sizeof(float), coordinates);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ValueBuffer);
+        if (valueBytes > valueCapacity) {
+            glBufferData(GL_SHADER_STORAGE_BUFFER, valueBytes, nullptr, GL_STREAM_READ);
+            valueCapacity = valueBytes;
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, PointBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ValueBuffer);
+
+        GLuint ProgramID = Program(job, kernel);
+        glUseProgram(ProgramID);
+        PrepareSampling(job, ProgramID);
+        glUniform1ui(glGetUniformLocation(ProgramID, "Count"), GLuint(count));
+        const GLint offset = glGetUniformLocation(ProgramID, "Offset");
+        for (size_t first = 0; first < groups; first += MaxGroups) {
+            glUniform1ui(offset, GLuint(first * 64));
+            glDispatchCompute(GLuint(min(groups - first, MaxGroups)), 1, 1);
+        }
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+
+    {
+        GPU_TRACE_SCOPE("point readback");
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ValueBuffer);
+        const void* mapped = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, valueBytes, GL_MAP_READ_BIT);
+        if (mapped)
+            memcpy(values, mapped, valueBytes);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        if (!mapped)
+            return false;
+    }
+
+    if (TraceEnabled())
+        TraceCollectGpu();
+    return true;
+}
+
+static bool HasGradients(const WarpJob& job)
+{
+    return !IsYuv(job.source.format) && (job.filter == Filter::Linear || job.filter == Filter::Cubic);
+}
+
+bool GlWarpEngine::SampleGradients(const WarpJob& job, const float* coordinates, size_t count, float* samples)
+{
+    if (!IsSupportedSource(job.source.format) || !IsSupportedEncoding(job.source, false) || !IsSupportedMosaic(job.source) ||
+        !IsSupportedLayout(job.source) || !HasGradients(job))
+        return false;
+    if (count == 0)
+        return true;
+
+    TRACE_SCOPE("GL gradient sampling");
+    UploadSource(job.source);
+    return DispatchPoints(job, Kernel::Gradients, coordinates, count, samples);
+}
+
+// One pass over the template: the partial sums of every workgroup are added
+// up by the reducer, so 29 floats come back instead of per-pixel values.
+bool GlWarpEngine::AlignStep(const WarpJob& job, const GpuImage& templ, const float affine[6], double terms[29])
+{
+    const GLuint groups = GLuint((size_t(templ.Width()) * templ.Height() + 63) / 64);
+    float sums[29];
+    {
+        GPU_TRACE_SCOPE("align step");
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, AlignPartials);
+        if (groups > alignGroups) {
+            glBufferData(GL_SHADER_STORAGE_BUFFER, size_t(groups) * 29 * sizeof(float), nullptr, GL_DYNAMIC_COPY);
+            alignGroups = groups;
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, AlignPartials);
+
+        GLuint ProgramID = Program(job, Kernel::Align);
+        glUseProgram(ProgramID);
+        PrepareSampling(job, ProgramID);
+        glUniform1fv(glGetUniformLocation(ProgramID, "Affine"), 6, affine);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, templ.Texture());
+        glActiveTexture(GL_TEXTURE0);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        if (!reducer.SumRows(AlignPartials, groups, 29, sums))
+            return false;
+    }
+    for (int k = 0; k < 29; ++k)
+        terms[k] = sums[k];
+    return true;
+}
+
+// Solves the 6x6 normal equations, given as their upper triangle and right
+// hand side, by Gaussian elimination with partial pivoting.
+static bool SolveNormalEquations(const double terms[27], double delta[6])
+{
+    double a[6][7];
+    int k = 0;
+    for (int i = 0; i < 6; ++i)
+        for (int j = i; j < 6; ++j)
+            a[i][j] = a[j][i] = terms[k++];
+    for (int i = 0; i < 6; ++i)
+        a[i][6] = terms[21 + i];
+
+    for (int col = 0; col < 6; ++col) {
+        int pivot = col;
+        for (int row = col + 1; row < 6; ++row)
+            if (fabs(a[row][col]) > fabs(a[pivot][col]))
+                pivot = row;
+        if (fabs(a[pivot][col]) < 1e-12)
+            return false;
+        for (int j = 0; j < 7; ++j)
+            swap(a[col][j], a[pivot][j]);
+        for (int row = col + 1; row < 6; ++row) {
+            const double factor = a[row][col] / a[col][col];
+            for (int j = col; j < 7; ++j)
+                a[row][j] -= factor * a[col][j];
+        }
+    }
+    for (int i = 5; i >= 0; --i) {
+        double sum = a[i][6];
+        for (int j = i + 1; j < 6; ++j)
+            sum -= a[i][j] * delta[j];
+        delta[i] = sum / a[i][i];
+    }
+    return true;
+}
+
+bool GlWarpEngine::AlignAffine(const WarpJob& job, const ImageView& templ, int iterations, float affine[6], float* rmsError)
+{
+    // One dispatch covers at most 65535 workgroups of 64 pixels
+    if (!IsSupportedSource(job.source.format) || !IsSupportedEncoding(job.source, false) || !IsSupportedMosaic(job.source) ||
+        !IsSupportedLayout(job.source) || !HasGradients(job) || templ.format != PixelFormat::RGBA32F ||
+        size_t(templ.width) * templ.height > size_t(65535) * 64)
+        return false;
+
+    TRACE_SCOPE("GL affine alignment");
+    GpuImage resident = UploadImage(templ);
+    UploadSource(job.source);
+
+    double terms[29];
+    for (int i = 0; i < iterations; ++i) {
+        if (!AlignStep(job, resident, affine, terms))
+            return false;
+        double delta[6];
+        if (terms[28] == 0 || !SolveNormalEquations(terms, delta))
+            break;
+        double largest = 0;
+        for (int k = 0; k < 6; ++k) {
+            affine[k] -= float(delta[k]);
+            largest = max(largest, fabs(delta[k]));
+        }
+        if (largest < 1e-6)
+            break;
+    }
+
+    if (rmsError) {
+        if (!AlignStep(job, resident, affine, terms))
+            return false;
+        *rmsError = terms[28] > 0 ? float(sqrt(terms[27] / (terms[28] * 3))) : 0;
+    }
+    if (TraceEnabled())
+        TraceCollectGpu();
+    return true;
+}
+
+bool GlWarpEngine::CompareTarget(const GpuImage& reference, float threshold, ImageDifference& difference)
+{
+    if (!reference || reference.Format() == PixelFormat::R16UI ||
+        reference.Width() != targetWidth || reference.Height() != targetHeight)
+        return false;
+    return reducer.Compare(TargetTexture, reference.Texture(), targetWidth, targetHeight, threshold, difference);
+}
+
+bool GlWarpEngine::Compare(const GpuImage& image, const GpuImage& reference, float threshold, ImageDifference& difference)
+{
+    if (!image || !reference || image.Format() == PixelFormat::R16UI || reference.Format() == PixelFormat::R16UI ||
+        image.Width() != reference.Width() || image.Height() != reference.Height())
+        return false;
+    return reducer.Compare(image.Texture(), reference.Texture(), image.Width(), image.Height(), threshold, difference);
+}
+
+bool GlWarpEngine::TargetHistogram(int channel, int bins, float low, float high, vector<unsigned>& counts)
+{
+    return reducer.Histogram(TargetTexture, targetWidth, targetHeight, channel, bins, low, high, counts);
+}
+
+bool GlWarpEngine::Run(const WarpJob& job)
+{
+    if (!Upload(job))
+        return false;
+    Draw(job);
+    Readback(job);
+    return true;
+}
@@ -0,0 +1,156 @@
+#ifndef GL_WARP_H
+#define GL_WARP_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+#include "gl_image.h"
+#include "gl_reduce.h"
+#include "warp.h"
+
+// Runs warp jobs on the current GL ES 3.1 context. GL objects are created
+// once and reused across jobs; source and target storage is only
+// reallocated when the image size or format changes.
+//
+// Narrow targets are quantized on the GPU so less data crosses the bus:
+// RGBA8 and RGBA16F render and read back directly, and R8 targets are
+// rendered to an R8 texture and then packed four pixels per RGBA8 texel,
+// since GLES only guarantees RGBA readback.
+//
+// Srgb sources and RGBA8 targets use sRGB textures: the texture unit
+// linearizes before filtering and the framebuffer encodes on write, so
+// gamma-correct resampling costs the same as plain RGBA8.
+//
+// Sources and targets may be regions of larger host frames: rows are
+// transferred with GL_UNPACK_ROW_LENGTH and GL_PACK_ROW_LENGTH and the
+// region's offset is in its plane pointers, so neither side is repacked.
+//
+// Bayer mosaics are demosaiced inside the filter, texel by texel, so raw
+// frames upload at one sample per pixel and resample in a single pass.
+class GlWarpEngine : public WarpEngine
+{
+public:
+    GlWarpEngine();
+    ~GlWarpEngine();
+
+    bool Run(const WarpJob& job) override;
+    const char* Name() const override { return "GL"; }
+
+    // The steps of Run(), for callers that draw one upload several times.
+    // Draw() and Readback() expect the job last passed to Upload(), with
+    // only the filter, sampling mode and dither allowed to differ.
+    bool Upload(const WarpJob& job);
+    void Draw(const WarpJob& job);
+    void Readback(const WarpJob& job);
+
+    // Resident images: results stay in pooled textures and feed the next
+    // step directly, so a chain of warps makes one upload and one readback.
+    // Warp() takes formats and sizes from job.target and ignores job.source
+    // and all planes; it returns an empty image if the job is not
+    // supported. These calls replace the state Upload() left behind, so
+    // call Upload() again before Draw().
+    GpuImage UploadImage(const ImageView& image);
+    GpuImage UploadImage(const CompressedImage& image);
+    GpuImage Warp(const WarpJob& job, const GpuImage& source);
+    bool ReadImage(const GpuImage& image, const ImageView& target);
+
+    GlImagePool& ImagePool() { return imagePool; }
+
+    // Evaluates job.source with job.filter and job.sampling at count
+    // normalized coordinates, given as (u, v) pairs, and writes count RGBA
+    // values, without rendering a target. Runs a compute shader over the
+    // list; job.target and job.mesh are ignored. Replaces the state Upload()
+    // left behind like the resident calls.
+    bool SamplePoints(const WarpJob& job, const float* coordinates, size_t count, float* values);
+
+    // The same on a resident image, e.g. to sample one frame repeatedly
+    // without uploading it again; job.source is ignored as well.
+    bool SamplePoints(const WarpJob& job, const GpuImage& source, const float* coordinates, size_t count, float* values);
+
+    // As SamplePoints(), but each point gets three RGBA values: the sample
+    // and its derivatives along u and v, per source texel, from the same
+    // taps. Analytic derivatives of the filter kernel, so Linear and Cubic
+    // only; the sampling mode is always manual.
+    bool SampleGradients(const WarpJob& job, const float* coordinates, size_t count, float* samples);
+
+    // Refines affine, in MakeAffineMesh() form, so that warping job.source
+    // with it matches templ, by Gauss-Newton on the RGB difference. Source
+    // and template stay on the GPU; each iteration is one compute pass that
+    // accumulates the 6x6 normal equations per workgroup, and only their 29
+    // summed terms are read back. Stops early once the update is negligible.
+    // templ must be RGBA32F; job.filter must be Linear or Cubic. rmsError,
+    // if given, receives the RMS difference at the final parameters.
+    bool AlignAffine(const WarpJob& job, const ImageView& templ, int iterations, float affine[6], float* rmsError = nullptr);
+
+    // GPU statistics of the target last drawn by Draw() or Run() against a
+    // resident reference of the same size, so a frame can be validated
+    // without reading it back. Integer formats are not supported.
+    bool CompareTarget(const GpuImage& reference, float threshold, ImageDifference& difference);
+    bool Compare(const GpuImage& image, const GpuImage& reference, float threshold, ImageDifference& difference);
+
+    // Histogram of one channel of the last drawn target; see
+    // GlReducer::Histogram().
+    bool TargetHistogram(int channel, int bins, float low, float high, std::vector<unsigned>& counts);
+
+    GlReducer& Reducer() { return reducer; }
+
+private:
+    enum class Kernel { Warp, Points, Gradients, Align };
+
+    GLuint Program(const WarpJob& job, Kernel kernel = Kernel::Warp);
+    void PrepareSampling(const WarpJob& job, GLuint ProgramID);
+    bool DispatchPoints(const WarpJob& job, Kernel kernel, const float* coordinates, size_t count, float* values);
+    bool AlignStep(const WarpJob& job, const GpuImage& templ, const float affine[6], double terms[29]);
+    void UploadMesh(const WarpMesh& mesh);
+    void UploadSource(const ImageView& source);
+    void PrepareTarget(const ImageView& target);
+    void PackRows(GLuint texture, int width, int height);
+    void ReadTexture(GLuint texture, const ImageView& target);
+
+    std::map<std::string, GLuint> programs;
+    GlImagePool imagePool;
+
+    GLuint Vao = 0;
+    GLuint SourceGridBuffer = 0;
+    GLuint TargetGridBuffer = 0;
+    GLuint IndexVertices = 0;
+    GLsizei indexCount = 0;
+
+    GLuint SourceTextures[3] = {};
+    PixelFormat sourceFormat = PixelFormat::RGBA32F;
+    ColorEncoding sourceEncoding = ColorEncoding::Linear;
+    int sourceWidth = 0;
+    int sourceHeight = 0;
+
+    GLuint TargetTexture = 0;
+    GLuint Fbo = 0;
+    PixelFormat targetFormat = PixelFormat::RGBA32F;
+    ColorEncoding targetEncoding = ColorEncoding::Linear;
+    int targetWidth = 0;
+    int targetHeight = 0;
+
+    // R8 targets: four pixels per texel, padded to whole texels
+    GLuint PackProgram = 0;
+    GLuint PackedTexture = 0;
+    GLuint PackFbo = 0;
+    GLuint PackVao = 0;
+    int packedWidth = 0;
+    int packedHeight = 0;
+    std::vector<unsigned char> readbackRows;
+
+    // Point sampling: coordinates in, RGBA values out, grown as needed
+    GLuint PointBuffer = 0;
+    GLuint ValueBuffer = 0;
+    size_t pointCapacity = 0;
+    size_t valueCapacity = 0;   // bytes
+
+    // Alignment: one row of terms per workgroup
+    GLuint AlignPartials = 0;
+    GLuint alignGroups = 0;
+    GlReducer reducer;
+    std::vector<float> readbackFloats;
+};
+
+#endif
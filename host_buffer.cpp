@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "host_buffer.h"
+
+using namespace std;
+
+HostBuffer::HostBuffer(HostBuffer&& other) noexcept
+    : arena(other.arena), data(other.data), size(other.size), capacity(other.capacity)
+{
+    other.arena = nullptr;
+    other.data = nullptr;
+    other.size = other.capacity = 0;
+}
+
+HostBuffer& HostBuffer::operator=(HostBuffer&& other) noexcept
+{
+    if (this != &other) {
+        Release();
+        swap(arena, other.arena);
+        swap(data, other.data);
+        swap(size, other.size);
+        swap(capacity, other.capacity);
+    }
+    return *this;
+}
+
+HostBuffer::~HostBuffer()
+{
+    Release();
+}
+
+void HostBuffer::Release()
+{
+    if (arena && data)
+        arena->Recycle(data, capacity);
+    arena = nullptr;
+    data = nullptr;
+    size = capacity = 0;
+}
+
+// Small blocks round up to a power of two and large ones to whole huge
+// pages, so blocks freed by one frame fit the same requests of the next.
+static size_t BlockCapacity(size_t bytes)
+{
+    if (bytes >= HostArena::LargeBlock)
+        return (bytes + HostArena::LargeBlock - 1) / HostArena::LargeBlock * HostArena::LargeBlock;
+    size_t capacity = HostArena::Alignment;
+    while (capacity < bytes)
+        capacity *= 2;
+    return capacity;
+}
+
+HostArena::HostArena(HugePages hugePages, size_t cacheLimit)
+    : hugePages(hugePages), cacheLimit(cacheLimit)
+{
+}
+
+HostArena::~HostArena()
+{
+    Trim();
+}
+
+HostBuffer HostArena::Acquire(size_t bytes)
+{
+    HostBuffer buffer;
+    if (bytes == 0)
+        return buffer;
+
+    const size_t capacity = BlockCapacity(bytes);
+    {
+        lock_guard<std::mutex> lock(mutex);
+        auto block = cached.lower_bound(capacity);
+        if (block != cached.end() && block->first <= capacity * 2) {
+            buffer.data = block->second;
+            buffer.capacity = block->first;
+            stats.cachedBytes -= block->first;
+            ++stats.reuses;
+            cached.erase(block);
+        }
+    }
+    if (!buffer.data) {
+        buffer.data = Allocate(capacity);
+        if (!buffer.data)
+            return buffer;
+        buffer.capacity = capacity;
+    }
+    buffer.arena = this;
+    buffer.size = bytes;
+    return buffer;
+}
+
+void* HostArena::Allocate(size_t capacity)
+{
+    if (capacity < LargeBlock) {
+        void* data = aligned_alloc(Alignment, capacity);
+        if (data) {
+            lock_guard<std::mutex> lock(mutex);
+            ++stats.allocations;
+        }
+        return data;
+    }
+
+    if (hugePages == HugePages::Reserved) {
+        void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (data != MAP_FAILED) {
+            lock_guard<std::mutex> lock(mutex);
+            ++stats.allocations;
+            stats.hugePageBytes += capacity;
+            return data;
+        }
+    }
+
+    // Over-map and trim to a huge page boundary, which transparent huge
+    // pages need
+    const size_t mapped = capacity + LargeBlock;
+    uint8_t* region = (uint8_t*)mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        return nullptr;
+    uint8_t* data = (uint8_t*)(((uintptr_t)region + LargeBlock - 1) & ~(uintptr_t)(LargeBlock - 1));
+    if (data > region)
+        munmap(region, data - region);
+    if (region + mapped > data + capacity)
+        munmap(data + capacity, region + mapped - (data + capacity));
+    if (hugePages != HugePages::Off)
+        madvise(data, capacity, MADV_HUGEPAGE);
+
+    // Take the page faults now rather than on the first frame
+    const size_t page = size_t(sysconf(_SC_PAGESIZE));
+    for (size_t offset = 0; offset < capacity; offset += page)
+        ((volatile uint8_t*)data)[offset] = 0;
+
+    lock_guard<std::mutex> lock(mutex);
+    ++stats.allocations;
+    return data;
+}
+
+void HostArena::Free(void* data, size_t capacity)
+{
+    if (capacity < LargeBlock)
+        free(data);
+    else
+        munmap(data, capacity);
+}
+
+void HostArena::Recycle(void* data, size_t capacity)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (stats.cachedBytes + capacity <= cacheLimit) {
+            cached.emplace(capacity, data);
+            stats.cachedBytes += capacity;
+            return;
+        }
+    }
+    Free(data, capacity);
+}
+
+void HostArena::Trim()
+{
+    multimap<size_t, void*> blocks;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        blocks.swap(cached);
+        stats.cachedBytes = 0;
+    }
+    for (auto& block : blocks)
+        Free(block.second, block.first);
+}
+
+HostArenaStats HostArena::Stats() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+HostArena& DefaultHostArena()
+{
+    static HostArena arena;
+    return arena;
+}
+
+HostImage AllocateImage(PixelFormat format, int width, int height, HostArena& arena)
+{
+    size_t offsets[3] = {};
+    size_t bytes = 0;
+    for (int plane = 0; plane < PlaneCount(format); ++plane) {
+        offsets[plane] = bytes;
+        bytes += (PlaneBytes(format, plane, width, height) + HostArena::Alignment - 1) / HostArena::Alignment * HostArena::Alignment;
+    }
+
+    HostImage image;
+    image.buffer = arena.Acquire(bytes);
+    image.view = MakeImageView(format, width, height, nullptr);
+    if (image.buffer) {
+        for (int plane = 0; plane < PlaneCount(format); ++plane)
+            image.view.planes[plane] = image.buffer.As<uint8_t>() + offsets[plane];
+    }
+    return image;
+}
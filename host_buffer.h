@@ -0,0 +1,107 @@
+#ifndef HOST_BUFFER_H
+#define HOST_BUFFER_H
+
+#include <stddef.h>
+
+#include <map>
+#include <mutex>
+
+#include "image.h"
+
+class HostArena;
+
+// Block of host memory from a HostArena, aligned to at least 64 bytes and
+// handed back to the arena for reuse when destroyed.
+class HostBuffer
+{
+public:
+    HostBuffer() = default;
+    HostBuffer(HostBuffer&& other) noexcept;
+    HostBuffer& operator=(HostBuffer&& other) noexcept;
+    ~HostBuffer();
+
+    HostBuffer(const HostBuffer&) = delete;
+    HostBuffer& operator=(const HostBuffer&) = delete;
+
+    void* Data() const { return data; }
+    size_t Size() const { return size; }
+    template <typename T> T* As() const { return static_cast<T*>(data); }
+    explicit operator bool() const { return data != nullptr; }
+
+    void Release();
+
+private:
+    friend class HostArena;
+
+    HostArena* arena = nullptr;
+    void* data = nullptr;
+    size_t size = 0;
+    size_t capacity = 0;
+};
+
+struct HostArenaStats
+{
+    size_t allocations = 0;     // blocks obtained from the system
+    size_t reuses = 0;          // requests served from recycled blocks
+    size_t hugePageBytes = 0;   // allocated with MAP_HUGETLB
+    size_t cachedBytes = 0;     // held for reuse right now
+};
+
+// Recycles host image buffers across jobs so frames stop paying for fresh
+// allocations. Blocks of LargeBlock bytes and up are mapped directly, page
+// aligned and pre-faulted, optionally backed by huge pages; smaller ones
+// come from the heap with 64-byte alignment. Returned blocks are kept, up to
+// cacheLimit bytes, and reused for any request they fit at most twice over.
+// Thread-safe.
+class HostArena
+{
+public:
+    // Advise asks for transparent huge pages with madvise(); Reserved takes
+    // them from the hugetlbfs pool and falls back to Advise when it is empty.
+    enum class HugePages { Off, Advise, Reserved };
+
+    static const size_t Alignment = 64;
+    static const size_t LargeBlock = size_t(2) << 20;
+
+    explicit HostArena(HugePages hugePages = HugePages::Advise, size_t cacheLimit = size_t(1) << 30);
+    ~HostArena();
+
+    HostArena(const HostArena&) = delete;
+    HostArena& operator=(const HostArena&) = delete;
+
+    HostBuffer Acquire(size_t bytes);
+
+    // Frees every cached block.
+    void Trim();
+
+    HostArenaStats Stats() const;
+
+private:
+    friend class HostBuffer;
+
+    void* Allocate(size_t capacity);
+    void Free(void* data, size_t capacity);
+    void Recycle(void* data, size_t capacity);
+
+    const HugePages hugePages;
+    const size_t cacheLimit;
+
+    mutable std::mutex mutex;
+    std::multimap<size_t, void*> cached;
+    HostArenaStats stats;
+};
+
+// Arena shared by the demos and benchmarks.
+HostArena& DefaultHostArena();
+
+// Host image whose planes share one arena block, each plane starting on a
+// 64-byte boundary.
+struct HostImage
+{
+    HostBuffer buffer;
+    ImageView view;
+};
+
+HostImage AllocateImage(PixelFormat format, int width, int height, HostArena& arena = DefaultHostArena());
+
+#endif
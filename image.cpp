@@ -0,0 +1,271 @@
+#include <math.h>
+#include <string.h>
+
+#include "image.h"
+
+ImageView MakeImageView(PixelFormat format, int width, int height,
+    const void* plane0, const void* plane1, const void* plane2)
+{
+    ImageView view;
+    view.format = format;
+    view.width = width;
+    view.height = height;
+    view.planes[0] = const_cast<void*>(plane0);
+    view.planes[1] = const_cast<void*>(plane1);
+    view.planes[2] = const_cast<void*>(plane2);
+    return view;
+}
+
+const char* FormatName(PixelFormat format)
+{
+    switch (format) {
+    case PixelFormat::RGBA32F: return "RGBA32F";
+    case PixelFormat::NV12: return "NV12";
+    case PixelFormat::I420: return "I420";
+    case PixelFormat::R16UI: return "R16UI";
+    case PixelFormat::R32F: return "R32F";
+    case PixelFormat::R8: return "R8";
+    case PixelFormat::RG8: return "RG8";
+    case PixelFormat::RGB8: return "RGB8";
+    case PixelFormat::RGBA8: return "RGBA8";
+    case PixelFormat::RG16UI: return "RG16UI";
+    case PixelFormat::RGB16UI: return "RGB16UI";
+    case PixelFormat::RGBA16UI: return "RGBA16UI";
+    case PixelFormat::R16F: return "R16F";
+    case PixelFormat::RG16F: return "RG16F";
+    case PixelFormat::RGB16F: return "RGB16F";
+    case PixelFormat::RGBA16F: return "RGBA16F";
+    case PixelFormat::RG32F: return "RG32F";
+    case PixelFormat::RGB32F: return "RGB32F";
+    }
+    return "?";
+}
+
+int PlaneCount(PixelFormat format)
+{
+    switch (format) {
+    case PixelFormat::NV12: return 2;
+    case PixelFormat::I420: return 3;
+    default: return 1;
+    }
+}
+
+void PlaneSize(PixelFormat format, int plane, int width, int height, int& planeWidth, int& planeHeight)
+{
+    planeWidth = width;
+    planeHeight = height;
+    if (plane > 0 && (format == PixelFormat::NV12 || format == PixelFormat::I420)) {
+        planeWidth = (width + 1) / 2;
+        planeHeight = (height + 1) / 2;
+    }
+}
+
+size_t PlaneBytes(PixelFormat format, int plane, int width, int height)
+{
+    int w, h;
+    PlaneSize(format, plane, width, height, w, h);
+    switch (format) {
+    case PixelFormat::NV12: return size_t(w) * h * (plane == 0 ? 1 : 2);
+    case PixelFormat::I420: return size_t(w) * h;
+    default: return size_t(w) * h * ChannelCount(format) * SampleBytes(FormatSampleType(format));
+    }
+}
+
+int RowLength(const ImageView& image, int plane)
+{
+    if (image.rowLengths[plane] > 0)
+        return image.rowLengths[plane];
+    int w, h;
+    PlaneSize(image.format, plane, image.width, image.height, w, h);
+    return w;
+}
+
+bool IsPacked(const ImageView& image)
+{
+    for (int plane = 0; plane < PlaneCount(image.format); ++plane) {
+        int w, h;
+        PlaneSize(image.format, plane, image.width, image.height, w, h);
+        if (RowLength(image, plane) != w)
+            return false;
+    }
+    return true;
+}
+
+ImageView SubImage(const ImageView& image, int x, int y, int width, int height)
+{
+    ImageView region = image;
+    region.width = width;
+    region.height = height;
+    for (int plane = 0; plane < PlaneCount(image.format); ++plane) {
+        int px, py;
+        PlaneSize(image.format, plane, x, y, px, py);
+        const size_t pixelBytes = PlaneBytes(image.format, plane, 1, 1);
+        region.rowLengths[plane] = RowLength(image, plane);
+        region.planes[plane] = (char*)image.planes[plane] + (size_t(py) * region.rowLengths[plane] + px) * pixelBytes;
+    }
+    return region;
+}
+
+SampleType FormatSampleType(PixelFormat format)
+{
+    switch (format) {
+    case PixelFormat::NV12:
+    case PixelFormat::I420:
+    case PixelFormat::R8:
+    case PixelFormat::RG8:
+    case PixelFormat::RGB8:
+    case PixelFormat::RGBA8:
+        return SampleType::U8;
+    case PixelFormat::R16UI:
+    case PixelFormat::RG16UI:
+    case PixelFormat::RGB16UI:
+    case PixelFormat::RGBA16UI:
+        return SampleType::U16;
+    case PixelFormat::R16F:
+    case PixelFormat::RG16F:
+    case PixelFormat::RGB16F:
+    case PixelFormat::RGBA16F:
+        return SampleType::F16;
+    default:
+        return SampleType::F32;
+    }
+}
+
+int ChannelCount(PixelFormat format)
+{
+    switch (format) {
+    case PixelFormat::RG8:
+    case PixelFormat::RG16UI:
+    case PixelFormat::RG16F:
+    case PixelFormat::RG32F:
+        return 2;
+    case PixelFormat::RGB8:
+    case PixelFormat::RGB16UI:
+    case PixelFormat::RGB16F:
+    case PixelFormat::RGB32F:
+        return 3;
+    case PixelFormat::RGBA8:
+    case PixelFormat::RGBA16UI:
+    case PixelFormat::RGBA16F:
+    case PixelFormat::RGBA32F:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+size_t SampleBytes(SampleType type)
+{
+    switch (type) {
+    case SampleType::U8: return 1;
+    case SampleType::U16:
+    case SampleType::F16: return 2;
+    default: return 4;
+    }
+}
+
+float HalfToFloat(unsigned short half)
+{
+    const unsigned sign = (half & 0x8000u) << 16;
+    const unsigned exponent = (half >> 10) & 0x1f;
+    unsigned mantissa = half & 0x3ffu;
+    unsigned bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else if (mantissa == 0) {
+        bits = sign;
+    }
+    else {
+        // Subnormal: normalize the mantissa
+        unsigned shift = 0;
+        while (!(mantissa & 0x400u)) {
+            mantissa <<= 1;
+            ++shift;
+        }
+        bits = sign | ((113 - shift) << 23) | ((mantissa & 0x3ffu) << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+unsigned short FloatToHalf(float value)
+{
+    unsigned bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const unsigned sign = (bits >> 16) & 0x8000u;
+    const unsigned exponent = (bits >> 23) & 0xff;
+    const unsigned mantissa = bits & 0x7fffffu;
+    if (exponent == 0xff)
+        return (unsigned short)(sign | 0x7c00u | (mantissa ? 0x200u | (mantissa >> 13) : 0));
+
+    // Rounds to nearest even; a carry out of the mantissa correctly bumps
+    // the exponent, up to infinity
+    const int halfExponent = int(exponent) - 112;
+    if (halfExponent >= 0x1f)
+        return (unsigned short)(sign | 0x7c00u);
+    unsigned half, rest, halfway;
+    if (halfExponent > 0) {
+        half = (unsigned(halfExponent) << 10) | (mantissa >> 13);
+        rest = mantissa & 0x1fffu;
+        halfway = 0x1000u;
+    }
+    else if (halfExponent >= -10) {
+        // Subnormal
+        const unsigned shift = unsigned(14 - halfExponent);
+        const unsigned full = mantissa | 0x800000u;
+        half = full >> shift;
+        rest = full & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else {
+        return (unsigned short)sign;
+    }
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        ++half;
+    return (unsigned short)(sign | half);
+}
+
+float SrgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float LinearToSrgb(float value)
+{
+    if (value <= 0)
+        return 0;
+    if (value >= 1)
+        return 1;
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1 / 2.4f) - 0.055f;
+}
+
+void YuvToRgbCoefficients(YuvMatrix matrix, YuvRange range, float coefficients[9], float offset[3])
+{
+    const float Kr = matrix == YuvMatrix::BT709 ? 0.2126f : 0.299f;
+    const float Kb = matrix == YuvMatrix::BT709 ? 0.0722f : 0.114f;
+    const float Kg = 1.0f - Kr - Kb;
+
+    // Limited range stretches [16, 235] luma and [16, 240] chroma to full scale
+    const float yScale = range == YuvRange::Limited ? 255.0f / 219.0f : 1.0f;
+    const float cScale = range == YuvRange::Limited ? 255.0f / 224.0f : 1.0f;
+
+    const float m[9] = {
+        1, 0, 2 * (1 - Kr),
+        1, -2 * (1 - Kb) * Kb / Kg, -2 * (1 - Kr) * Kr / Kg,
+        1, 2 * (1 - Kb), 0
+    };
+    for (int row = 0; row < 3; ++row) {
+        coefficients[row * 3 + 0] = m[row * 3 + 0] * yScale;
+        coefficients[row * 3 + 1] = m[row * 3 + 1] * cScale;
+        coefficients[row * 3 + 2] = m[row * 3 + 2] * cScale;
+    }
+
+    offset[0] = range == YuvRange::Limited ? 16.0f / 255.0f : 0.0f;
+    offset[1] = 128.0f / 255.0f;
+    offset[2] = 128.0f / 255.0f;
+}
@@ -0,0 +1,98 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+
+// Host-side pixel layouts understood by the warp engines.
+enum class PixelFormat
+{
+    RGBA32F,    // interleaved float RGBA
+    NV12,       // 8-bit Y plane, then interleaved 8-bit UV plane at half resolution
+    I420,       // 8-bit Y plane, then 8-bit U and V planes at half resolution
+    R16UI,      // unsigned 16-bit single channel, e.g. 12/16-bit raw sensor data
+    R32F,       // float single channel
+
+    // Further interleaved layouts. 8-bit samples are normalized like UNORM
+    // textures, 16-bit integers stay raw; the GL engine reads no
+    // multi-channel integer layouts.
+    R8, RG8, RGB8, RGBA8,
+    RG16UI, RGB16UI, RGBA16UI,
+    R16F, RG16F, RGB16F, RGBA16F,
+    RG32F, RGB32F,
+};
+
+// Sample type and channel count of the interleaved formats, that is all but
+// NV12 and I420.
+enum class SampleType { U8, U16, F16, F32 };
+SampleType FormatSampleType(PixelFormat format);
+int ChannelCount(PixelFormat format);
+size_t SampleBytes(SampleType type);
+
+// Colorimetry of YUV sources, ignored for RGB formats.
+enum class YuvMatrix { BT601, BT709 };
+enum class YuvRange { Limited, Full };
+
+// Transfer function of 8-bit color samples. Srgb samples are linearized
+// before filtering and encoded again when written, so interpolation happens
+// in linear light; alpha is always linear. Only RGB8 and RGBA8 images can
+// be Srgb.
+enum class ColorEncoding { Linear, Srgb };
+
+// Color filter layout of a raw sensor mosaic, named after the top-left 2x2
+// quad. Mosaics are R8 or R16UI images with one color sample per pixel.
+enum class BayerPattern { None, RGGB, BGGR, GRBG, GBRG };
+
+// Interpolation filling in the two missing colors of each mosaic pixel.
+// Bilinear averages the nearest samples of each color; Malvar is the
+// Malvar-He-Cutler 5x5 filter, bilinear corrected by the Laplacian of the
+// pixel's own color.
+enum class Demosaic { Bilinear, Malvar };
+
+// Non-owning view of a host image. Rows of each plane are rowLengths[plane]
+// pixels apart, or tightly packed where that is 0, so a view can address a
+// region of a larger frame; see SubImage().
+struct ImageView
+{
+    PixelFormat format = PixelFormat::RGBA32F;
+    int width = 0;
+    int height = 0;
+    void* planes[3] = {};
+    YuvMatrix matrix = YuvMatrix::BT601;
+    YuvRange range = YuvRange::Limited;
+    ColorEncoding encoding = ColorEncoding::Linear;
+    BayerPattern bayer = BayerPattern::None;
+    int rowLengths[3] = {};
+};
+
+ImageView MakeImageView(PixelFormat format, int width, int height,
+    const void* plane0, const void* plane1 = nullptr, const void* plane2 = nullptr);
+
+const char* FormatName(PixelFormat format);
+
+int PlaneCount(PixelFormat format);
+void PlaneSize(PixelFormat format, int plane, int width, int height, int& planeWidth, int& planeHeight);
+size_t PlaneBytes(PixelFormat format, int plane, int width, int height);
+
+// Pixels from one row of the plane to the next; IsPacked() tells whether
+// every plane is tightly packed.
+int RowLength(const ImageView& image, int plane);
+bool IsPacked(const ImageView& image);
+
+// View of the width x height region at (x, y) of image, sharing its memory.
+// Regions of NV12 and I420 images start at even coordinates.
+ImageView SubImage(const ImageView& image, int x, int y, int width, int height);
+
+// IEEE 754 binary16 to float, including subnormals, infinities and NaN,
+// and back with rounding to nearest even.
+float HalfToFloat(unsigned short half);
+unsigned short FloatToHalf(float value);
+
+// The sRGB transfer function on normalized values, both ways.
+float SrgbToLinear(float value);
+float LinearToSrgb(float value);
+
+// Row-major 3x3 matrix and offset such that rgb = matrix * (yuv - offset), with
+// yuv normalized to [0, 1] the way an 8-bit UNORM texture returns it.
+void YuvToRgbCoefficients(YuvMatrix matrix, YuvRange range, float coefficients[9], float offset[3]);
+
+#endif
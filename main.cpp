@@ -1,17 +1,32 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <math.h>
 #include <gbm.h>
 
+#include <algorithm>
 #include <vector>
 #include <string>
 
 #include "glad/glad.h"
 #include "glad/glad_egl.h"
+#include "gl_warp.h"
+#include "gl_pyramid.h"
+#include "etc2.h"
+#include "demosaic.h"
+#include "raw_image.h"
+#include "warp_chain.h"
+#include "cpu_warp.h"
+#include "engine_selector.h"
+#include "benchmark.h"
+#include "trace.h"
 
 #ifdef WITH_PNG
-#include "lodepng.h"
+#include "png_dump.h"
+#include "tiled_image.h"
 #endif
 
 using namespace std;
@@ -19,121 +34,1478 @@ using namespace std;
 static const int Width = 3;
 static const int Height = 3;
 
-static const std::string sVertex = R"delim(
-#version 310 es
+static const int YuvWidth = 4;
+static const int YuvHeight = 4;
 
-in vec2 TextureCoord;
-in vec2 ClipSpaceCoord;
+#ifdef WITH_PNG
+// Hands a copy of an RGBA32F image to the background writer, which saves
+// it as 8-bit PNG; never waits on the writer.
+static void DumpPng(const char* path, const vector<GLfloat>& image, int width, int height)
+{
+    static PngDumper Dumper(1, 8);
+    HostBuffer copy = DefaultHostArena().Acquire(image.size() * sizeof(GLfloat));
+    memcpy(copy.Data(), image.data(), copy.Size());
+    if (!Dumper.TrySubmit(path, move(copy), width, height))
+        printf("PNG queue full, skipping %s\n", path);
+}
+#endif
+
+int MatchConfig2Visual(EGLDisplay egl_display, EGLint visual_id, EGLConfig* configs, int count) {
+
+    EGLint id;
+    for (int i = 0; i < count; ++i) {
+        if (!eglGetConfigAttrib(egl_display, configs[i], EGL_NATIVE_VISUAL_ID, &id)) continue;
+        if (id == visual_id) return i;
+    }
+    return -1;
+}
+
+static void APIENTRY funcname(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
+{
+    printf("GL CALLBACK: %s type = 0x%x, severity = 0x%x, message = %s\n",
+        (type == GL_DEBUG_TYPE_ERROR ? "** GL ERROR **" : ""),
+        type, severity, message);
+}
 
-out vec2 UV;
+// Converts a synthetic YUV 4:2:0 image on the GPU and checks it against the
+// host-side conversion of the same samples, to within half an 8-bit step.
+// Linear filtering interpolates the half-resolution chroma at each luma
+// sample, wrapping at the edges like the GL_REPEAT sampler.
+static float SampleChroma(const vector<unsigned char>& plane, int width, int height, int x, int y, Filter filter)
+{
+    if (filter == Filter::Nearest)
+        return plane[(y / 2) * width + x / 2];
 
-void main()
+    const float u = (x + 0.5f) / 2 - 0.5f;
+    const float v = (y + 0.5f) / 2 - 0.5f;
+    const int x0 = (int)floorf(u);
+    const int y0 = (int)floorf(v);
+    const float fx = u - x0;
+    const float fy = v - y0;
+    auto texel = [&](int tx, int ty) {
+        tx = (tx + width) % width;
+        ty = (ty + height) % height;
+        return float(plane[ty * width + tx]);
+    };
+    const float top = texel(x0, y0) * (1 - fx) + texel(x0 + 1, y0) * fx;
+    const float bottom = texel(x0, y0 + 1) * (1 - fx) + texel(x0 + 1, y0 + 1) * fx;
+    return top * (1 - fy) + bottom * fy;
+}
+
+static void CompareYuvConversion(WarpEngine& Engine, const WarpMesh& Mesh, PixelFormat format, YuvMatrix matrix, YuvRange range,
+    Filter filter)
 {
-    gl_Position = vec4(ClipSpaceCoord, 0, 1);
-    UV = TextureCoord;
-};
-)delim";
+    const int ChromaWidth = YuvWidth / 2;
+    const int ChromaHeight = YuvHeight / 2;
+    vector<unsigned char> luma(YuvWidth * YuvHeight);
+    vector<unsigned char> u(ChromaWidth * ChromaHeight);
+    vector<unsigned char> v(ChromaWidth * ChromaHeight);
+    for (size_t i = 0; i < luma.size(); ++i)
+        luma[i] = (unsigned char)(16 + i * 219 / (luma.size() - 1));
+    for (size_t i = 0; i < u.size(); ++i) {
+        u[i] = (unsigned char)(64 + 32 * i);
+        v[i] = (unsigned char)(192 - 32 * i);
+    }
 
-static const std::string sFragment = R"delim(
-#version 310 es
-precision highp float;
+    vector<unsigned char> chroma;
+    if (format == PixelFormat::NV12) {
+        for (size_t i = 0; i < u.size(); ++i) {
+            chroma.push_back(u[i]);
+            chroma.push_back(v[i]);
+        }
+    }
 
-in vec2 UV;
+    vector<GLfloat> targetImage(4 * YuvWidth * YuvHeight);
+    WarpJob Job;
+    if (format == PixelFormat::NV12)
+        Job.source = MakeImageView(format, YuvWidth, YuvHeight, luma.data(), chroma.data());
+    else
+        Job.source = MakeImageView(format, YuvWidth, YuvHeight, luma.data(), u.data(), v.data());
+    Job.source.matrix = matrix;
+    Job.source.range = range;
+    Job.target = MakeImageView(PixelFormat::RGBA32F, YuvWidth, YuvHeight, targetImage.data());
+    Job.mesh = &Mesh;
+    Job.filter = filter;
+    const char* name = format == PixelFormat::NV12 ? "NV12" : "I420";
+    const char* filterName = filter == Filter::Linear ? "linear" : "nearest";
+    if (!Engine.Run(Job)) {
+        printf("...%s %s is not supported by the %s engine\n", name, filterName, Engine.Name());
+        return;
+    }
 
-uniform sampler2D Texture;
+    float coefficients[9], offset[3];
+    YuvToRgbCoefficients(matrix, range, coefficients, offset);
+    float maxError = 0;
+    for (int y = 0; y < YuvHeight; ++y) {
+        for (int x = 0; x < YuvWidth; ++x) {
+            const float yuv[3] = {
+                luma[y * YuvWidth + x] / 255.0f - offset[0],
+                SampleChroma(u, ChromaWidth, ChromaHeight, x, y, filter) / 255.0f - offset[1],
+                SampleChroma(v, ChromaWidth, ChromaHeight, x, y, filter) / 255.0f - offset[2]
+            };
+            for (int channel = 0; channel < 3; ++channel) {
+                const float* row = &coefficients[channel * 3];
+                const float expected = row[0] * yuv[0] + row[1] * yuv[1] + row[2] * yuv[2];
+                const float error = fabsf(expected - targetImage[(y * YuvWidth + x) * 4 + channel]);
+                maxError = error > maxError ? error : maxError;
+            }
+        }
+    }
 
-out vec4 fragColor;
+    printf("...%s %s %s range, %s. Result is %s (max error %g)\n", name,
+        matrix == YuvMatrix::BT709 ? "BT.709" : "BT.601",
+        range == YuvRange::Full ? "full" : "limited", filterName,
+        maxError < 0.5f / 255 ? "EQUAL" : "DIFFERENT", maxError);
+}
 
-void main()
+// Maps 12-bit raw samples one-to-one through the shader-side filters, which
+// should reproduce each count exactly.
+static void CompareRawMapping(WarpEngine& Engine, const WarpMesh& Mesh)
 {
-	//vec2 texCoord = UV + vec2(1.0 / 4194304.0, 1.0 / 4194304.0);
-	vec2 texCoord = UV + vec2(0, 0);
-	fragColor = texture2D(Texture, texCoord);
-};
-)delim";
+    const vector<GLushort> rawImage({ 0, 4095, 17, 2048, 1, 4094, 100, 3000, 511 });
+    vector<GLfloat> expected;
+    for (auto sample : rawImage) {
+        expected.insert(expected.end(), { GLfloat(sample), GLfloat(sample), GLfloat(sample), 1 });
+    }
+    vector<GLfloat> targetImage(4 * Width * Height);
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::R16UI, Width, Height, rawImage.data());
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Width, Height, targetImage.data());
+    Job.mesh = &Mesh;
+
+    printf("\nOne-to-one mapping of a %dx%d 16-bit raw texture using...\n", Width, Height);
+    const char* names[] = { "......nearest neighbour", "...linear interpolation", "....cubic interpolation" };
+    const Filter filters[] = { Filter::Nearest, Filter::Linear, Filter::Cubic };
+    for (int i = 0; i < 3; ++i) {
+        Job.filter = filters[i];
+        Engine.Run(Job);
+        printf("%s. Result is %s\n", names[i], expected == targetImage ? "EQUAL" : "DIFFERENT");
+    }
+}
 
-static GLint CompileShader(const GLuint shaderID, const string& shaderCode)
+// Runs the gather kernels against their texelFetch counterparts on a rotated
+// texture; both use the same fp32 weights, so results should match exactly.
+static void CompareGatherKernels(GlWarpEngine& Engine, PixelFormat format)
 {
-    GLint Result = GL_FALSE;
+    const int Size = 64;
+    const int Channels = format == PixelFormat::R32F ? 1 : 4;
+    vector<GLfloat> sourceImage(Channels * Size * Size);
+    vector<GLfloat> fetchImage(4 * Size * Size);
+    vector<GLfloat> gatherImage(4 * Size * Size);
+    FillNoise(sourceImage, 3);
+    const WarpMesh Mesh = MakeRotationMesh(30, 0.8f);
 
-    // Compile Shader
-    char const* ShaderSourcePointer = shaderCode.c_str();
-    glShaderSource(shaderID, 1, &ShaderSourcePointer, NULL);
-    glCompileShader(shaderID);
+    WarpJob Job;
+    Job.source = MakeImageView(format, Size, Size, sourceImage.data());
+    Job.mesh = &Mesh;
 
-    // Check Shader
-    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &Result);
-    if (Result == GL_FALSE) {
-        int InfoLogLength;
-        glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-        vector<char> ShaderErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(shaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
-        printf("%s\n", &ShaderErrorMessage[0]);
+    printf("...%s", format == PixelFormat::R32F ? "R32F" : "RGBA32F");
+    const char* names[] = { "linear", "cubic", "min", "max" };
+    const Filter filters[] = { Filter::Linear, Filter::Cubic, Filter::Min, Filter::Max };
+    for (int i = 0; i < 4; ++i) {
+        Job.filter = filters[i];
+        Job.sampling = Sampling::Manual;
+        Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, fetchImage.data());
+        Engine.Run(Job);
+        Job.sampling = Sampling::Gather;
+        Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, gatherImage.data());
+        Engine.Run(Job);
+        printf(" %s %s", names[i], fetchImage == gatherImage ? "EQUAL" : "DIFFERENT");
     }
-    return Result;
+    printf("\n");
 }
 
-static GLuint CreateAndLinkProgram(const vector<GLuint> shaderIDs)
+// One-to-one mappings through every engine path; each should reproduce the
+// source exactly, except hardware linear filtering on most GPUs.
+static void RunComparisons(WarpEngine& Engine)
 {
-    GLuint ProgramID = glCreateProgram();
-    for (auto& sID : shaderIDs)
-    {
-        glAttachShader(ProgramID, sID);
+    TRACE_SCOPE("comparisons");
+    const vector<float> SourceGrid({ 0, 0, 1, 0, 0, 1, 1, 1 });
+    const vector<float> TargetGrid({ -1, -1, 1, -1, -1, 1, 1, 1 });
+    const vector<GLushort> indexBuffer({ 0, 1, 2, 3, 1, 2 });
+    const vector<GLfloat> sourceImage(
+        {
+             0, 0, 0, -1,  0, 0, 0, -1,     0, 0, 0, -1,
+             0, 0, 0, -1,  -1, -1, -1, -1,  0, 0, 0, -1,
+             0, 0, 0, -1,  0, 0, 0, -1,     0, 0, 0, -1
+        }
+    );
+    vector<GLfloat> targetImage(4 * Width * Height);
+    const WarpMesh Mesh = { SourceGrid, TargetGrid, indexBuffer };
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Width, Height, sourceImage.data());
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Width, Height, targetImage.data());
+    Job.mesh = &Mesh;
+
+#ifdef WITH_PNG
+    DumpPng("SourceTexture.png", sourceImage, Width, Height);
+#endif
+
+    Job.filter = Filter::Nearest;
+    Engine.Run(Job);
+
+#ifdef WITH_PNG
+    DumpPng("TargetTexture-Nearest.png", targetImage, Width, Height);
+#endif
+
+    printf("\nOne-to-one mapping of a %dx%d texture using...\n", Width, Height);
+    printf("......nearest neighbour. Result is %s\n", sourceImage == targetImage ? "EQUAL" : "DIFFERENT");
+
+    Job.filter = Filter::Linear;
+    Engine.Run(Job);
+
+#ifdef WITH_PNG
+    DumpPng("TargetTexture-Linear.png", targetImage, Width, Height);
+#endif
+
+    printf("...linear interpolation. Result is %s\n", sourceImage == targetImage ? "EQUAL" : "DIFFERENT");
+
+    Job.sampling = Sampling::Manual;
+    Engine.Run(Job);
+    Job.sampling = Sampling::Hardware;
+
+    printf("...linear interpolation with fp32 weights. Result is %s\n", sourceImage == targetImage ? "EQUAL" : "DIFFERENT");
+
+    printf("\nOne-to-one conversion of a %dx%d YUV 4:2:0 texture from...\n", YuvWidth, YuvHeight);
+    CompareYuvConversion(Engine, Mesh, PixelFormat::NV12, YuvMatrix::BT601, YuvRange::Limited, Filter::Nearest);
+    CompareYuvConversion(Engine, Mesh, PixelFormat::I420, YuvMatrix::BT709, YuvRange::Full, Filter::Nearest);
+    CompareYuvConversion(Engine, Mesh, PixelFormat::NV12, YuvMatrix::BT601, YuvRange::Limited, Filter::Linear);
+    CompareYuvConversion(Engine, Mesh, PixelFormat::I420, YuvMatrix::BT709, YuvRange::Full, Filter::Linear);
+
+    CompareRawMapping(Engine, Mesh);
+}
+
+// Runs the same rotation through two engines with fp32 weights and reports
+// the largest difference per filter.
+static void CompareEngines(WarpEngine& Reference, WarpEngine& Engine)
+{
+    const int Size = 64;
+    vector<GLfloat> sourceImage(4 * Size * Size);
+    vector<GLfloat> referenceImage(4 * Size * Size);
+    vector<GLfloat> targetImage(4 * Size * Size);
+    FillNoise(sourceImage, 5);
+    const WarpMesh Mesh = MakeRotationMesh(30, 0.8f);
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Size, Size, sourceImage.data());
+    Job.mesh = &Mesh;
+    Job.sampling = Sampling::Manual;
+
+    printf("\n%s against %s engine on a rotated texture...\n", Engine.Name(), Reference.Name());
+    const char* names[] = { "nearest", "linear", "cubic" };
+    const Filter filters[] = { Filter::Nearest, Filter::Linear, Filter::Cubic };
+    for (int i = 0; i < 3; ++i) {
+        Job.filter = filters[i];
+        Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, referenceImage.data());
+        Reference.Run(Job);
+        Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, targetImage.data());
+        Engine.Run(Job);
+        float maxError = 0;
+        for (size_t j = 0; j < targetImage.size(); ++j)
+            maxError = fmaxf(maxError, fabsf(targetImage[j] - referenceImage[j]));
+        printf("...%s max difference %g\n", names[i], maxError);
     }
+}
+
+// Fills each interleaved layout with random samples and checks the kernels
+// specialized for it against the RGBA32F kernels on the decoded values.
+static void CompareSampleTypes(WarpEngine& Engine)
+{
+    const int Size = 32;
+    const PixelFormat formats[] = {
+        PixelFormat::R8, PixelFormat::RGB8, PixelFormat::RGBA8, PixelFormat::R16UI, PixelFormat::RG16UI,
+        PixelFormat::R16F, PixelFormat::RGBA16F, PixelFormat::R32F, PixelFormat::RG32F, PixelFormat::RGB32F
+    };
+    const WarpMesh Mesh = MakeRotationMesh(30, 0.8f);
+    vector<GLfloat> referenceImage(4 * Size * Size);
+    vector<GLfloat> targetImage(4 * Size * Size);
 
-    glLinkProgram(ProgramID);
+    printf("\n%s kernels per sample type against RGBA32F on a rotated texture...\n", Engine.Name());
+    for (auto format : formats) {
+        const int channels = ChannelCount(format);
+        const SampleType type = FormatSampleType(format);
+        vector<unsigned char> sourceImage(PlaneBytes(format, 0, Size, Size));
+        vector<GLfloat> expandedImage(4 * Size * Size);
+        unsigned seed = 7;
+        for (int i = 0; i < Size * Size; ++i) {
+            GLfloat* texel = &expandedImage[i * 4];
+            texel[0] = texel[1] = texel[2] = 0;
+            texel[3] = 1;
+            for (int c = 0; c < channels; ++c) {
+                seed = seed * 1664525u + 1013904223u;
+                const int sample = i * channels + c;
+                GLfloat value;
+                switch (type) {
+                case SampleType::U8:
+                    sourceImage[sample] = (unsigned char)(seed >> 24);
+                    value = sourceImage[sample] / 255.0f;
+                    break;
+                case SampleType::U16:
+                    ((unsigned short*)sourceImage.data())[sample] = (unsigned short)(seed >> 20);
+                    value = GLfloat(seed >> 20);
+                    break;
+                case SampleType::F16:
+                    // Random mantissa, exponents for [0.25, 1)
+                    ((unsigned short*)sourceImage.data())[sample] = (unsigned short)(0x3400 + (seed >> 21));
+                    value = HalfToFloat((unsigned short)(0x3400 + (seed >> 21)));
+                    break;
+                default:
+                    value = (seed >> 8) / 16777216.0f;
+                    ((GLfloat*)sourceImage.data())[sample] = value;
+                    break;
+                }
+                texel[c] = value;
+            }
+            if (channels == 1)
+                texel[1] = texel[2] = texel[0];
+        }
 
-    // Check the program
-    GLint Result = GL_FALSE;
-    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-    if (Result == GL_FALSE) {
-        int InfoLogLength;
-        glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-        vector<char> ProgramErrorMessage(InfoLogLength + 1);
-        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-        printf("%s\n", &ProgramErrorMessage[0]);
+        WarpJob Job;
+        Job.mesh = &Mesh;
+        Job.sampling = Sampling::Manual;
+        printf("...%s", FormatName(format));
+        const char* names[] = { "nearest", "linear", "cubic" };
+        const Filter filters[] = { Filter::Nearest, Filter::Linear, Filter::Cubic };
+        for (int i = 0; i < 3; ++i) {
+            Job.filter = filters[i];
+            Job.source = MakeImageView(PixelFormat::RGBA32F, Size, Size, expandedImage.data());
+            Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, referenceImage.data());
+            Engine.Run(Job);
+            Job.source = MakeImageView(format, Size, Size, sourceImage.data());
+            Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, targetImage.data());
+            printf(" %s %s", names[i], !Engine.Run(Job) ? "unsupported" : referenceImage == targetImage ? "EQUAL" : "DIFFERENT");
+        }
+        printf("\n");
     }
+}
 
-    for (auto& sID : shaderIDs)
-    {
-        glDetachShader(ProgramID, sID);
-        glDeleteShader(sID);
+// Hardware bilinear filtering of 8-bit textures in two engines, e.g. the
+// GPU's texture unit against the CPU's fixed-point emulation of it. Samples
+// whose coordinate lands on a rounding boundary may still differ by a step,
+// as the GPU interpolates coordinates per pixel and the CPU per span.
+static void CompareFixedPoint(WarpEngine& Reference, WarpEngine& Engine)
+{
+    const int Size = 64;
+    const PixelFormat formats[] = { PixelFormat::R8, PixelFormat::RGB8, PixelFormat::RGBA8 };
+    const WarpMesh Mesh = MakeRotationMesh(30, 0.8f);
+    vector<GLfloat> referenceImage(4 * Size * Size);
+    vector<GLfloat> targetImage(4 * Size * Size);
+
+    printf("\n%s against %s 8-bit hardware bilinear on a rotated texture...\n", Engine.Name(), Reference.Name());
+    for (auto format : formats) {
+        vector<unsigned char> sourceImage(PlaneBytes(format, 0, Size, Size));
+        unsigned seed = 11;
+        for (auto& sample : sourceImage) {
+            seed = seed * 1664525u + 1013904223u;
+            sample = (unsigned char)(seed >> 24);
+        }
+
+        WarpJob Job;
+        Job.source = MakeImageView(format, Size, Size, sourceImage.data());
+        Job.mesh = &Mesh;
+        Job.filter = Filter::Linear;
+        Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, referenceImage.data());
+        Reference.Run(Job);
+        Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, targetImage.data());
+        Engine.Run(Job);
+
+        float maxError = 0;
+        size_t differences = 0;
+        for (size_t i = 0; i < targetImage.size(); ++i) {
+            maxError = fmaxf(maxError, fabsf(targetImage[i] - referenceImage[i]));
+            differences += targetImage[i] != referenceImage[i];
+        }
+        printf("...%s max difference %g 8-bit steps in %zu of %zu samples\n", FormatName(format),
+            maxError * 255, differences, targetImage.size());
+    }
+}
+
+// Raw counts are filtered with fp32 weights by both engines, also with
+// Sampling::Hardware, so a rotated R16UI frame should agree to well under
+// a count; the fixed-point blend would round each lerp to whole counts.
+static void CompareRawRotation(WarpEngine& Reference, WarpEngine& Engine)
+{
+    const int Size = 64;
+    vector<GLushort> rawImage(Size * Size);
+    unsigned seed = 13;
+    for (auto& sample : rawImage) {
+        seed = seed * 1664525u + 1013904223u;
+        sample = GLushort(seed >> 20);
     }
+    const WarpMesh Mesh = MakeRotationMesh(30, 0.8f);
+    vector<GLfloat> referenceImage(4 * Size * Size);
+    vector<GLfloat> targetImage(4 * Size * Size);
 
-    return ProgramID;
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::R16UI, Size, Size, rawImage.data());
+    Job.mesh = &Mesh;
+    Job.filter = Filter::Linear;
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, referenceImage.data());
+    Reference.Run(Job);
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, targetImage.data());
+    Engine.Run(Job);
+
+    float maxError = 0;
+    for (size_t i = 0; i < targetImage.size(); ++i)
+        maxError = fmaxf(maxError, fabsf(targetImage[i] - referenceImage[i]));
+    printf("\n%s against %s on a rotated 12-bit raw texture, linear. Result is %s (max difference %g counts)\n",
+        Engine.Name(), Reference.Name(), maxError < 0.5f ? "EQUAL" : "DIFFERENT", maxError);
 }
 
-static GLuint LoadShaders(const string& sVertex, const string& sFragment)
+// Narrow GL targets against the RGBA32F result quantized on the host. The
+// 8-bit targets may differ by a step where the GPU rounds a value sitting on
+// a rounding boundary the other way; R8 must match the red channel of RGBA8.
+static void CompareOutputPacking(GlWarpEngine& Engine)
 {
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+    const int TargetWidth = 61;
+    const int TargetHeight = 48;
+    const size_t Samples = size_t(4) * TargetWidth * TargetHeight;
+    vector<GLfloat> sourceImage(Samples);
+    FillNoise(sourceImage, 9);
+    const WarpMesh Mesh = MakeRotationMesh(30, 0.8f);
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::RGBA32F, TargetWidth, TargetHeight, sourceImage.data());
+    Job.mesh = &Mesh;
+    Job.filter = Filter::Linear;
+    Job.sampling = Sampling::Manual;
+
+    vector<GLfloat> referenceImage(Samples);
+    Job.target = MakeImageView(PixelFormat::RGBA32F, TargetWidth, TargetHeight, referenceImage.data());
+    Engine.Run(Job);
+
+    printf("\nGL output packing against the RGBA32F result, %dx%d...\n", TargetWidth, TargetHeight);
+    vector<unsigned char> bytes(Samples);
+    for (int dither = 0; dither < 2; ++dither) {
+        Job.dither = dither != 0;
+        Job.target = MakeImageView(PixelFormat::RGBA8, TargetWidth, TargetHeight, bytes.data());
+        Engine.Run(Job);
+
+        // Same 4x4 Bayer offsets as the shader
+        static const int Bayer[16] = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+        int maxSteps = 0;
+        size_t differences = 0;
+        for (size_t i = 0; i < Samples; ++i) {
+            const int x = int(i / 4 % TargetWidth), y = int(i / 4 / TargetWidth);
+            const float offset = Job.dither ? ((Bayer[(y & 3) * 4 + (x & 3)] + 0.5f) / 16 - 0.5f) / 255 : 0;
+            const int expected = int(lrintf(fminf(fmaxf(referenceImage[i] + offset, 0), 1) * 255));
+            const int steps = abs(bytes[i] - expected);
+            maxSteps = steps > maxSteps ? steps : maxSteps;
+            differences += steps != 0;
+        }
+        printf("...RGBA8%s max difference %d steps in %zu of %zu samples\n", Job.dither ? " dithered" : "",
+            maxSteps, differences, Samples);
+    }
 
-    CompileShader(VertexShaderID, sVertex);
-    CompileShader(FragmentShaderID, sFragment);
-    vector<GLuint> shaderIDs = { VertexShaderID, FragmentShaderID };
-    auto ProgramID = CreateAndLinkProgram(shaderIDs);
-    return ProgramID;
+    Job.dither = false;
+    vector<unsigned char> rgba8(Samples);
+    Job.target = MakeImageView(PixelFormat::RGBA8, TargetWidth, TargetHeight, rgba8.data());
+    Engine.Run(Job);
+    vector<unsigned char> red(size_t(TargetWidth) * TargetHeight);
+    Job.target = MakeImageView(PixelFormat::R8, TargetWidth, TargetHeight, red.data());
+    Engine.Run(Job);
+    bool same = true;
+    for (size_t i = 0; i < red.size(); ++i)
+        same &= red[i] == rgba8[i * 4];
+    printf("...R8 packed four per texel against RGBA8 red. Result is %s\n", same ? "EQUAL" : "DIFFERENT");
+
+    vector<unsigned short> halves(Samples);
+    Job.target = MakeImageView(PixelFormat::RGBA16F, TargetWidth, TargetHeight, halves.data());
+    Engine.Run(Job);
+    float maxError = 0;
+    for (size_t i = 0; i < Samples; ++i)
+        maxError = fmaxf(maxError, fabsf(HalfToFloat(halves[i]) - referenceImage[i]) / fmaxf(fabsf(referenceImage[i]), 1e-4f));
+    printf("...RGBA16F max relative difference %g, %s half precision\n", maxError,
+        maxError <= 1.0f / 1024 ? "within" : "OUTSIDE");
+    printf("...readback bytes per pixel RGBA32F 16, RGBA16F 8, RGBA8 4, R8 1\n");
 }
 
-int MatchConfig2Visual(EGLDisplay egl_display, EGLint visual_id, EGLConfig* configs, int count) {
+// A rotation, a downscale to half size and a conversion to RGBA8 chained on
+// resident images, against the same steps with a readback and upload in
+// between. The GPU does identical work either way, so results must match.
+static void CompareResidentChain(GlWarpEngine& Engine)
+{
+    const int Size = 64;
+    vector<GLfloat> sourceImage(4 * Size * Size);
+    FillNoise(sourceImage, 13);
+    const WarpMesh Rotation = MakeRotationMesh(30, 0.8f);
+    const WarpMesh Identity = MakeRotationMesh(0, 1);
 
-    EGLint id;
-    for (int i = 0; i < count; ++i) {
-        if (!eglGetConfigAttrib(egl_display, configs[i], EGL_NATIVE_VISUAL_ID, &id)) continue;
-        if (id == visual_id) return i;
+    WarpJob Steps[3];
+    Steps[0].mesh = &Rotation;
+    Steps[0].filter = Filter::Cubic;
+    Steps[0].target = MakeImageView(PixelFormat::RGBA32F, Size, Size, nullptr);
+    Steps[1].mesh = &Identity;
+    Steps[1].filter = Filter::Linear;
+    Steps[1].sampling = Sampling::Manual;
+    Steps[1].target = MakeImageView(PixelFormat::RGBA32F, Size / 2, Size / 2, nullptr);
+    Steps[2].mesh = &Identity;
+    Steps[2].target = MakeImageView(PixelFormat::RGBA8, Size / 2, Size / 2, nullptr);
+
+    vector<GLfloat> rotated(4 * Size * Size), scaled(Size * Size);
+    vector<unsigned char> expected(Size * Size), result(Size * Size);
+    WarpJob Job = Steps[0];
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Size, Size, sourceImage.data());
+    Job.target.planes[0] = rotated.data();
+    Engine.Run(Job);
+    Job = Steps[1];
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Size, Size, rotated.data());
+    Job.target.planes[0] = scaled.data();
+    Engine.Run(Job);
+    Job = Steps[2];
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Size / 2, Size / 2, scaled.data());
+    Job.target.planes[0] = expected.data();
+    Engine.Run(Job);
+
+    printf("\nResident chain of three warps against a round trip per step...\n");
+    for (int run = 0; run < 2; ++run) {
+        GpuImage image = Engine.UploadImage(MakeImageView(PixelFormat::RGBA32F, Size, Size, sourceImage.data()));
+        for (auto& step : Steps)
+            image = Engine.Warp(step, image);
+        Engine.ReadImage(image, MakeImageView(PixelFormat::RGBA8, Size / 2, Size / 2, result.data()));
     }
-    return -1;
+    const GlImagePoolStats stats = Engine.ImagePool().Stats();
+    printf("...Result is %s, %zu textures created, %zu reused\n", result == expected ? "EQUAL" : "DIFFERENT",
+        stats.allocations, stats.reuses);
 }
 
-static void APIENTRY funcname(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
+// Smooth periodic test pattern, so texture wrapping stays consistent and
+// every sample has an exact expected value.
+static void Pattern(float u, float v, GLfloat* rgba)
 {
-    printf("GL CALLBACK: %s type = 0x%x, severity = 0x%x, message = %s\n",
-        (type == GL_DEBUG_TYPE_ERROR ? "** GL ERROR **" : ""),
-        type, severity, message);
+    const float TwoPi = 6.2831853f;
+    rgba[0] = 0.5f + 0.5f * sinf(TwoPi * (2 * u + v));
+    rgba[1] = 0.5f + 0.5f * cosf(TwoPi * (u - 3 * v));
+    rgba[2] = 0.5f + 0.5f * sinf(TwoPi * 4 * u);
+    rgba[3] = 1;
+}
+
+// Five steps run one resampling pass each through resident images, against
+// the same chain composed into one mesh. Both are scored against the exact
+// pattern value at each output pixel, where no intermediate step reads
+// outside its input.
+static void CompareWarpChain(GlWarpEngine& Engine)
+{
+    const int Size = 256;
+    vector<GLfloat> sourceImage(4 * Size * Size);
+    for (int y = 0; y < Size; ++y)
+        for (int x = 0; x < Size; ++x)
+            Pattern((x + 0.5f) / Size, (y + 0.5f) / Size, &sourceImage[(size_t(y) * Size + x) * 4]);
+
+    const float Perspective[9] = { 1, 0.02f, 0, 0.01f, 1, 0, 0.05f, 0.03f, 1 };
+    WarpChain Steps[5];
+    Steps[0].Mesh(MakeUndistortMesh(0.15f, 0));
+    Steps[1].Rotate(12, 0.95f);
+    Steps[2].Crop(0.1f, 0.1f, 0.8f, 0.8f);
+    Steps[3].Homography(Perspective);
+    Steps[4].Rotate(0, 0.9f);
+    WarpChain Chain;
+    for (auto& step : Steps)
+        Chain.Then(step);
+
+    WarpJob Job;
+    Job.filter = Filter::Linear;
+    Job.sampling = Sampling::Manual;
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, nullptr);
+    WarpMesh Meshes[5];
+    GpuImage image = Engine.UploadImage(MakeImageView(PixelFormat::RGBA32F, Size, Size, sourceImage.data()));
+    for (int i = 0; i < 5; ++i) {
+        Meshes[i] = Steps[i].Compose();
+        Job.mesh = &Meshes[i];
+        image = Engine.Warp(Job, image);
+    }
+    vector<GLfloat> chainedImage(4 * Size * Size);
+    Engine.ReadImage(image, MakeImageView(PixelFormat::RGBA32F, Size, Size, chainedImage.data()));
+
+    const WarpMesh Composed = Chain.Compose();
+    vector<GLfloat> composedImage(4 * Size * Size);
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Size, Size, sourceImage.data());
+    Job.target.planes[0] = composedImage.data();
+    Job.mesh = &Composed;
+    Engine.Run(Job);
+
+    const float Margin = 2.0f / Size;
+    double chainedError = 0, composedError = 0;
+    size_t pixels = 0;
+    for (int y = 0; y < Size; ++y) {
+        for (int x = 0; x < Size; ++x) {
+            float u = (x + 0.5f) / Size, v = (y + 0.5f) / Size;
+            bool inside = true;
+            for (int i = 4; i >= 0; --i) {
+                Steps[i].Map(u, v, u, v);
+                inside &= i == 0 || (u >= Margin && u <= 1 - Margin && v >= Margin && v <= 1 - Margin);
+            }
+            if (!inside)
+                continue;
+
+            GLfloat expected[4];
+            Pattern(u, v, expected);
+            for (int c = 0; c < 3; ++c) {
+                const size_t i = (size_t(y) * Size + x) * 4 + c;
+                chainedError += (chainedImage[i] - expected[c]) * (chainedImage[i] - expected[c]);
+                composedError += (composedImage[i] - expected[c]) * (composedImage[i] - expected[c]);
+            }
+            ++pixels;
+        }
+    }
+
+    const WarpMesh Affine = WarpChain().Rotate(12, 0.95f).Crop(0.1f, 0.1f, 0.8f, 0.8f).Rotate(0, 0.9f).Compose();
+    printf("\nFive-step warp chain on a %dx%d pattern, %zu pixels scored...\n", Size, Size, pixels);
+    printf("...one pass per step: RMS error %.5f\n", sqrt(chainedError / (pixels * 3)));
+    printf("...composed into one pass of %zu vertices: RMS error %.5f\n", Composed.sourceGrid.size() / 2,
+        sqrt(composedError / (pixels * 3)));
+    printf("...matrix steps fused into %zu stored steps, an affine-only chain composes to %zu vertices\n",
+        Chain.StepCount(), Affine.sourceGrid.size() / 2);
+}
+
+// Point sampling at the coordinates a rotated warp's pixel centers map to,
+// against the warp itself. The rasterizer interpolates those coordinates
+// slightly differently from the host, so filtered values differ in their
+// low bits, and Nearest may pick a neighbour at a texel boundary.
+static void CompareSamplePoints(GlWarpEngine& Engine)
+{
+    const int Size = 64;
+    vector<GLfloat> sourceImage(4 * Size * Size);
+    FillNoise(sourceImage, 14);
+    WarpChain Rotation;
+    Rotation.Rotate(30, 0.8f);
+    const WarpMesh Mesh = Rotation.Compose();
+
+    vector<GLfloat> coordinates(2 * Size * Size);
+    for (int y = 0; y < Size; ++y)
+        for (int x = 0; x < Size; ++x)
+            Rotation.Map((x + 0.5f) / Size, (y + 0.5f) / Size, coordinates[(y * Size + x) * 2], coordinates[(y * Size + x) * 2 + 1]);
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Size, Size, sourceImage.data());
+    Job.mesh = &Mesh;
+    vector<GLfloat> warpImage(4 * Size * Size);
+    vector<GLfloat> points(4 * Size * Size);
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, warpImage.data());
+
+    printf("\nPoint sampling against a rotated warp at its pixel centers...\n");
+    const char* names[] = { "nearest", "manual linear", "manual cubic", "hardware linear" };
+    const Filter filters[] = { Filter::Nearest, Filter::Linear, Filter::Cubic, Filter::Linear };
+    for (int i = 0; i < 4; ++i) {
+        Job.filter = filters[i];
+        Job.sampling = i == 3 ? Sampling::Hardware : Sampling::Manual;
+        Engine.Run(Job);
+        Engine.SamplePoints(Job, coordinates.data(), Size * Size, points.data());
+
+        float maxError = 0;
+        size_t differences = 0;
+        for (size_t j = 0; j < points.size(); ++j) {
+            maxError = fmaxf(maxError, fabsf(points[j] - warpImage[j]));
+            differences += points[j] != warpImage[j];
+        }
+        printf("...%s max difference %g in %zu of %zu samples\n", names[i], maxError, differences, points.size());
+    }
+
+    vector<GLfloat> residentPoints(4 * Size * Size);
+    const GpuImage Resident = Engine.UploadImage(Job.source);
+    Engine.SamplePoints(Job, Resident, coordinates.data(), Size * Size, residentPoints.data());
+    printf("...on a resident image. Result is %s\n", residentPoints == points ? "EQUAL" : "DIFFERENT");
 }
 
-int main()
+// Analytic gradients against central differences of the sampled values,
+// at coordinates whose fractional texel position stays in [0.3, 0.7] so
+// the differences never straddle a bilinear cell boundary.
+static void CompareGradients(GlWarpEngine& Engine)
 {
+    const int Size = 64;
+    const size_t Count = 1024;
+    const float Step = 0.1f;
+    vector<GLfloat> sourceImage(4 * Size * Size);
+    FillNoise(sourceImage, 15);
+    vector<GLfloat> offsets(2 * Count);
+    FillNoise(offsets, 16);
+
+    vector<GLfloat> coordinates(2 * Count), shifted(8 * Count);
+    for (size_t i = 0; i < Count; ++i) {
+        for (int axis = 0; axis < 2; ++axis) {
+            const float texel = 2 + (i * (axis ? 7 : 13)) % (Size - 4) + 0.8f + 0.4f * offsets[i * 2 + axis];
+            coordinates[i * 2 + axis] = texel / Size;
+        }
+        // u - h, u + h, v - h, v + h
+        for (int k = 0; k < 4; ++k) {
+            const float sign = k & 1 ? 1.0f : -1.0f;
+            shifted[(k * Count + i) * 2] = coordinates[i * 2] + (k < 2 ? sign * Step / Size : 0);
+            shifted[(k * Count + i) * 2 + 1] = coordinates[i * 2 + 1] + (k < 2 ? 0 : sign * Step / Size);
+        }
+    }
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Size, Size, sourceImage.data());
+    Job.sampling = Sampling::Manual;
+    vector<GLfloat> gradients(12 * Count), values(4 * Count), neighbours(16 * Count);
+
+    printf("\nAnalytic gradients against central differences of %zu samples...\n", Count);
+    for (auto filter : { Filter::Linear, Filter::Cubic }) {
+        Job.filter = filter;
+        Engine.SampleGradients(Job, coordinates.data(), Count, gradients.data());
+        Engine.SamplePoints(Job, coordinates.data(), Count, values.data());
+        Engine.SamplePoints(Job, shifted.data(), Count * 4, neighbours.data());
+
+        float maxError = 0;
+        bool sameValues = true;
+        for (size_t i = 0; i < Count; ++i) {
+            for (int c = 0; c < 4; ++c) {
+                const float dx = (neighbours[(Count + i) * 4 + c] - neighbours[i * 4 + c]) / (2 * Step);
+                const float dy = (neighbours[(3 * Count + i) * 4 + c] - neighbours[(2 * Count + i) * 4 + c]) / (2 * Step);
+                maxError = fmaxf(maxError, fabsf(gradients[i * 12 + 4 + c] - dx));
+                maxError = fmaxf(maxError, fabsf(gradients[i * 12 + 8 + c] - dy));
+                sameValues &= gradients[i * 12 + c] == values[i * 4 + c];
+            }
+        }
+        printf("...%s max derivative difference %g, values against SamplePoints() %s\n",
+            filter == Filter::Linear ? "linear" : "cubic", maxError, sameValues ? "EQUAL" : "DIFFERENT");
+    }
+}
+
+// The template is the exact pattern under a known affine warp; alignment
+// starts from the identity and should recover the warp to within the
+// source's interpolation error.
+static void CompareAlignment(GlWarpEngine& Engine)
+{
+    const int Size = 128;
+    const int TemplateSize = 96;
+    vector<GLfloat> sourceImage(4 * Size * Size);
+    for (int y = 0; y < Size; ++y)
+        for (int x = 0; x < Size; ++x)
+            Pattern((x + 0.5f) / Size, (y + 0.5f) / Size, &sourceImage[(size_t(y) * Size + x) * 4]);
+
+    const float Angle = 3 * 3.14159265f / 180, Scale = 0.97f;
+    const float Expected[6] = { Scale * cosf(Angle), -Scale * sinf(Angle), 0.03f, Scale * sinf(Angle), Scale * cosf(Angle), 0.01f };
+    vector<GLfloat> templateImage(4 * TemplateSize * TemplateSize);
+    for (int y = 0; y < TemplateSize; ++y) {
+        for (int x = 0; x < TemplateSize; ++x) {
+            const float u = (x + 0.5f) / TemplateSize, v = (y + 0.5f) / TemplateSize;
+            Pattern(Expected[0] * u + Expected[1] * v + Expected[2], Expected[3] * u + Expected[4] * v + Expected[5],
+                &templateImage[(size_t(y) * TemplateSize + x) * 4]);
+        }
+    }
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Size, Size, sourceImage.data());
+    Job.sampling = Sampling::Manual;
+    const ImageView Template = MakeImageView(PixelFormat::RGBA32F, TemplateSize, TemplateSize, templateImage.data());
+
+    printf("\nAffine alignment of a %dx%d template to a %dx%d pattern from the identity...\n",
+        TemplateSize, TemplateSize, Size, Size);
+    for (auto filter : { Filter::Linear, Filter::Cubic }) {
+        Job.filter = filter;
+        float affine[6] = { 1, 0, 0, 0, 1, 0 };
+        float rms = 0;
+        const bool aligned = Engine.AlignAffine(Job, Template, 20, affine, &rms);
+        float maxError = 0;
+        for (int k = 0; k < 6; ++k)
+            maxError = fmaxf(maxError, fabsf(affine[k] - Expected[k]));
+        printf("...%s %s, max parameter error %g, RMS difference %.5f\n", filter == Filter::Linear ? "linear" : "cubic",
+            aligned ? "done" : "failed", maxError, rms);
+    }
+}
+
+// GPU statistics of a warp's target against references uploaded from the
+// host: the same warp read back, which must be equal, and the CPU engine's
+// result, whose differences are also measured on the host.
+static void CompareGpuStatistics(GlWarpEngine& Engine, WarpEngine& Reference)
+{
+    const int TargetWidth = 203, TargetHeight = 150;
+    vector<GLfloat> sourceImage(4 * 128 * 128);
+    FillNoise(sourceImage, 17);
+    const WarpMesh Mesh = MakeRotationMesh(20, 0.9f);
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::RGBA32F, 128, 128, sourceImage.data());
+    Job.mesh = &Mesh;
+    Job.filter = Filter::Linear;
+    Job.sampling = Sampling::Manual;
+    vector<GLfloat> referenceImage(4 * TargetWidth * TargetHeight);
+    vector<GLfloat> image(4 * TargetWidth * TargetHeight);
+    Job.target = MakeImageView(PixelFormat::RGBA32F, TargetWidth, TargetHeight, referenceImage.data());
+    Reference.Run(Job);
+    Job.target.planes[0] = image.data();
+    Engine.Run(Job);
+
+    const GpuImage Same = Engine.UploadImage(Job.target);
+    const GpuImage Cpu = Engine.UploadImage(MakeImageView(PixelFormat::RGBA32F, TargetWidth, TargetHeight, referenceImage.data()));
+    const float Threshold = 1e-6f;
+    ImageDifference same, difference;
+    Engine.CompareTarget(Same, 0, same);
+    Engine.CompareTarget(Cpu, Threshold, difference);
+
+    ImageDifference expected;
+    for (int c = 0; c < 4; ++c) {
+        expected.min[c] = 1e30f;
+        expected.max[c] = -1e30f;
+    }
+    for (size_t i = 0; i < image.size(); i += 4) {
+        bool over = false;
+        for (int c = 0; c < 4; ++c) {
+            const float d = image[i + c] - referenceImage[i + c];
+            expected.min[c] = fminf(expected.min[c], d);
+            expected.max[c] = fmaxf(expected.max[c], d);
+            expected.sum[c] += d;
+            expected.sumSquares[c] += double(d) * d;
+            over |= fabsf(d) > Threshold;
+        }
+        expected.pixelsOver += over;
+    }
+    bool extremesEqual = true;
+    double sumError = 0;
+    for (int c = 0; c < 4; ++c) {
+        extremesEqual &= difference.min[c] == expected.min[c] && difference.max[c] == expected.max[c];
+        sumError = max(sumError, fabs(difference.sum[c] - expected.sum[c]));
+        sumError = max(sumError, fabs(difference.sumSquares[c] - expected.sumSquares[c]));
+    }
+
+    printf("\nGPU statistics of a %dx%d GL target...\n", TargetWidth, TargetHeight);
+    printf("...against itself: %zu of %zu pixels differ. Result is %s\n", same.pixelsOver, same.pixels,
+        same.Equal() ? "EQUAL" : "DIFFERENT");
+    printf("...against the CPU engine: %zu pixels over %g (host %zu), min/max %s, max sum difference %g\n",
+        difference.pixelsOver, Threshold, expected.pixelsOver, extremesEqual ? "EQUAL" : "DIFFERENT", sumError);
+
+    for (int bins : { 256, 4096 }) {
+        vector<unsigned> counts, expectedCounts(bins);
+        Engine.TargetHistogram(1, bins, 0, 1, counts);
+        for (size_t i = 1; i < image.size(); i += 4)
+            ++expectedCounts[min(max(int(floorf(image[i] * bins)), 0), bins - 1)];
+        printf("...%d-bin histogram of green. Result is %s\n", bins, counts == expectedCounts ? "EQUAL" : "DIFFERENT");
+    }
+}
+
+// Identity warp of a resident image with nearest filtering into RGBA32F,
+// i.e. the texels as the GPU decodes them.
+static vector<GLfloat> FetchTexels(GlWarpEngine& Engine, const GpuImage& Image)
+{
+    const WarpMesh Identity = MakeRotationMesh(0, 1);
+    WarpJob Job;
+    Job.mesh = &Identity;
+    Job.filter = Filter::Nearest;
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Image.Width(), Image.Height(), nullptr);
+    vector<GLfloat> texels(4 * size_t(Image.Width()) * Image.Height());
+    Engine.ReadImage(Engine.Warp(Job, Image), MakeImageView(PixelFormat::RGBA32F, Image.Width(), Image.Height(), texels.data()));
+    return texels;
+}
+
+// Host decode of random blocks, which exercise every ETC2 mode, against
+// the GPU's decode; then encoding quality, determinism across instruction
+// sets and threads, and the disk cache.
+static void CompareEtc2(GlWarpEngine& Engine)
+{
+    const int Size = 64;
+    const CompressedFormat Formats[3] = { CompressedFormat::Etc2Rgb8, CompressedFormat::Etc2Rgba8, CompressedFormat::EacR11 };
+
+    printf("\nETC2 and EAC blocks decoded on the host against the GPU...\n");
+    for (auto format : Formats) {
+        CompressedImage random;
+        random.format = format;
+        random.width = Size;
+        random.height = Size;
+        random.blocks.resize(CompressedSize(format, Size, Size));
+        vector<GLfloat> noise(random.blocks.size());
+        FillNoise(noise, 18);
+        for (size_t i = 0; i < noise.size(); ++i)
+            random.blocks[i] = uint8_t(noise[i] * 256);
+
+        const bool r11 = format == CompressedFormat::EacR11;
+        vector<unsigned short> decoded(size_t(Size) * Size * (r11 ? 1 : 2));
+        DecodeEtc2(random, MakeImageView(r11 ? PixelFormat::R16UI : PixelFormat::RGBA8, Size, Size, decoded.data()));
+        const vector<GLfloat> texels = FetchTexels(Engine, Engine.UploadImage(random));
+
+        size_t differences = 0;
+        for (size_t i = 0; i < size_t(Size) * Size; ++i) {
+            if (r11) {
+                differences += int(lrintf(texels[i * 4] * 2047)) != decoded[i];
+                continue;
+            }
+            const unsigned char* rgba = (const unsigned char*)decoded.data() + i * 4;
+            for (int c = 0; c < 4; ++c)
+                differences += int(lrintf(texels[i * 4 + c] * 255)) != rgba[c];
+        }
+        printf("...%s: %zu differences. Result is %s\n", CompressedFormatName(format), differences,
+            differences == 0 ? "EQUAL" : "DIFFERENT");
+    }
+
+    const int ImageSize = 256;
+    vector<unsigned char> rgba(4 * ImageSize * ImageSize), red(ImageSize * ImageSize);
+    for (int y = 0; y < ImageSize; ++y) {
+        for (int x = 0; x < ImageSize; ++x) {
+            GLfloat color[4];
+            Pattern((x + 0.5f) / ImageSize, (y + 0.5f) / ImageSize, color);
+            color[3] = 0.5f + 0.5f * color[0] * color[1];
+            for (int c = 0; c < 4; ++c)
+                rgba[(size_t(y) * ImageSize + x) * 4 + c] = (unsigned char)lrintf(color[c] * 255);
+            red[size_t(y) * ImageSize + x] = (unsigned char)lrintf(color[2] * 255);
+        }
+    }
+
+    printf("\nETC2 and EAC encoding of a %dx%d pattern...\n", ImageSize, ImageSize);
+    ThreadPool Pool;
+    for (auto format : Formats) {
+        const bool r11 = format == CompressedFormat::EacR11;
+        const ImageView Source = r11 ? MakeImageView(PixelFormat::R8, ImageSize, ImageSize, red.data())
+            : MakeImageView(PixelFormat::RGBA8, ImageSize, ImageSize, rgba.data());
+        CompressedImage scalar, threaded;
+        EncodeEtc2(Source, format, scalar, nullptr, CpuKernels::Scalar);
+        EncodeEtc2(Source, format, threaded, &Pool);
+
+        vector<unsigned short> decoded(size_t(ImageSize) * ImageSize * (r11 ? 1 : 2));
+        DecodeEtc2(threaded, MakeImageView(r11 ? PixelFormat::R16UI : PixelFormat::RGBA8, ImageSize, ImageSize, decoded.data()));
+        double squares = 0;
+        const int channels = r11 ? 1 : format == CompressedFormat::Etc2Rgba8 ? 4 : 3;
+        for (size_t i = 0; i < size_t(ImageSize) * ImageSize; ++i) {
+            for (int c = 0; c < channels; ++c) {
+                const double d = r11 ? decoded[i] / 2047.0 - red[i] / 255.0
+                    : (((const unsigned char*)decoded.data())[i * 4 + c] - rgba[i * 4 + c]) / 255.0;
+                squares += d * d;
+            }
+        }
+        const double mse = squares / (size_t(ImageSize) * ImageSize * channels);
+        printf("...%s: %zu bytes, PSNR %.1f dB, scalar against %u threads with the best kernels %s\n",
+            CompressedFormatName(format), threaded.blocks.size(), 10 * log10(1 / mse), Pool.ThreadCount(),
+            scalar.blocks == threaded.blocks ? "EQUAL" : "DIFFERENT");
+    }
+
+    CompressedImage first, second;
+    bool firstCached = false, secondCached = false;
+    const ImageView Source = MakeImageView(PixelFormat::RGBA8, ImageSize, ImageSize, rgba.data());
+    LoadOrEncodeEtc2(Source, CompressedFormat::Etc2Rgb8, ".", first, &Pool, &firstCached);
+    LoadOrEncodeEtc2(Source, CompressedFormat::Etc2Rgb8, ".", second, &Pool, &secondCached);
+    printf("...cache: %s, then %s. Result is %s\n", firstCached ? "loaded" : "encoded", secondCached ? "loaded" : "encoded",
+        secondCached && first.blocks == second.blocks ? "EQUAL" : "DIFFERENT");
+
+    // A warp of the compressed source against the uncompressed one
+    const WarpMesh Mesh = MakeRotationMesh(15, 0.9f);
+    WarpJob Job;
+    Job.mesh = &Mesh;
+    Job.filter = Filter::Linear;
+    Job.target = MakeImageView(PixelFormat::RGBA32F, ImageSize, ImageSize, nullptr);
+    vector<GLfloat> compressedImage(4 * ImageSize * ImageSize), plainImage(4 * ImageSize * ImageSize);
+    ImageView target = MakeImageView(PixelFormat::RGBA32F, ImageSize, ImageSize, compressedImage.data());
+    Engine.ReadImage(Engine.Warp(Job, Engine.UploadImage(first)), target);
+    target.planes[0] = plainImage.data();
+    Engine.ReadImage(Engine.Warp(Job, Engine.UploadImage(Source)), target);
+    double squares = 0;
+    for (size_t i = 0; i < plainImage.size(); i += 4)
+        for (int c = 0; c < 3; ++c)
+            squares += (compressedImage[i + c] - plainImage[i + c]) * (compressedImage[i + c] - plainImage[i + c]);
+    printf("...rotated warp of the ETC2 source against RGBA8: RMS difference %.4f\n",
+        sqrt(squares / (plainImage.size() / 4 * 3)));
+}
+
+// Gamma-correct resampling of an sRGB photo-like source: the GL engine's
+// sRGB textures against the CPU engine's table, in linear floats and
+// encoded back to sRGB bytes, and how far naive interpolation of the
+// encoded values is off.
+static void CompareSrgb(GlWarpEngine& Engine, CpuWarpEngine& Cpu)
+{
+    const int Size = 64;
+    vector<GLfloat> noise(4 * Size * Size);
+    FillNoise(noise, 19);
+    vector<unsigned char> sourceImage(noise.size());
+    for (size_t i = 0; i < noise.size(); ++i)
+        sourceImage[i] = (unsigned char)(noise[i] * 256);
+    const WarpMesh Mesh = MakeRotationMesh(25, 0.7f);
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::RGBA8, Size, Size, sourceImage.data());
+    Job.source.encoding = ColorEncoding::Srgb;
+    Job.mesh = &Mesh;
+    Job.filter = Filter::Linear;
+    Job.sampling = Sampling::Manual;
+    vector<GLfloat> glImage(4 * Size * Size), cpuImage(4 * Size * Size), naiveImage(4 * Size * Size);
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, glImage.data());
+    Engine.Run(Job);
+    Job.target.planes[0] = cpuImage.data();
+    Cpu.Run(Job);
+
+    vector<unsigned char> encodedImage(4 * Size * Size);
+    Job.target = MakeImageView(PixelFormat::RGBA8, Size, Size, encodedImage.data());
+    Job.target.encoding = ColorEncoding::Srgb;
+    Engine.Run(Job);
+
+    Job.source.encoding = ColorEncoding::Linear;
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, naiveImage.data());
+    Engine.Run(Job);
+
+    float maxError = 0;
+    int maxSteps = 0;
+    double naiveSteps = 0;
+    for (size_t i = 0; i < glImage.size(); ++i) {
+        maxError = fmaxf(maxError, fabsf(glImage[i] - cpuImage[i]));
+        const bool alpha = i % 4 == 3;
+        const float encoded = alpha ? cpuImage[i] : LinearToSrgb(cpuImage[i]);
+        maxSteps = max(maxSteps, abs(int(encodedImage[i]) - int(lrintf(encoded * 255))));
+        if (!alpha)
+            naiveSteps += fabsf(naiveImage[i] - encoded) * 255;
+    }
+    printf("\nsRGB source rotated with manual linear filtering...\n");
+    printf("...GL against CPU in linear light: max difference %g\n", maxError);
+    printf("...GL sRGB RGBA8 target against the CPU result encoded on the host: max %d steps\n", maxSteps);
+    printf("...interpolating the encoded values instead: mean error %.2f steps\n", naiveSteps / (glImage.size() / 4 * 3));
+
+    if (KernelsSupported(CpuKernels::Avx2)) {
+        vector<GLfloat> scalar(sourceImage.size()), avx2(sourceImage.size());
+        SrgbToLinear(CpuKernels::Scalar, sourceImage.data(), 4, Size * Size, scalar.data());
+        SrgbToLinear(CpuKernels::Avx2, sourceImage.data(), 4, Size * Size, avx2.data());
+        printf("Host sRGB decode, AVX2 against scalar. Result is %s\n", scalar == avx2 ? "EQUAL" : "DIFFERENT");
+    }
+}
+
+// Raw mosaics of a detailed pattern in every color filter order, 8-bit and
+// 12-bit in 16-bit samples: the GL engine's fused demosaic and rotation
+// against the CPU engine, which demosaics the whole frame first, and each
+// method's demosaic alone against the full-color pattern.
+static void CompareBayer(GlWarpEngine& Engine, CpuWarpEngine& Cpu)
+{
+    const int Size = 128;
+    const BayerPattern Patterns[] = { BayerPattern::RGGB, BayerPattern::BGGR, BayerPattern::GRBG, BayerPattern::GBRG };
+    const char* PatternNames[] = { "RGGB", "BGGR", "GRBG", "GBRG" };
+    const float Identity[6] = { 1, 0, 0, 0, 1, 0 };
+    const WarpMesh Rotation = MakeRotationMesh(20, 0.8f);
+    const WarpMesh Copy = MakeAffineMesh(Identity);
+
+    vector<GLfloat> truth(4 * Size * Size);
+    for (int y = 0; y < Size; ++y)
+        for (int x = 0; x < Size; ++x) {
+            // Detail mostly in luma, as in camera images, which Malvar's
+            // correction relies on
+            GLfloat* rgba = &truth[(size_t(y) * Size + x) * 4];
+            Pattern((x + 0.5f) / Size, (y + 0.5f) / Size, rgba);
+            const float luma = 0.5f + 0.4f * sinf(0.35f * x) * cosf(0.27f * y);
+            for (int c = 0; c < 3; ++c)
+                rgba[c] = luma + 0.1f * (rgba[c] - 0.5f);
+        }
+
+    printf("\nBayer mosaics demosaiced and rotated in one pass...\n");
+    vector<unsigned char> mosaic8(Size * Size);
+    vector<unsigned short> mosaic16(Size * Size);
+    vector<GLfloat> glImage(4 * Size * Size), cpuImage(4 * Size * Size);
+    for (int p = 0; p < 4; ++p) {
+        int redX, redY;
+        BayerRedOrigin(Patterns[p], redX, redY);
+        for (int y = 0; y < Size; ++y)
+            for (int x = 0; x < Size; ++x) {
+                const int px = (x - redX) & 1, py = (y - redY) & 1;
+                const int channel = px == py ? (px == 0 ? 0 : 2) : 1;
+                const float value = truth[(size_t(y) * Size + x) * 4 + channel];
+                mosaic8[size_t(y) * Size + x] = (unsigned char)lrintf(value * 255);
+                mosaic16[size_t(y) * Size + x] = (unsigned short)lrintf(value * 4095);
+            }
+
+        for (int bits : { 8, 12 })
+            for (Demosaic method : { Demosaic::Bilinear, Demosaic::Malvar }) {
+                const float Scale = bits == 8 ? 1.0f : 4095.0f;
+                WarpJob Job;
+                Job.source = bits == 8 ? MakeImageView(PixelFormat::R8, Size, Size, mosaic8.data())
+                                       : MakeImageView(PixelFormat::R16UI, Size, Size, mosaic16.data());
+                Job.source.bayer = Patterns[p];
+                Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, glImage.data());
+                Job.mesh = &Rotation;
+                Job.filter = Filter::Linear;
+                Job.demosaic = method;
+                Engine.Run(Job);
+                Job.target.planes[0] = cpuImage.data();
+                Cpu.Run(Job);
+                float maxError = 0;
+                for (size_t i = 0; i < glImage.size(); ++i)
+                    maxError = fmaxf(maxError, fabsf(glImage[i] - cpuImage[i]) / Scale);
+
+                Job.target.planes[0] = glImage.data();
+                Job.mesh = &Copy;
+                Job.filter = Filter::Nearest;
+                Engine.Run(Job);
+                double squares = 0;
+                for (size_t i = 0; i < glImage.size(); ++i)
+                    if (i % 4 != 3)
+                        squares += (glImage[i] / Scale - truth[i]) * (glImage[i] / Scale - truth[i]);
+                printf("...%s %d-bit, %s: GL against CPU max difference %g, demosaic PSNR %.1f dB\n", PatternNames[p], bits,
+                    method == Demosaic::Malvar ? "Malvar" : "bilinear", maxError, 10 * log10(glImage.size() / 4 * 3 / squares));
+            }
+    }
+}
+
+// Plane of a possibly strided view, tightly packed
+static vector<unsigned char> PackPlane(const ImageView& image, int plane)
+{
+    int w, h;
+    PlaneSize(image.format, plane, image.width, image.height, w, h);
+    const size_t pixelBytes = PlaneBytes(image.format, plane, 1, 1);
+    const size_t rowBytes = w * pixelBytes;
+    const size_t strideBytes = RowLength(image, plane) * pixelBytes;
+    vector<unsigned char> packed(rowBytes * h);
+    for (int y = 0; y < h; ++y)
+        memcpy(&packed[y * rowBytes], (const unsigned char*)image.planes[plane] + y * strideBytes, rowBytes);
+    return packed;
+}
+
+// Regions of larger frames warped into regions of larger canvases, against
+// the same job on packed copies. The canvas around the region must keep its
+// contents.
+static void CompareStridedViews(GlWarpEngine& Engine)
+{
+    const WarpMesh Mesh = MakeRotationMesh(15, 0.9f);
+    vector<unsigned char> rgbaFrame(100 * 80 * 4), nv12Frame(96 * 64 * 3 / 2);
+    for (size_t i = 0; i < rgbaFrame.size(); ++i)
+        rgbaFrame[i] = (unsigned char)(i * 7 + i / 13);
+    for (size_t i = 0; i < nv12Frame.size(); ++i)
+        nv12Frame[i] = (unsigned char)(i * 5 + i / 11);
+    const ImageView Sources[] = {
+        SubImage(MakeImageView(PixelFormat::RGBA8, 100, 80, rgbaFrame.data()), 13, 7, 41, 33),
+        SubImage(MakeImageView(PixelFormat::NV12, 96, 64, nv12Frame.data(), &nv12Frame[96 * 64]), 10, 6, 40, 30),
+    };
+    const struct { PixelFormat format; int width; } Targets[] = {
+        { PixelFormat::RGBA32F, 35 }, { PixelFormat::RGBA16F, 35 }, { PixelFormat::RGBA8, 35 },
+        { PixelFormat::R8, 37 }, { PixelFormat::R8, 40 },
+    };
+    const int CanvasWidth = 64, CanvasHeight = 48, Height = 29;
+
+    printf("\nStrided regions against packed copies...\n");
+    for (const ImageView& source : Sources) {
+        vector<unsigned char> packedPlanes[2];
+        for (int plane = 0; plane < PlaneCount(source.format); ++plane)
+            packedPlanes[plane] = PackPlane(source, plane);
+        const ImageView packedSource = MakeImageView(source.format, source.width, source.height, packedPlanes[0].data(),
+            PlaneCount(source.format) > 1 ? packedPlanes[1].data() : nullptr);
+
+        for (auto& target : Targets) {
+            const size_t pixelBytes = PlaneBytes(target.format, 0, 1, 1);
+            vector<unsigned char> canvas(CanvasWidth * CanvasHeight * pixelBytes, 0x5a), packed(target.width * Height * pixelBytes);
+            const vector<unsigned char> untouched = canvas;
+            WarpJob Job;
+            Job.mesh = &Mesh;
+            Job.filter = Filter::Linear;
+            Job.source = packedSource;
+            Job.target = MakeImageView(target.format, target.width, Height, packed.data());
+            Engine.Run(Job);
+            Job.source = source;
+            Job.target = SubImage(MakeImageView(target.format, CanvasWidth, CanvasHeight, canvas.data()), 8, 12, target.width, Height);
+            Engine.Run(Job);
+
+            // Packing the region back and clearing it must give the packed
+            // result and the untouched canvas
+            bool equal = PackPlane(Job.target, 0) == packed;
+            for (int y = 0; y < Height; ++y)
+                memset((unsigned char*)Job.target.planes[0] + y * CanvasWidth * pixelBytes, 0x5a, target.width * pixelBytes);
+            equal = equal && canvas == untouched;
+            printf("...%s %dx%d into %s %dx%d. Result is %s\n", FormatName(source.format), source.width, source.height,
+                FormatName(target.format), target.width, Height, equal ? "EQUAL" : "DIFFERENT");
+        }
+    }
+}
+
+// A warp read back straight into a mapped raw file, reopened and uploaded
+// from the mapping, and a strided NV12 region written out, against the
+// images they came from. Damaged and overflowing headers must be rejected.
+static void CompareRawImages(GlWarpEngine& Engine)
+{
+    const int Size = 64;
+    const char* Path = "RawImageCheck.raw";
+    vector<GLfloat> sourceImage(4 * Size * Size), targetImage(4 * Size * Size), uploaded(4 * Size * Size);
+    FillNoise(sourceImage, 23);
+    const WarpMesh Mesh = MakeRotationMesh(30, 0.8f);
+
+    WarpJob Job;
+    Job.source = MakeImageView(PixelFormat::RGBA32F, Size, Size, sourceImage.data());
+    Job.target = MakeImageView(PixelFormat::RGBA32F, Size, Size, targetImage.data());
+    Job.mesh = &Mesh;
+    Job.filter = Filter::Linear;
+    Engine.Run(Job);
+
+    printf("\nRaw image files...\n");
+    RawImageFile file;
+    bool written = file.Create(Path, PixelFormat::RGBA32F, Size, Size);
+    if (written) {
+        Job.target = file.View();
+        written = Engine.Run(Job);
+    }
+    file.Close();
+    bool equal = written && file.Open(Path) && memcmp(file.View().planes[0], targetImage.data(), targetImage.size() * sizeof(GLfloat)) == 0;
+    printf("...warp read back into a mapped file. Result is %s\n", equal ? "EQUAL" : "DIFFERENT");
+
+    equal = equal && Engine.ReadImage(Engine.UploadImage(file.View()), MakeImageView(PixelFormat::RGBA32F, Size, Size, uploaded.data())) &&
+        uploaded == targetImage;
+    printf("...mapped file uploaded and read back. Result is %s\n", equal ? "EQUAL" : "DIFFERENT");
+    file.Close();
+
+    vector<unsigned char> frame(96 * 64 * 3 / 2);
+    for (size_t i = 0; i < frame.size(); ++i)
+        frame[i] = (unsigned char)(i * 3 + i / 7);
+    const ImageView Region = SubImage(MakeImageView(PixelFormat::NV12, 96, 64, frame.data(), &frame[96 * 64]), 16, 8, 50, 34);
+    equal = WriteRawImage(Path, Region) && file.Open(Path) && file.View().format == PixelFormat::NV12 && file.View().width == 50;
+    for (int plane = 0; equal && plane < 2; ++plane)
+        equal = PackPlane(Region, plane) == PackPlane(file.View(), plane);
+    printf("...strided NV12 region written and mapped. Result is %s\n", equal ? "EQUAL" : "DIFFERENT");
+    file.Close();
+
+    if (FILE* damaged = fopen(Path, "r+b")) {
+        fseek(damaged, 16, SEEK_SET);
+        fputc(0x7f, damaged);
+        fclose(damaged);
+    }
+    printf("...damaged header. Result is %s\n", file.Open(Path) ? "DIFFERENT" : "EQUAL (rejected)");
+
+    // 2^30 x 2^30 RGBA32F pixels are 2^64 bytes, which wraps to an empty
+    // image in 64-bit arithmetic
+    RawImageHeader huge = {};
+    memcpy(huge.magic, "RAWI", 4);
+    huge.byteOrder = 0x01020304;
+    huge.version = 1;
+    huge.format = uint32_t(PixelFormat::RGBA32F);
+    huge.width = huge.height = huge.rowLengths[0] = 1 << 30;
+    huge.planeOffsets[0] = sizeof(huge);
+    huge.fileSize = sizeof(huge);
+    if (FILE* forged = fopen(Path, "wb")) {
+        fwrite(&huge, sizeof(huge), 1, forged);
+        fclose(forged);
+    }
+    printf("...header whose size overflows. Result is %s\n", file.Open(Path) ? "DIFFERENT" : "EQUAL (rejected)");
+    remove(Path);
+}
+
+#ifdef WITH_PNG
+// Tiled archives with partial edge tiles, read whole and as a region into
+// a strided canvas, on one thread and on a pool; a region must decode only
+// the tiles it overlaps and a damaged tile must fail the read.
+static void CompareTiledImages()
+{
+    const int Width = 300, Height = 200, TileSize = 64;
+    const char* Path = "TiledImageCheck.tiles";
+    vector<GLfloat> floats(4 * Width * Height);
+    for (int y = 0; y < Height; ++y)
+        for (int x = 0; x < Width; ++x)
+            Pattern(x / float(Width), y / float(Height), &floats[(size_t(y) * Width + x) * 4]);
+    vector<unsigned short> counts(Width * Height);
+    for (size_t i = 0; i < counts.size(); ++i)
+        counts[i] = (unsigned short)(floats[i * 4] * 4095);
+    const ImageView Images[] = {
+        MakeImageView(PixelFormat::RGBA32F, Width, Height, floats.data()),
+        MakeImageView(PixelFormat::R16UI, Width, Height, counts.data()),
+    };
+
+    printf("\nTiled images of %dx%d pixels in %dx%d tiles...\n", Width, Height, TileSize, TileSize);
+    ThreadPool pool(4);
+    for (const ImageView& image : Images) {
+        const size_t pixelBytes = PlaneBytes(image.format, 0, 1, 1);
+        for (ThreadPool* threads : { (ThreadPool*)nullptr, &pool }) {
+            TiledImageReader reader;
+            vector<unsigned char> whole(Width * Height * pixelBytes);
+            bool equal = WriteTiledImage(Path, image, TileSize, threads) && reader.Open(Path) &&
+                reader.ReadRegion(0, 0, MakeImageView(image.format, Width, Height, whole.data()), threads) &&
+                memcmp(whole.data(), image.planes[0], whole.size()) == 0;
+
+            // A region of 100x90 pixels at (70, 50) overlaps 3x2 tiles
+            vector<unsigned char> canvas(128 * 96 * pixelBytes);
+            const ImageView Region = SubImage(MakeImageView(image.format, 128, 96, canvas.data()), 10, 4, 100, 90);
+            size_t tiles = 0;
+            equal = equal && reader.ReadRegion(70, 50, Region, threads, &tiles) && tiles == 6 &&
+                PackPlane(Region, 0) == PackPlane(SubImage(image, 70, 50, 100, 90), 0);
+            struct stat info;
+            const size_t fileBytes = stat(Path, &info) == 0 ? size_t(info.st_size) : 0;
+            printf("...%s, %s: %zu of %zu bytes. Result is %s\n", FormatName(image.format), threads ? "4 threads" : "1 thread",
+                fileBytes, PlaneBytes(image.format, 0, Width, Height), equal ? "EQUAL" : "DIFFERENT");
+        }
+    }
+
+    // Flip a byte in the middle of the last tile's stream
+    if (FILE* damaged = fopen(Path, "r+b")) {
+        fseek(damaged, -40, SEEK_END);
+        const int byte = fgetc(damaged);
+        fseek(damaged, -40, SEEK_END);
+        fputc(byte ^ 0x55, damaged);
+        fclose(damaged);
+    }
+    TiledImageReader reader;
+    vector<unsigned short> region(32 * 32);
+    const bool clean = reader.Open(Path) && reader.ReadRegion(0, 0, MakeImageView(PixelFormat::R16UI, 32, 32, region.data()));
+    const bool damaged = !reader.ReadRegion(Width - 32, Height - 32, MakeImageView(PixelFormat::R16UI, 32, 32, region.data()));
+    printf("...damaged last tile, first tile still read. Result is %s\n", clean && damaged ? "EQUAL (rejected)" : "DIFFERENT");
+    remove(Path);
+}
+#endif
+
+// Host versions of the pyramid builder's reduce and expand steps, RGBA with
+// clamped borders.
+static const GLfloat* Texel(const vector<GLfloat>& image, int width, int height, int x, int y)
+{
+    return &image[(size_t(min(max(y, 0), height - 1)) * width + min(max(x, 0), width - 1)) * 4];
+}
+
+static vector<GLfloat> ReduceLevel(const vector<GLfloat>& fine, int width, int height)
+{
+    static const float Weights[5] = { 1 / 16.0f, 4 / 16.0f, 6 / 16.0f, 4 / 16.0f, 1 / 16.0f };
+    const int coarseWidth = (width + 1) / 2, coarseHeight = (height + 1) / 2;
+    vector<GLfloat> rows(size_t(4) * coarseWidth * height, 0);
+    vector<GLfloat> coarse(size_t(4) * coarseWidth * coarseHeight, 0);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < coarseWidth; ++x)
+            for (int k = -2; k <= 2; ++k)
+                for (int c = 0; c < 4; ++c)
+                    rows[(size_t(y) * coarseWidth + x) * 4 + c] += Weights[k + 2] * Texel(fine, width, height, 2 * x + k, y)[c];
+    for (int y = 0; y < coarseHeight; ++y)
+        for (int x = 0; x < coarseWidth; ++x)
+            for (int k = -2; k <= 2; ++k)
+                for (int c = 0; c < 4; ++c)
+                    coarse[(size_t(y) * coarseWidth + x) * 4 + c] += Weights[k + 2] * Texel(rows, coarseWidth, height, x, 2 * y + k)[c];
+    return coarse;
+}
+
+static vector<GLfloat> ExpandLevel(const vector<GLfloat>& coarse, int width, int height)
+{
+    static const float EvenWeights[3] = { 1 / 8.0f, 6 / 8.0f, 1 / 8.0f };
+    static const float OddWeights[3] = { 4 / 8.0f, 4 / 8.0f, 0 };
+    const int coarseWidth = (width + 1) / 2, coarseHeight = (height + 1) / 2;
+    vector<GLfloat> expanded(size_t(4) * width * height, 0);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            for (int j = 0; j < 3; ++j)
+                for (int i = 0; i < 3; ++i) {
+                    const float w = (y & 1 ? OddWeights : EvenWeights)[j] * (x & 1 ? OddWeights : EvenWeights)[i];
+                    const GLfloat* texel = Texel(coarse, coarseWidth, coarseHeight, (x + 1) / 2 - 1 + i, (y + 1) / 2 - 1 + j);
+                    for (int c = 0; c < 4; ++c)
+                        expanded[(size_t(y) * width + x) * 4 + c] += w * texel[c];
+                }
+    return expanded;
+}
+
+static float MaxDifference(const GLfloat* a, const GLfloat* b, size_t count)
+{
+    float maxError = 0;
+    for (size_t i = 0; i < count; ++i)
+        maxError = fmaxf(maxError, fabsf(a[i] - b[i]));
+    return maxError;
+}
+
+// Gaussian levels against the host reduce, and the Laplacian bands
+// collapsed from the residual up against the source. Odd sizes exercise the
+// rounded-up levels and the clamped borders.
+static void ComparePyramid(GlPyramidBuilder& Builder)
+{
+    const int Levels = 5;
+    const int SourceWidth = 75, SourceHeight = 50;
+    vector<GLfloat> sourceImage(size_t(4) * SourceWidth * SourceHeight);
+    FillNoise(sourceImage, 12);
+    const ImageView source = MakeImageView(PixelFormat::RGBA32F, SourceWidth, SourceHeight, sourceImage.data());
+
+    printf("\nGL pyramid of a %dx%d RGBA32F image, %d levels...\n", SourceWidth, SourceHeight, Levels);
+    Pyramid gaussian;
+    Builder.Build(source, Levels, false, gaussian);
+    vector<GLfloat> level = sourceImage;
+    float maxError = 0;
+    for (int i = 0; i < Levels; ++i) {
+        const ImageView& view = gaussian.levels[i];
+        if (i > 0)
+            level = ReduceLevel(level, gaussian.levels[i - 1].width, gaussian.levels[i - 1].height);
+        maxError = fmaxf(maxError, MaxDifference((const GLfloat*)view.planes[0], level.data(), level.size()));
+    }
+    printf("...Gaussian levels down to %dx%d, max difference to host %g\n",
+        gaussian.levels.back().width, gaussian.levels.back().height, maxError);
+
+    Pyramid laplacian;
+    Builder.Build(source, Levels, true, laplacian);
+    const ImageView& residual = laplacian.levels.back();
+    const GLfloat* residualSamples = (const GLfloat*)residual.planes[0];
+    level.assign(residualSamples, residualSamples + size_t(4) * residual.width * residual.height);
+    for (int i = Levels - 2; i >= 0; --i) {
+        const ImageView& band = laplacian.levels[i];
+        level = ExpandLevel(level, band.width, band.height);
+        for (size_t j = 0; j < level.size(); ++j)
+            level[j] += ((const GLfloat*)band.planes[0])[j];
+    }
+    maxError = MaxDifference(sourceImage.data(), level.data(), level.size());
+    printf("...Laplacian collapsed on the host, max difference to source %g, %s\n", maxError,
+        maxError < 1e-5f ? "EQUAL" : "DIFFERENT");
+
+    // A source that fits in a texture while its atlas, half again as wide,
+    // does not
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    const int WideWidth = maxSize / 4 * 3;
+    vector<GLfloat> wideImage(size_t(4) * WideWidth * 2);
+    Pyramid wide;
+    const bool built = Builder.Build(MakeImageView(PixelFormat::RGBA32F, WideWidth, 2, wideImage.data()), 2, false, wide);
+    printf("...%dx2 source with an atlas over GL_MAX_TEXTURE_SIZE %d is rejected. Result is %s\n", WideWidth, maxSize,
+        built ? "DIFFERENT" : "EQUAL");
+}
+
+static void PrintEngineCost(const char* name, const EngineCost& cost)
+{
+    printf("%s %.1f us/job %.3f ns/source byte\n", name, cost.jobSeconds * 1e6, cost.sourceByteSeconds * 1e9);
+    const char* formats[] = { "RGBA32F", "float", "8-bit", "16-bit", "sRGB", "Bayer" };
+    for (int format = 0; format < CostFormatCount; ++format) {
+        const double* pixel = cost.pixelSeconds[format];
+        printf("...%-7s ns/source pixel %.2f, ns/pixel nearest %.2f linear %.2f cubic %.2f min %.2f max %.2f hardware linear %.2f\n",
+            formats[format], cost.sourcePixelSeconds[format] * 1e9, pixel[0] * 1e9, pixel[1] * 1e9, pixel[2] * 1e9,
+            pixel[3] * 1e9, pixel[4] * 1e9, cost.hardwareLinearPixelSeconds[format] * 1e9);
+    }
+}
+
+// Calibrates the selector and shows where it would send a few typical jobs.
+static void CalibrateEngineSelection(EngineSelector& Selector)
+{
+    const char* CachePath = "engine_calibration.txt";
+    const bool cached = Selector.Calibrate(CachePath);
+    printf("\nEngine costs for \"%s\", %s %s...\n", Selector.CacheKey().c_str(), cached ? "loaded from" : "measured and saved to", CachePath);
+    PrintEngineCost("GL", Selector.GlCost());
+    PrintEngineCost("CPU", Selector.CpuCost());
+
+    struct Example
+    {
+        PixelFormat format; int size; Filter filter; Sampling sampling;
+        ColorEncoding encoding = ColorEncoding::Linear; BayerPattern bayer = BayerPattern::None;
+    };
+    const Example examples[] = {
+        { PixelFormat::RGBA32F, 3, Filter::Linear, Sampling::Manual },
+        { PixelFormat::R16UI, 64, Filter::Cubic, Sampling::Manual },
+        { PixelFormat::RGBA8, 1024, Filter::Linear, Sampling::Hardware },
+        { PixelFormat::RGBA8, 1024, Filter::Linear, Sampling::Hardware, ColorEncoding::Srgb },
+        { PixelFormat::R16UI, 1024, Filter::Linear, Sampling::Hardware, ColorEncoding::Linear, BayerPattern::RGGB },
+        { PixelFormat::RGBA32F, 2048, Filter::Cubic, Sampling::Manual },
+    };
+    const WarpMesh Mesh = MakeRotationMesh(10, 0.9f);
+    for (auto& example : examples) {
+        WarpJob Job;
+        Job.source = MakeImageView(example.format, example.size, example.size, nullptr);
+        Job.source.encoding = example.encoding;
+        Job.source.bayer = example.bayer;
+        Job.target = MakeImageView(PixelFormat::RGBA32F, example.size, example.size, nullptr);
+        Job.mesh = &Mesh;
+        Job.filter = example.filter;
+        Job.sampling = example.sampling;
+        const char* kind = example.bayer != BayerPattern::None ? " Bayer" : example.encoding == ColorEncoding::Srgb ? " sRGB" : "";
+        printf("...%s%s %dx%d: GL %.3f ms, CPU %.3f ms, runs on %s\n", FormatName(example.format), kind, example.size, example.size,
+            Selector.GlCost().Estimate(Job) * 1e3, Selector.CpuCost().Estimate(Job) * 1e3, Selector.Choose(Job).Name());
+    }
+}
+
+static void FinishTrace(const char* path)
+{
+    if (!path)
+        return;
+    StopTrace();
+    if (WriteTrace(path))
+        printf("\nTrace written to %s\n", path);
+}
+
+int main(int argc, char** argv)
+{
+    bool benchmark = false;
+    const char* tracePath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--benchmark") == 0)
+            benchmark = true;
+        else if (strcmp(argv[i], "--trace") == 0)
+            tracePath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "trace.json";
+    }
+    if (tracePath) {
+        TraceThreadName("main");
+        StartTrace();
+    }
+    const int64_t setupBegin = TraceNow();
+
     const vector<EGLint> EglConfigAttributes(
         {
             EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
@@ -151,22 +1523,41 @@ int main()
             EGL_NONE
         }
     );
-    const vector<float> SourceGrid({ 0, 0, 1, 0, 0, 1, 1, 1 });
-    const vector<float> TargetGrid({ -1, -1, 1, -1, -1, 1, 1, 1 });
-    const vector<GLushort> indexBuffer({ 0, 1, 2, 3, 1, 2 });
-    const vector<GLfloat> sourceImage(
-        {
-             0, 0, 0, -1,  0, 0, 0, -1,     0, 0, 0, -1,
-             0, 0, 0, -1,  -1, -1, -1, -1,  0, 0, 0, -1,
-             0, 0, 0, -1,  0, 0, 0, -1,     0, 0, 0, -1
-        }
-    );
-    vector<GLfloat> targetImage(4 * Width * Height);
-
     int FileDesc = open("/dev/dri/by-path/platform-gpu-card", O_RDWR);
-    struct gbm_device* GbmDevice = gbm_create_device(FileDesc);
-    EGLDisplay eglDisplay = eglGetDisplay(GbmDevice);
-    eglInitialize(eglDisplay, NULL, NULL);
+    struct gbm_device* GbmDevice = FileDesc < 0 ? nullptr : gbm_create_device(FileDesc);
+    EGLDisplay eglDisplay = GbmDevice ? eglGetDisplay(GbmDevice) : EGL_NO_DISPLAY;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, NULL, NULL)) {
+        printf("No usable GPU, falling back to the CPU engine\n");
+        if (GbmDevice)
+            gbm_device_destroy(GbmDevice);
+        if (FileDesc >= 0)
+            close(FileDesc);
+
+        CpuWarpEngine Engine;
+        printf("**** CPU information ****\n");
+        printf("kernels: \"%s\"\n", CpuWarpEngine::KernelsName(Engine.Kernels()));
+        RunComparisons(Engine);
+
+        CpuWarpEngine ScalarEngine(CpuKernels::Scalar);
+        CompareEngines(ScalarEngine, Engine);
+        CompareSampleTypes(Engine);
+        CompareFixedPoint(ScalarEngine, Engine);
+#ifdef WITH_PNG
+        CompareTiledImages();
+#endif
+
+        if (benchmark) {
+            TRACE_SCOPE("benchmarks");
+            BenchmarkCpuScaling();
+            BenchmarkCpuFormats();
+            BenchmarkEtc2();
+#ifdef WITH_PNG
+            BenchmarkTiledImages();
+#endif
+        }
+        FinishTrace(tracePath);
+        return EXIT_SUCCESS;
+    }
     eglBindAPI(EGL_OPENGL_ES_API);
 
     EGLint count = 0;
@@ -189,6 +1580,8 @@ int main()
 
     gladLoadEGLLoader((GLADloadproc)eglGetProcAddress);
     gladLoadGLES2Loader((GLADloadproc)eglGetProcAddress);
+    if (TraceEnabled())
+        TraceRecord("EGL setup", setupBegin, TraceNow());
 
     printf("**** OpenGL information ****\n");
     printf("vendor: \"%s\"\n", glGetString(GL_VENDOR));
@@ -200,111 +1593,66 @@ int main()
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
     glEnable(GL_DEBUG_OUTPUT);
 
-    GLuint Program = LoadShaders(sVertex, sFragment);
-    GLuint LocTextureCoord = glGetAttribLocation(Program, "TextureCoord");
-    GLuint LocClipSpaceCoord = glGetAttribLocation(Program, "ClipSpaceCoord");
-    glUseProgram(Program);
-
-    GLuint SourceGridBuffer;
-    glGenBuffers(1, &SourceGridBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, SourceGridBuffer);
-    glBufferData(GL_ARRAY_BUFFER, SourceGrid.size() * sizeof(float), SourceGrid.data(), GL_STATIC_DRAW);
-
-    GLuint TargetGridBuffer;
-    glGenBuffers(1, &TargetGridBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, TargetGridBuffer);
-    glBufferData(GL_ARRAY_BUFFER, TargetGrid.size() * sizeof(float), TargetGrid.data(), GL_STATIC_DRAW);
-
-    glViewport(0, 0, Width, Height);
-    glClearColor(0, 0, 0, 0);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    GLuint TargetTexture;
-    glGenTextures(1, &TargetTexture);
-    glBindTexture(GL_TEXTURE_2D, TargetTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, Width, Height, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    GLuint Fbo;
-    glGenFramebuffers(1, &Fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TargetTexture, 0);
-
-    GLuint Vao;
-    glGenVertexArrays(1, &Vao);
-    glBindVertexArray(Vao);
-
-    GLuint IndexVertices; // Index buffer 
-    glGenBuffers(1, &IndexVertices);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexVertices);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indexBuffer.size(), indexBuffer.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, SourceGridBuffer);
-    glVertexAttribPointer(LocTextureCoord, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glBindBuffer(GL_ARRAY_BUFFER, TargetGridBuffer);
-    glVertexAttribPointer(LocClipSpaceCoord, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glEnableVertexAttribArray(LocTextureCoord);
-    glEnableVertexAttribArray(LocClipSpaceCoord);
-
-    GLuint SourceTexture;
-    glGenTextures(1, &SourceTexture);
-    glBindTexture(GL_TEXTURE_2D, SourceTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, Width, Height, 0, GL_RGBA, GL_FLOAT, sourceImage.data());
-
-#ifdef WITH_PNG
-    lodepng_encode32_file("SourceTexture.png", (unsigned char*)sourceImage.data(), Width, Height);
-#endif
-
-    glDrawElements(GL_TRIANGLES, indexBuffer.size(), GL_UNSIGNED_SHORT, nullptr);
+    {
+        GlWarpEngine Engine;
+        RunComparisons(Engine);
 
-    glBindTexture(GL_TEXTURE_2D, TargetTexture);
-    glReadPixels(0, 0, Width, Height, GL_RGBA, GL_FLOAT, targetImage.data());
-    /*GLint readFormat, readType;
-    glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &readFormat);
-    glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &readType);
-    printf("0x%04x 0x%04x\n", readFormat, readType);*/
-    glBindTexture(GL_TEXTURE_2D, 0);
+        printf("\nGather against texel fetch kernels on a rotated texture...\n");
+        CompareGatherKernels(Engine, PixelFormat::R32F);
+        CompareGatherKernels(Engine, PixelFormat::RGBA32F);
 
+        CpuWarpEngine CpuEngine;
+        CompareEngines(Engine, CpuEngine);
+        CompareSampleTypes(CpuEngine);
+        CompareFixedPoint(Engine, CpuEngine);
+        CompareRawRotation(Engine, CpuEngine);
+        CompareOutputPacking(Engine);
+        CompareResidentChain(Engine);
+        CompareWarpChain(Engine);
+        CompareSamplePoints(Engine);
+        CompareGradients(Engine);
+        CompareAlignment(Engine);
+        CompareGpuStatistics(Engine, CpuEngine);
+        CompareEtc2(Engine);
+        CompareSrgb(Engine, CpuEngine);
+        CompareBayer(Engine, CpuEngine);
+        CompareStridedViews(Engine);
+        CompareRawImages(Engine);
 #ifdef WITH_PNG
-    lodepng_encode32_file("TargetTexture-Nearest.png", (unsigned char*)targetImage.data(), Width, Height);
+        CompareTiledImages();
 #endif
 
-    printf("\nOne-to-one mapping of a %dx%d texture using...\n", Width, Height);
-    printf("......nearest neighbour. Result is %s\n", sourceImage == targetImage ? "EQUAL" : "DIFFERENT");
-
-    glBindTexture(GL_TEXTURE_2D, SourceTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GlPyramidBuilder PyramidBuilder;
+        ComparePyramid(PyramidBuilder);
 
-    glDrawElements(GL_TRIANGLES, indexBuffer.size(), GL_UNSIGNED_SHORT, nullptr);
-
-    glBindTexture(GL_TEXTURE_2D, TargetTexture);
-    glReadPixels(0, 0, Width, Height, GL_RGBA, GL_FLOAT, targetImage.data());
-    glBindTexture(GL_TEXTURE_2D, 0);
+        EngineSelector Selector(Engine, CpuEngine);
+        CalibrateEngineSelection(Selector);
 
+        if (benchmark) {
+            TRACE_SCOPE("benchmarks");
+            BenchmarkManualBilinear(Engine);
+            BenchmarkGather(Engine);
+            BenchmarkCpuScaling();
+            BenchmarkCpuFormats();
+            BenchmarkEngineSelection(Selector, Engine, CpuEngine);
+            BenchmarkOutputPacking(Engine);
+            BenchmarkResidentChain(Engine);
+            BenchmarkPointSampling(Engine);
+            BenchmarkAlignment(Engine);
+            BenchmarkGpuStatistics(Engine);
+            BenchmarkEtc2();
+            BenchmarkCompressedSources(Engine);
+            BenchmarkSrgb(Engine);
+            BenchmarkBayer(Engine);
+            BenchmarkStridedViews(Engine);
+            BenchmarkRawImages(Engine);
 #ifdef WITH_PNG
-    lodepng_encode32_file("TargetTexture-Linear.png", (unsigned char*)targetImage.data(), Width, Height);
+            BenchmarkTiledImages();
 #endif
-
-    printf("...linear interpolation. Result is %s\n", sourceImage == targetImage ? "EQUAL" : "DIFFERENT");
-
-    glDisableVertexAttribArray(LocTextureCoord);
-    glDisableVertexAttribArray(LocClipSpaceCoord);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
-
-    glDeleteVertexArrays(1, &Vao);
-    glDeleteFramebuffers(1, &Fbo);
-    glDeleteBuffers(1, &IndexVertices);
-    glDeleteTextures(1, &SourceTexture);
-    glDeleteTextures(1, &TargetTexture);
-    glDeleteBuffers(1, &SourceGridBuffer);
-    glDeleteBuffers(1, &TargetGridBuffer);
+            BenchmarkPyramid(PyramidBuilder);
+        }
+    }
+    FinishTrace(tracePath);
 
     eglDestroySurface(eglDisplay, EglSurface);
     gbm_surface_destroy(GbmSurface);
@@ -0,0 +1,221 @@
+#include <stdio.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "lodepng.h"
+#include "png_dump.h"
+#include "trace.h"
+
+using namespace std;
+
+static inline uint32_t ScaleUnorm(float sample, float scale)
+{
+    const float clamped = sample > 0 ? (sample < 1 ? sample : 1) : 0;
+    return uint32_t(clamped * scale + 0.5f);
+}
+
+void PackUnorm8(const float* samples, size_t count, uint8_t* packed)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    // max() returns its second operand for NaN, so NaN clamps to 0
+    auto convert = [&](const float* p) {
+        const __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), zero), one);
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, scale), half));
+    };
+    for (; i + 16 <= count; i += 16) {
+        const __m128i low = _mm_packs_epi32(convert(samples + i), convert(samples + i + 4));
+        const __m128i high = _mm_packs_epi32(convert(samples + i + 8), convert(samples + i + 12));
+        _mm_storeu_si128((__m128i*)(packed + i), _mm_packus_epi16(low, high));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t scale = vdupq_n_f32(255.0f);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    // Float to unsigned conversion turns NaN into 0
+    auto convert = [&](const float* p) {
+        const float32x4_t clamped = vminq_f32(vmaxq_f32(vld1q_f32(p), zero), one);
+        return vmovn_u32(vcvtq_u32_f32(vaddq_f32(vmulq_f32(clamped, scale), half)));
+    };
+    for (; i + 8 <= count; i += 8)
+        vst1_u8(packed + i, vmovn_u16(vcombine_u16(convert(samples + i), convert(samples + i + 4))));
+#endif
+    for (; i < count; ++i)
+        packed[i] = uint8_t(ScaleUnorm(samples[i], 255.0f));
+}
+
+void PackUnorm16BE(const float* samples, size_t count, uint8_t* packed)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(65535.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    // SSE2 only packs with signed saturation, so pack around a bias of 32768
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i flip = _mm_set1_epi16(-32768);
+    auto convert = [&](const float* p) {
+        const __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), zero), one);
+        return _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, scale), half)), bias);
+    };
+    for (; i + 8 <= count; i += 8) {
+        const __m128i words = _mm_xor_si128(_mm_packs_epi32(convert(samples + i), convert(samples + i + 4)), flip);
+        _mm_storeu_si128((__m128i*)(packed + i * 2), _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8)));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t scale = vdupq_n_f32(65535.0f);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    auto convert = [&](const float* p) {
+        const float32x4_t clamped = vminq_f32(vmaxq_f32(vld1q_f32(p), zero), one);
+        return vmovn_u32(vcvtq_u32_f32(vaddq_f32(vmulq_f32(clamped, scale), half)));
+    };
+    for (; i + 8 <= count; i += 8) {
+        const uint16x8_t words = vcombine_u16(convert(samples + i), convert(samples + i + 4));
+        vst1q_u8(packed + i * 2, vrev16q_u8(vreinterpretq_u8_u16(words)));
+    }
+#endif
+    for (; i < count; ++i) {
+        const uint32_t word = ScaleUnorm(samples[i], 65535.0f);
+        packed[i * 2] = uint8_t(word >> 8);
+        packed[i * 2 + 1] = uint8_t(word);
+    }
+}
+
+PngDumper::PngDumper(unsigned threadCount, size_t capacity, HostArena& arena)
+    : capacity(max<size_t>(1, capacity)), arena(arena)
+{
+    for (unsigned i = 0; i < max(1u, threadCount); ++i)
+        workers.emplace_back(&PngDumper::WorkerLoop, this);
+}
+
+PngDumper::~PngDumper()
+{
+    Flush();
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+bool PngDumper::Submit(const string& path, HostBuffer rgba, int width, int height, int bitDepth)
+{
+    return Enqueue({ path, move(rgba), width, height, bitDepth }, true);
+}
+
+bool PngDumper::TrySubmit(const string& path, HostBuffer rgba, int width, int height, int bitDepth)
+{
+    return Enqueue({ path, move(rgba), width, height, bitDepth }, false);
+}
+
+bool PngDumper::Enqueue(Dump&& dump, bool wait)
+{
+    if ((dump.bitDepth != 8 && dump.bitDepth != 16) || dump.rgba.Size() < size_t(dump.width) * dump.height * 4 * sizeof(float))
+        return false;
+
+    {
+        unique_lock<std::mutex> lock(mutex);
+        if (queue.size() >= capacity) {
+            if (!wait) {
+                ++dropped;
+                return false;
+            }
+            dequeued.wait(lock, [this] { return queue.size() < capacity; });
+        }
+        queue.push_back(move(dump));
+    }
+    queued.notify_one();
+    return true;
+}
+
+void PngDumper::Flush()
+{
+    unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return queue.empty() && busy == 0; });
+}
+
+size_t PngDumper::Written() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return written;
+}
+
+size_t PngDumper::Failed() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+size_t PngDumper::Dropped() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return dropped;
+}
+
+void PngDumper::WorkerLoop()
+{
+    TraceThreadName("PNG writer");
+    for (;;) {
+        Dump dump;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            dump = move(queue.front());
+            queue.pop_front();
+            ++busy;
+        }
+        dequeued.notify_one();
+
+        const size_t count = size_t(dump.width) * dump.height * 4;
+        HostBuffer packed = arena.Acquire(count * (dump.bitDepth / 8));
+        bool error = !packed;
+        if (error) {
+            printf("Cannot write %s: out of memory for the packed image\n", dump.path.c_str());
+        } else {
+            {
+                TRACE_SCOPE("PNG pack");
+                if (dump.bitDepth == 16)
+                    PackUnorm16BE(dump.rgba.As<float>(), count, packed.As<uint8_t>());
+                else
+                    PackUnorm8(dump.rgba.As<float>(), count, packed.As<uint8_t>());
+                dump.rgba.Release();
+            }
+            unsigned encodeError;
+            {
+                TRACE_SCOPE("PNG encode");
+                encodeError = lodepng_encode_file(dump.path.c_str(), packed.As<uint8_t>(), dump.width, dump.height, LCT_RGBA,
+                    dump.bitDepth);
+            }
+            error = encodeError != 0;
+            if (error)
+                printf("Cannot write %s: %s\n", dump.path.c_str(), lodepng_error_text(encodeError));
+        }
+
+        {
+            lock_guard<std::mutex> lock(mutex);
+            if (error)
+                ++failed;
+            else
+                ++written;
+            if (--busy == 0 && queue.empty())
+                idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef PNG_DUMP_H
+#define PNG_DUMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "host_buffer.h"
+
+// Clamp float samples to [0, 1] and scale them to 8-bit, or to 16-bit in
+// PNG's big-endian byte order, rounding to nearest. NaN becomes 0.
+void PackUnorm8(const float* samples, size_t count, uint8_t* packed);
+void PackUnorm16BE(const float* samples, size_t count, uint8_t* packed);
+
+// Writes RGBA32F images as 8- or 16-bit RGBA PNG files on background
+// threads, so callers only pay for handing over the buffer; packing buffers
+// come from the arena. At most capacity images wait in the queue; Submit()
+// then waits for a slot while TrySubmit() drops the image, for threads that
+// must never stall.
+class PngDumper
+{
+public:
+    explicit PngDumper(unsigned threadCount = 1, size_t capacity = 4, HostArena& arena = DefaultHostArena());
+
+    // Writes everything still queued.
+    ~PngDumper();
+
+    PngDumper(const PngDumper&) = delete;
+    PngDumper& operator=(const PngDumper&) = delete;
+
+    // rgba holds width * height RGBA float pixels; bitDepth is 8 or 16.
+    bool Submit(const std::string& path, HostBuffer rgba, int width, int height, int bitDepth = 8);
+    bool TrySubmit(const std::string& path, HostBuffer rgba, int width, int height, int bitDepth = 8);
+
+    // Waits until every queued image has been written.
+    void Flush();
+
+    size_t Written() const;
+    size_t Failed() const;
+    size_t Dropped() const;
+
+private:
+    struct Dump
+    {
+        std::string path;
+        HostBuffer rgba;
+        int width;
+        int height;
+        int bitDepth;
+    };
+
+    bool Enqueue(Dump&& dump, bool wait);
+    void WorkerLoop();
+
+    const size_t capacity;
+    HostArena& arena;
+    std::vector<std::thread> workers;
+
+    mutable std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable dequeued;
+    std::condition_variable idle;
+    std::deque<Dump> queue;
+    unsigned busy = 0;
+    size_t written = 0;
+    size_t failed = 0;
+    size_t dropped = 0;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <utility>
+
+#include "raw_image.h"
+#include "trace.h"
+
+using namespace std;
+
+static_assert(sizeof(RawImageHeader) == 64, "planes are laid out after a 64-byte header");
+
+static const uint32_t ByteOrder = 0x01020304;
+static const uint32_t Version = 1;
+static const size_t PlaneAlignment = 64;
+
+// Packed planes after the header, each on a 64-byte boundary. Sizes come
+// from files too, so the plane sizes are multiplied out with overflow
+// checks; the file must also fit in the address space to be mapped.
+static bool LayOut(RawImageHeader& header)
+{
+    if (header.width <= 0 || header.height <= 0)
+        return false;
+    const PixelFormat format = PixelFormat(header.format);
+    uint64_t offset = sizeof(RawImageHeader);
+    for (int plane = 0; plane < 3; ++plane) {
+        header.rowLengths[plane] = 0;
+        header.planeOffsets[plane] = 0;
+        if (plane >= PlaneCount(format))
+            continue;
+        int w, h;
+        PlaneSize(format, plane, header.width, header.height, w, h);
+        offset = (offset + PlaneAlignment - 1) / PlaneAlignment * PlaneAlignment;
+        if (offset > UINT32_MAX)
+            return false;
+        header.rowLengths[plane] = w;
+        header.planeOffsets[plane] = uint32_t(offset);
+        const uint64_t pixels = uint64_t(w) * uint64_t(h);
+        const uint64_t pixelBytes = PlaneBytes(format, plane, 1, 1);
+        if (pixels > (UINT64_MAX - offset) / pixelBytes)
+            return false;
+        offset += pixels * pixelBytes;
+    }
+    if (offset > SIZE_MAX)
+        return false;
+    header.fileSize = offset;
+    return true;
+}
+
+static bool ValidFormat(uint32_t format)
+{
+    return format <= uint32_t(PixelFormat::RGB32F);
+}
+
+RawImageFile::RawImageFile(RawImageFile&& other) noexcept
+    : mapping(other.mapping), size(other.size), view(other.view)
+{
+    other.mapping = nullptr;
+    other.size = 0;
+    other.view = ImageView();
+}
+
+RawImageFile& RawImageFile::operator=(RawImageFile&& other) noexcept
+{
+    if (this != &other) {
+        Close();
+        swap(mapping, other.mapping);
+        swap(size, other.size);
+        swap(view, other.view);
+    }
+    return *this;
+}
+
+RawImageFile::~RawImageFile()
+{
+    Close();
+}
+
+bool RawImageFile::Create(const char* path, PixelFormat format, int width, int height, ColorEncoding encoding, BayerPattern bayer)
+{
+    Close();
+    RawImageHeader header = {};
+    memcpy(header.magic, "RAWI", 4);
+    header.byteOrder = ByteOrder;
+    header.version = Version;
+    header.format = uint32_t(format);
+    header.width = width;
+    header.height = height;
+    header.encoding = uint32_t(encoding);
+    header.bayer = uint32_t(bayer);
+    if (!LayOut(header))
+        return false;
+
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, off_t(header.fileSize)) == 0)
+        data = mmap(nullptr, header.fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    memcpy(data, &header, sizeof(header));
+    mapping = data;
+    size = header.fileSize;
+    view = MakeImageView(format, width, height, nullptr);
+    view.encoding = encoding;
+    view.bayer = bayer;
+    for (int plane = 0; plane < PlaneCount(format); ++plane)
+        view.planes[plane] = (uint8_t*)data + header.planeOffsets[plane];
+    return true;
+}
+
+bool RawImageFile::Open(const char* path)
+{
+    Close();
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(RawImageHeader))
+        data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    // The stored layout must be the one Create() writes, within the file
+    const RawImageHeader& header = *(const RawImageHeader*)data;
+    RawImageHeader expected = header;
+    const bool valid = memcmp(header.magic, "RAWI", 4) == 0 && header.byteOrder == ByteOrder && header.version == Version &&
+        ValidFormat(header.format) && header.encoding <= uint32_t(ColorEncoding::Srgb) &&
+        header.bayer <= uint32_t(BayerPattern::GBRG) && LayOut(expected) &&
+        memcmp(&expected, &header, sizeof(header)) == 0 && header.fileSize <= uint64_t(info.st_size);
+    if (!valid) {
+        munmap(data, info.st_size);
+        return false;
+    }
+
+    mapping = data;
+    size = info.st_size;
+    view = MakeImageView(PixelFormat(header.format), header.width, header.height, nullptr);
+    view.encoding = ColorEncoding(header.encoding);
+    view.bayer = BayerPattern(header.bayer);
+    for (int plane = 0; plane < PlaneCount(view.format); ++plane)
+        view.planes[plane] = (uint8_t*)data + header.planeOffsets[plane];
+    return true;
+}
+
+void RawImageFile::Close()
+{
+    if (mapping)
+        munmap(mapping, size);
+    mapping = nullptr;
+    size = 0;
+    view = ImageView();
+}
+
+bool WriteRawImage(const char* path, const ImageView& image)
+{
+    TRACE_SCOPE("raw image write");
+    RawImageFile file;
+    if (!file.Create(path, image.format, image.width, image.height, image.encoding, image.bayer))
+        return false;
+
+    const ImageView& target = file.View();
+    for (int plane = 0; plane < PlaneCount(image.format); ++plane) {
+        int w, h;
+        PlaneSize(image.format, plane, image.width, image.height, w, h);
+        const size_t pixelBytes = PlaneBytes(image.format, plane, 1, 1);
+        const size_t rowBytes = w * pixelBytes;
+        const size_t strideBytes = RowLength(image, plane) * pixelBytes;
+        if (strideBytes == rowBytes) {
+            memcpy(target.planes[plane], image.planes[plane], rowBytes * h);
+            continue;
+        }
+        for (int y = 0; y < h; ++y)
+            memcpy((uint8_t*)target.planes[plane] + y * rowBytes, (const uint8_t*)image.planes[plane] + y * strideBytes, rowBytes);
+    }
+    return true;
+}
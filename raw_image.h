@@ -0,0 +1,67 @@
+#ifndef RAW_IMAGE_H
+#define RAW_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+
+// Uncompressed image files for intermediate dumps: any PixelFormat stored
+// as is, so RGBA32F keeps full precision and writing costs no more than the
+// copy. A 64-byte header gives the format, size, row length and offset of
+// each plane; planes start on 64-byte boundaries. Samples are in host byte
+// order and files from a host of the other order are rejected.
+struct RawImageHeader
+{
+    char magic[4];              // "RAWI"
+    uint32_t byteOrder;         // 0x01020304 as written by the host
+    uint32_t version;
+    uint32_t format;            // PixelFormat
+    int32_t width;
+    int32_t height;
+    uint32_t encoding;          // ColorEncoding
+    uint32_t bayer;             // BayerPattern
+    int32_t rowLengths[3];      // pixels, at least the plane width
+    uint32_t planeOffsets[3];   // bytes from the start of the file
+    uint64_t fileSize;
+};
+
+// The file is mapped rather than read or written through a buffer: a
+// created file is sized up front and its view points into the mapping, so
+// GlWarpEngine::Readback() writes pixels straight to the page cache, and an
+// opened file's view can be uploaded without a copy. Move-only; closing
+// unmaps, and the kernel writes dirty pages back in its own time.
+class RawImageFile
+{
+public:
+    RawImageFile() = default;
+    RawImageFile(RawImageFile&& other) noexcept;
+    RawImageFile& operator=(RawImageFile&& other) noexcept;
+    ~RawImageFile();
+
+    RawImageFile(const RawImageFile&) = delete;
+    RawImageFile& operator=(const RawImageFile&) = delete;
+
+    // Creates or truncates path for a packed image, mapped for writing.
+    // The pixels start out zero.
+    bool Create(const char* path, PixelFormat format, int width, int height,
+        ColorEncoding encoding = ColorEncoding::Linear, BayerPattern bayer = BayerPattern::None);
+
+    // Maps an existing file read-only after validating its header.
+    bool Open(const char* path);
+
+    void Close();
+
+    const ImageView& View() const { return view; }
+    explicit operator bool() const { return mapping != nullptr; }
+
+private:
+    void* mapping = nullptr;
+    size_t size = 0;
+    ImageView view;
+};
+
+// Writes image, which may be strided, in one go through a mapped file.
+bool WriteRawImage(const char* path, const ImageView& image);
+
+#endif
@@ -0,0 +1,130 @@
+#include "thread_pool.h"
+#include "trace.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+    if (threadCount == 0)
+        threadCount = max(1u, thread::hardware_concurrency());
+
+    for (unsigned i = 0; i < threadCount; ++i)
+        ranges.emplace_back(new Range);
+    for (unsigned i = 1; i < threadCount; ++i)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::Run(size_t count, const function<void(size_t, unsigned)>& task)
+{
+    if (count == 0)
+        return;
+
+    const size_t threads = ranges.size();
+    for (size_t i = 0; i < threads; ++i) {
+        lock_guard<std::mutex> lock(ranges[i]->mutex);
+        ranges[i]->begin = count * i / threads;
+        ranges[i]->end = count * (i + 1) / threads;
+    }
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        busy = unsigned(workers.size());
+        ++generation;
+    }
+    wake.notify_all();
+
+    Work(0);
+
+    unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    this->task = nullptr;
+}
+
+bool ThreadPool::Pop(unsigned thread, size_t& index)
+{
+    Range& range = *ranges[thread];
+    lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin == range.end)
+        return false;
+    index = range.begin++;
+    return true;
+}
+
+bool ThreadPool::Steal(unsigned thread)
+{
+    // Victim with the most work left
+    unsigned victim = thread;
+    size_t largest = 0;
+    for (unsigned i = 0; i < ranges.size(); ++i) {
+        if (i == thread)
+            continue;
+        lock_guard<std::mutex> lock(ranges[i]->mutex);
+        const size_t size = ranges[i]->end - ranges[i]->begin;
+        if (size > largest) {
+            largest = size;
+            victim = i;
+        }
+    }
+    if (victim == thread)
+        return false;
+
+    size_t begin, end;
+    {
+        Range& range = *ranges[victim];
+        lock_guard<std::mutex> lock(range.mutex);
+        if (range.begin == range.end)
+            return true;
+        end = range.end;
+        begin = range.end - (range.end - range.begin + 1) / 2;
+        range.end = begin;
+    }
+    Range& own = *ranges[thread];
+    lock_guard<std::mutex> lock(own.mutex);
+    own.begin = begin;
+    own.end = end;
+    return true;
+}
+
+void ThreadPool::Work(unsigned thread)
+{
+    for (;;) {
+        size_t index;
+        if (Pop(thread, index))
+            (*task)(index, thread);
+        else if (!Steal(thread))
+            break;
+    }
+}
+
+void ThreadPool::WorkerLoop(unsigned thread)
+{
+    TraceThreadName("pool " + to_string(thread));
+    unsigned seen = 0;
+    for (;;) {
+        {
+            unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        Work(thread);
+
+        lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0)
+            done.notify_one();
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running batches of indexed tasks. A batch is split
+// into contiguous ranges, one per thread, so neighbouring tasks run on the
+// same thread; a thread that runs out steals the far half of the largest
+// remaining range.
+class ThreadPool
+{
+public:
+    // threadCount 0 uses one thread per hardware thread. The thread calling
+    // Run() counts as one of them.
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned ThreadCount() const { return unsigned(ranges.size()); }
+
+    // Calls task(index, thread) for every index in [0, count) and returns
+    // once all calls have finished; thread is in [0, ThreadCount()).
+    void Run(size_t count, const std::function<void(size_t, unsigned)>& task);
+
+private:
+    struct Range
+    {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    bool Pop(unsigned thread, size_t& index);
+    bool Steal(unsigned thread);
+    void Work(unsigned thread);
+    void WorkerLoop(unsigned thread);
+
+    std::vector<std::unique_ptr<Range>> ranges;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t, unsigned)>* task = nullptr;
+    unsigned generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "lodepng.h"
+#include "tiled_image.h"
+#include "trace.h"
+
+using namespace std;
+
+static_assert(sizeof(TiledImageHeader) == 32, "the index follows a 32-byte header");
+
+static const uint32_t ByteOrder = 0x01020304;
+static const uint32_t Version = 1;
+
+struct TileRect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+static TileRect TileAt(const TiledImageHeader& header, size_t tile)
+{
+    const int tilesX = (header.width + header.tileSize - 1) / header.tileSize;
+    TileRect rect;
+    rect.x = int(tile % tilesX) * header.tileSize;
+    rect.y = int(tile / tilesX) * header.tileSize;
+    rect.width = min(header.tileSize, header.width - rect.x);
+    rect.height = min(header.tileSize, header.height - rect.y);
+    return rect;
+}
+
+static size_t CountTiles(int width, int height, int tileSize)
+{
+    return size_t((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+}
+
+// Single-plane formats; the GL-only layouts have no host samples to store
+static bool IsSupportedFormat(uint32_t format)
+{
+    return format <= uint32_t(PixelFormat::RGB32F) && PlaneCount(PixelFormat(format)) == 1;
+}
+
+// The rows of rect gathered from image with the bytes of each sample split
+// into planes, and back
+static void ShuffleTile(const ImageView& image, const TileRect& rect, uint8_t* shuffled)
+{
+    const size_t sampleBytes = SampleBytes(FormatSampleType(image.format));
+    const size_t channels = ChannelCount(image.format);
+    const size_t rowSamples = size_t(rect.width) * channels;
+    const size_t samples = rowSamples * rect.height;
+    const size_t strideBytes = PlaneBytes(image.format, 0, RowLength(image, 0), 1);
+    for (int y = 0; y < rect.height; ++y) {
+        const uint8_t* row = (const uint8_t*)image.planes[0] + size_t(rect.y + y) * strideBytes + rect.x * channels * sampleBytes;
+        uint8_t* target = shuffled + y * rowSamples;
+        for (size_t i = 0; i < rowSamples; ++i)
+            for (size_t b = 0; b < sampleBytes; ++b)
+                target[b * samples + i] = row[i * sampleBytes + b];
+    }
+}
+
+static void UnshuffleTile(const uint8_t* shuffled, const TileRect& tile, const TileRect& region, int x0, int y0,
+    const ImageView& target)
+{
+    const size_t sampleBytes = SampleBytes(FormatSampleType(target.format));
+    const size_t channels = ChannelCount(target.format);
+    const size_t samples = size_t(tile.width) * tile.height * channels;
+    const size_t strideBytes = PlaneBytes(target.format, 0, RowLength(target, 0), 1);
+    for (int y = region.y; y < region.y + region.height; ++y) {
+        uint8_t* row = (uint8_t*)target.planes[0] + size_t(y - y0) * strideBytes + size_t(region.x - x0) * channels * sampleBytes;
+        const size_t first = (size_t(y - tile.y) * tile.width + (region.x - tile.x)) * channels;
+        for (size_t i = 0; i < size_t(region.width) * channels; ++i)
+            for (size_t b = 0; b < sampleBytes; ++b)
+                row[i * sampleBytes + b] = shuffled[b * samples + first + i];
+    }
+}
+
+static void RunTasks(size_t count, ThreadPool* pool, const function<void(size_t, unsigned)>& task)
+{
+    if (pool)
+        pool->Run(count, task);
+    else
+        for (size_t i = 0; i < count; ++i)
+            task(i, 0);
+}
+
+bool WriteTiledImage(const char* path, const ImageView& image, int tileSize, ThreadPool* pool)
+{
+    if (!IsSupportedFormat(uint32_t(image.format)) || image.width <= 0 || image.height <= 0 || tileSize <= 0 ||
+        !image.planes[0])
+        return false;
+
+    TRACE_SCOPE("tiled image write");
+    TiledImageHeader header = {};
+    memcpy(header.magic, "TILI", 4);
+    header.byteOrder = ByteOrder;
+    header.version = Version;
+    header.format = uint32_t(image.format);
+    header.width = image.width;
+    header.height = image.height;
+    header.tileSize = tileSize;
+    header.tileCount = uint32_t(CountTiles(image.width, image.height, tileSize));
+
+    // Streams come back from LodePNG in malloc'ed buffers
+    vector<uint8_t*> streams(header.tileCount, nullptr);
+    vector<size_t> sizes(header.tileCount, 0);
+    atomic<bool> failed(false);
+    RunTasks(header.tileCount, pool, [&](size_t tile, unsigned) {
+        const TileRect rect = TileAt(header, tile);
+        vector<uint8_t> shuffled(PlaneBytes(image.format, 0, rect.width, rect.height));
+        ShuffleTile(image, rect, shuffled.data());
+        if (lodepng_zlib_compress(&streams[tile], &sizes[tile], shuffled.data(), shuffled.size(), &lodepng_default_compress_settings))
+            failed = true;
+    });
+
+    bool written = false;
+    if (!failed) {
+        vector<TiledImageEntry> index(header.tileCount);
+        uint64_t offset = sizeof(header) + index.size() * sizeof(TiledImageEntry);
+        for (size_t tile = 0; tile < index.size(); ++tile) {
+            index[tile].offset = offset;
+            index[tile].bytes = sizes[tile];
+            offset += sizes[tile];
+        }
+        if (FILE* file = fopen(path, "wb")) {
+            written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                fwrite(index.data(), sizeof(TiledImageEntry), index.size(), file) == index.size();
+            for (size_t tile = 0; written && tile < index.size(); ++tile)
+                written = fwrite(streams[tile], 1, sizes[tile], file) == sizes[tile];
+            written = fclose(file) == 0 && written;
+        }
+    }
+    for (uint8_t* stream : streams)
+        free(stream);
+    return written;
+}
+
+TiledImageReader::~TiledImageReader()
+{
+    Close();
+}
+
+bool TiledImageReader::Open(const char* path)
+{
+    Close();
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    bool valid = fstat(fd, &info) == 0 && pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)) &&
+        memcmp(header.magic, "TILI", 4) == 0 && header.byteOrder == ByteOrder && header.version == Version &&
+        IsSupportedFormat(header.format) && header.width > 0 && header.height > 0 && header.tileSize > 0 &&
+        header.tileCount == CountTiles(header.width, header.height, header.tileSize);
+    if (valid) {
+        index.resize(header.tileCount);
+        const ssize_t indexBytes = ssize_t(index.size() * sizeof(TiledImageEntry));
+        valid = pread(fd, index.data(), indexBytes, sizeof(header)) == indexBytes;
+        for (size_t tile = 0; valid && tile < index.size(); ++tile)
+            valid = index[tile].offset <= uint64_t(info.st_size) && index[tile].bytes <= uint64_t(info.st_size) - index[tile].offset;
+    }
+    if (!valid)
+        Close();
+    return valid;
+}
+
+void TiledImageReader::Close()
+{
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    header = TiledImageHeader();
+    index.clear();
+}
+
+bool TiledImageReader::ReadRegion(int x, int y, const ImageView& target, ThreadPool* pool, size_t* tiles)
+{
+    if (fd < 0 || target.format != Format() || x < 0 || y < 0 || target.width <= 0 || target.height <= 0 ||
+        x + target.width > Width() || y + target.height > Height() || RowLength(target, 0) < target.width)
+        return false;
+
+    TRACE_SCOPE("tiled image read");
+    const int tilesX = (Width() + TileSize() - 1) / TileSize();
+    const int firstX = x / TileSize(), lastX = (x + target.width - 1) / TileSize();
+    const int firstY = y / TileSize(), lastY = (y + target.height - 1) / TileSize();
+    const int columns = lastX - firstX + 1;
+    const size_t count = size_t(columns) * (lastY - firstY + 1);
+    if (tiles)
+        *tiles = count;
+
+    atomic<bool> failed(false);
+    RunTasks(count, pool, [&](size_t task, unsigned) {
+        const size_t tile = size_t(firstY + int(task) / columns) * tilesX + firstX + int(task) % columns;
+        const TileRect rect = TileAt(header, tile);
+        const TiledImageEntry& entry = index[tile];
+        vector<uint8_t> stream(entry.bytes);
+        uint8_t* shuffled = nullptr;
+        size_t size = 0;
+        if (pread(fd, stream.data(), stream.size(), entry.offset) != ssize_t(stream.size()) ||
+            lodepng_zlib_decompress(&shuffled, &size, stream.data(), stream.size(), &lodepng_default_decompress_settings) ||
+            size != PlaneBytes(Format(), 0, rect.width, rect.height)) {
+            failed = true;
+        } else {
+            TileRect region;
+            region.x = max(rect.x, x);
+            region.y = max(rect.y, y);
+            region.width = min(rect.x + rect.width, x + target.width) - region.x;
+            region.height = min(rect.y + rect.height, y + target.height) - region.y;
+            UnshuffleTile(shuffled, rect, region, x, y, target);
+        }
+        free(shuffled);
+    });
+    return !failed;
+}
@@ -0,0 +1,77 @@
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "image.h"
+#include "thread_pool.h"
+
+// Lossless archive of a single-plane image cut into square tiles, each a
+// separate zlib stream from LodePNG, so tiles compress and decompress in
+// parallel and a region decodes only the tiles it overlaps. Before
+// compression a tile's samples are shuffled into byte planes, all first
+// bytes, then all second bytes and so on: the sign and exponent bytes of
+// smooth float data repeat and deflate well once they are adjacent.
+//
+// File layout: a 32-byte header, an index of (offset, size) pairs in row
+// order of tiles, then the streams. Samples are in host byte order and
+// files from a host of the other order are rejected.
+struct TiledImageHeader
+{
+    char magic[4];          // "TILI"
+    uint32_t byteOrder;     // 0x01020304 as written by the host
+    uint32_t version;
+    uint32_t format;        // PixelFormat
+    int32_t width;
+    int32_t height;
+    int32_t tileSize;       // edge tiles are cut to the image
+    uint32_t tileCount;
+};
+
+struct TiledImageEntry
+{
+    uint64_t offset;        // bytes from the start of the file
+    uint64_t bytes;
+};
+
+// Compresses the tiles of image, which may be strided, over pool when
+// given, and writes the file.
+bool WriteTiledImage(const char* path, const ImageView& image, int tileSize = 256, ThreadPool* pool = nullptr);
+
+// Reads tiles with pread() on one descriptor, so ReadRegion() can decode
+// them on several threads.
+class TiledImageReader
+{
+public:
+    TiledImageReader() = default;
+    ~TiledImageReader();
+
+    TiledImageReader(const TiledImageReader&) = delete;
+    TiledImageReader& operator=(const TiledImageReader&) = delete;
+
+    // Reads and checks the header and index.
+    bool Open(const char* path);
+    void Close();
+
+    PixelFormat Format() const { return PixelFormat(header.format); }
+    int Width() const { return header.width; }
+    int Height() const { return header.height; }
+    int TileSize() const { return header.tileSize; }
+    size_t TileCount() const { return index.size(); }
+
+    // Decodes the region at (x, y) of target's size into target, which has
+    // the file's format and may be strided, over pool when given. tiles, if
+    // given, receives the number of tiles decoded. Fails if the region
+    // leaves the image or a tile is damaged.
+    bool ReadRegion(int x, int y, const ImageView& target, ThreadPool* pool = nullptr, size_t* tiles = nullptr);
+
+private:
+    int fd = -1;
+    TiledImageHeader header = {};
+    std::vector<TiledImageEntry> index;
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include <stdio.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "glad/glad.h"
+#include "trace.h"
+
+using namespace std;
+
+atomic<bool> traceEnabled(false);
+
+struct TraceEvent
+{
+    const char* name;
+    int64_t begin;
+    int64_t end;
+};
+
+// Written only by its thread; head counts every event ever recorded, so
+// the newest events.size() of them are kept.
+struct TraceRing
+{
+    unsigned thread = 0;
+    string name;
+    vector<TraceEvent> events;
+    atomic<size_t> head{0};
+};
+
+static mutex ringsMutex;
+static vector<unique_ptr<TraceRing>> rings;
+static size_t ringCapacity = 1 << 16;
+static thread_local TraceRing* threadRing = nullptr;
+static thread_local string threadName;
+
+int64_t TraceNow()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static TraceRing& ThreadRing()
+{
+    if (!threadRing) {
+        lock_guard<mutex> lock(ringsMutex);
+        rings.emplace_back(new TraceRing);
+        threadRing = rings.back().get();
+        threadRing->thread = unsigned(rings.size());
+        threadRing->name = threadName;
+        threadRing->events.resize(ringCapacity);
+    }
+    return *threadRing;
+}
+
+void TraceRecord(const char* name, int64_t begin, int64_t end)
+{
+    TraceRing& ring = ThreadRing();
+    const size_t head = ring.head.load(memory_order_relaxed);
+    ring.events[head & (ring.events.size() - 1)] = { name, begin, end };
+    ring.head.store(head + 1, memory_order_release);
+}
+
+void TraceThreadName(const string& name)
+{
+    threadName = name;
+    if (threadRing) {
+        lock_guard<mutex> lock(ringsMutex);
+        threadRing->name = name;
+    }
+}
+
+// GPU spans are two timestamp queries each, resolved in issue order. GPU
+// time is mapped to TraceNow() with an offset taken once per trace.
+struct GpuSpan
+{
+    const char* name;
+    GLuint queries[2];
+    bool ended;
+};
+
+static const size_t MaxGpuSpans = 1024;
+static map<int, GpuSpan> gpuSpans;
+static int nextGpuSpan = 0;
+static vector<GLuint> freeQueries;
+static vector<TraceEvent> gpuEvents;
+static bool gpuOffsetKnown = false;
+static int64_t gpuOffset = 0;
+
+static bool GpuTimersAvailable()
+{
+    return GLAD_GL_EXT_disjoint_timer_query && glQueryCounterEXT && glGetQueryObjectui64vEXT;
+}
+
+static GLuint AcquireQuery()
+{
+    if (freeQueries.empty()) {
+        GLuint queries[16];
+        glGenQueriesEXT(16, queries);
+        freeQueries.assign(queries, queries + 16);
+    }
+    const GLuint query = freeQueries.back();
+    freeQueries.pop_back();
+    return query;
+}
+
+GpuTraceScope::GpuTraceScope(const char* name)
+{
+    if (!TraceEnabled() || !GpuTimersAvailable() || gpuSpans.size() >= MaxGpuSpans)
+        return;
+    span = nextGpuSpan++;
+    GpuSpan& gpuSpan = gpuSpans[span];
+    gpuSpan = { name, { AcquireQuery(), AcquireQuery() }, false };
+    glQueryCounterEXT(gpuSpan.queries[0], GL_TIMESTAMP_EXT);
+}
+
+GpuTraceScope::~GpuTraceScope()
+{
+    if (span < 0)
+        return;
+    auto gpuSpan = gpuSpans.find(span);
+    if (gpuSpan == gpuSpans.end())
+        return;
+    glQueryCounterEXT(gpuSpan->second.queries[1], GL_TIMESTAMP_EXT);
+    gpuSpan->second.ended = true;
+}
+
+void TraceCollectGpu()
+{
+    if (!GpuTimersAvailable())
+        return;
+
+    if (!gpuOffsetKnown) {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP_EXT, &gpuNow);
+        gpuOffset = TraceNow() - gpuNow;
+        gpuOffsetKnown = true;
+    }
+
+    // Spans finish in order, so stop at the first one still running
+    vector<TraceEvent> resolved;
+    while (!gpuSpans.empty()) {
+        GpuSpan& span = gpuSpans.begin()->second;
+        GLuint available = 0;
+        if (span.ended)
+            glGetQueryObjectuivEXT(span.queries[1], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available)
+            break;
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64vEXT(span.queries[0], GL_QUERY_RESULT_EXT, &begin);
+        glGetQueryObjectui64vEXT(span.queries[1], GL_QUERY_RESULT_EXT, &end);
+        resolved.push_back({ span.name, int64_t(begin) + gpuOffset, int64_t(end) + gpuOffset });
+        freeQueries.push_back(span.queries[0]);
+        freeQueries.push_back(span.queries[1]);
+        gpuSpans.erase(gpuSpans.begin());
+    }
+
+    // Timestamps are meaningless across a disjoint event such as a clock
+    // change, so drop the batch
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (!disjoint)
+        gpuEvents.insert(gpuEvents.end(), resolved.begin(), resolved.end());
+}
+
+// Threads write their rings without the lock, so rings are never resized
+// once they exist; restarting only forgets the recorded events.
+void StartTrace(size_t eventsPerThread)
+{
+    size_t capacity = 1;
+    while (capacity < eventsPerThread)
+        capacity *= 2;
+
+    {
+        lock_guard<mutex> lock(ringsMutex);
+        if (rings.empty())
+            ringCapacity = capacity;
+        for (auto& ring : rings)
+            ring->head.store(0, memory_order_relaxed);
+    }
+    gpuEvents.clear();
+    gpuOffsetKnown = false;
+    traceEnabled.store(true);
+}
+
+void StopTrace()
+{
+    traceEnabled.store(false);
+}
+
+// Writes text as the contents of a JSON string.
+static void WriteEscaped(FILE* file, const char* text)
+{
+    for (const char* c = text; *c; ++c) {
+        if ((unsigned char)*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+            continue;
+        }
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+        fputc(*c, file);
+    }
+}
+
+// Follows the thread_name metadata event, which always comes first.
+static void WriteEvent(FILE* file, const char* name, unsigned thread, int64_t begin, int64_t end)
+{
+    fprintf(file, ",\n{\"name\":\"");
+    WriteEscaped(file, name);
+    fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", thread, begin / 1000.0, (end - begin) / 1000.0);
+}
+
+bool WriteTrace(const char* path)
+{
+    TraceCollectGpu();
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Cannot write trace to %s\n", path);
+        return false;
+    }
+
+    // The GPU track is thread 0, CPU threads are numbered from 1
+    fprintf(file, "{\"traceEvents\":[");
+    fprintf(file, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+    for (auto& event : gpuEvents)
+        WriteEvent(file, event.name, 0, event.begin, event.end);
+
+    lock_guard<mutex> lock(ringsMutex);
+    for (auto& ring : rings) {
+        const string name = ring->name.empty() ? "thread " + to_string(ring->thread) : ring->name;
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", ring->thread);
+        WriteEscaped(file, name.c_str());
+        fprintf(file, "\"}}");
+
+        const size_t head = ring->head.load(memory_order_acquire);
+        const size_t size = ring->events.size();
+        for (size_t i = head > size ? head - size : 0; i < head; ++i) {
+            const TraceEvent& event = ring->events[i & (size - 1)];
+            WriteEvent(file, event.name, ring->thread, event.begin, event.end);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
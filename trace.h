@@ -0,0 +1,85 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+// Optional tracer writing Chrome trace-event JSON, which chrome://tracing
+// and ui.perfetto.dev open. Spans are recorded into a ring per thread, so
+// recording takes no lock and keeps the newest eventsPerThread spans. When
+// tracing is off a span costs one relaxed atomic load.
+//
+// Span names must outlive the trace, i.e. be string literals.
+
+extern std::atomic<bool> traceEnabled;
+
+inline bool TraceEnabled()
+{
+    return traceEnabled.load(std::memory_order_relaxed);
+}
+
+// Nanoseconds on the steady clock.
+int64_t TraceNow();
+
+// Clears the recorded spans and starts recording. eventsPerThread is
+// rounded up to a power of two and applies until the first thread records.
+void StartTrace(size_t eventsPerThread = 1 << 16);
+void StopTrace();
+
+// Names the calling thread in the trace.
+void TraceThreadName(const std::string& name);
+
+void TraceRecord(const char* name, int64_t begin, int64_t end);
+
+// Resolves finished GPU spans; call on the GL thread now and then, e.g.
+// once per frame, so the query pool does not run dry.
+void TraceCollectGpu();
+
+// Collects pending GPU spans and writes everything recorded so far. Other
+// threads must not be recording while it runs.
+bool WriteTrace(const char* path);
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : name(TraceEnabled() ? name : nullptr), begin(this->name ? TraceNow() : 0) {}
+    ~TraceScope()
+    {
+        if (name)
+            TraceRecord(name, begin, TraceNow());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    int64_t begin;
+};
+
+// GPU execution time of the GL commands issued in its scope, measured with
+// EXT_disjoint_timer_query timestamps and shown on a separate GPU track.
+// Does nothing without the extension. GL thread only.
+class GpuTraceScope
+{
+public:
+    explicit GpuTraceScope(const char* name);
+    ~GpuTraceScope();
+
+    GpuTraceScope(const GpuTraceScope&) = delete;
+    GpuTraceScope& operator=(const GpuTraceScope&) = delete;
+
+private:
+    int span = -1;
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_JOIN(traceScope, __LINE__)(name)
+#define GPU_TRACE_SCOPE(name) GpuTraceScope TRACE_JOIN(gpuTraceScope, __LINE__)(name)
+
+#endif
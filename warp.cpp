@@ -0,0 +1,85 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "warp.h"
+
+WarpMesh MakeAffineMesh(const float m[6])
+{
+    WarpMesh mesh;
+    const float corners[8] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+    for (int i = 0; i < 4; ++i) {
+        const float u = corners[i * 2];
+        const float v = corners[i * 2 + 1];
+        mesh.sourceGrid.push_back(m[0] * u + m[1] * v + m[2]);
+        mesh.sourceGrid.push_back(m[3] * u + m[4] * v + m[5]);
+        mesh.targetGrid.push_back(u * 2 - 1);
+        mesh.targetGrid.push_back(v * 2 - 1);
+    }
+    mesh.indices = { 0, 1, 2, 3, 1, 2 };
+    return mesh;
+}
+
+WarpMesh MakeRotationMesh(float degrees, float scale)
+{
+    const float angle = degrees * 3.14159265f / 180.0f;
+    const float c = scale * cosf(angle);
+    const float s = scale * sinf(angle);
+    const float m[6] = { c, -s, 0.5f - 0.5f * (c - s), s, c, 0.5f - 0.5f * (s + c) };
+    return MakeAffineMesh(m);
+}
+
+static const size_t MaxGridVertices = 65536;
+
+WarpMesh MakeGridMesh(int columns, int rows, const std::function<void(float u, float v, float& su, float& sv)>& map)
+{
+    columns = std::max(columns, 1);
+    rows = std::max(rows, 1);
+    const double vertices = double(columns + 1) * (rows + 1);
+    if (vertices > MaxGridVertices) {
+        const double scale = sqrt(MaxGridVertices / vertices);
+        columns = std::max(int((columns + 1) * scale) - 1, 1);
+        rows = std::max(int((rows + 1) * scale) - 1, 1);
+        // A side held at one cell leaves the other to shrink further
+        if (columns > rows)
+            columns = std::min(columns, int(MaxGridVertices / (rows + 1)) - 1);
+        else
+            rows = std::min(rows, int(MaxGridVertices / (columns + 1)) - 1);
+    }
+
+    WarpMesh mesh;
+    for (int j = 0; j <= rows; ++j) {
+        for (int i = 0; i <= columns; ++i) {
+            const float u = float(i) / columns;
+            const float v = float(j) / rows;
+            float su, sv;
+            map(u, v, su, sv);
+            mesh.sourceGrid.push_back(su);
+            mesh.sourceGrid.push_back(sv);
+            mesh.targetGrid.push_back(u * 2 - 1);
+            mesh.targetGrid.push_back(v * 2 - 1);
+        }
+    }
+    for (int j = 0; j < rows; ++j) {
+        for (int i = 0; i < columns; ++i) {
+            const unsigned short v00 = (unsigned short)(j * (columns + 1) + i);
+            const unsigned short v10 = (unsigned short)(v00 + 1);
+            const unsigned short v01 = (unsigned short)(v00 + columns + 1);
+            const unsigned short v11 = (unsigned short)(v01 + 1);
+            mesh.indices.insert(mesh.indices.end(), { v00, v10, v01, v11, v10, v01 });
+        }
+    }
+    return mesh;
+}
+
+WarpMesh MakeUndistortMesh(float k1, float k2, int gridSize)
+{
+    return MakeGridMesh(gridSize, gridSize, [=](float u, float v, float& su, float& sv) {
+        const float dx = u - 0.5f;
+        const float dy = v - 0.5f;
+        const float r2 = dx * dx + dy * dy;
+        const float factor = 1 + k1 * r2 + k2 * r2 * r2;
+        su = 0.5f + dx * factor;
+        sv = 0.5f + dy * factor;
+    });
+}
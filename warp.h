@@ -0,0 +1,74 @@
+#ifndef WARP_H
+#define WARP_H
+
+#include <functional>
+#include <vector>
+
+#include "image.h"
+
+// Cubic is the Keys kernel with a = -0.5 (Catmull-Rom) over a 4x4 footprint.
+// Min and Max take the extreme of the 2x2 footprint Linear would blend.
+enum class Filter { Nearest, Linear, Cubic, Min, Max };
+
+// Hardware uses the texture unit's filter where it can. Manual computes the
+// weights in fp32 in the shader instead of relying on the unit's fixed-point
+// fraction (typically 8 bits), so results do not depend on the GPU. Gather
+// uses the same weights but reads each 2x2 footprint with textureGather, one
+// instruction per channel instead of four texel fetches.
+enum class Sampling { Hardware, Manual, Gather };
+
+// Triangle mesh mapping source texture coordinates ([0, 1], texel edges at
+// i / size) to target clip-space coordinates ([-1, 1]).
+struct WarpMesh
+{
+    std::vector<float> sourceGrid;
+    std::vector<float> targetGrid;
+    std::vector<unsigned short> indices;
+};
+
+// The target is RGBA32F. The GL engine also writes RGBA16F and RGBA8, and
+// R8 holding only the red channel, to cut readback bandwidth; dither adds
+// a 4x4 ordered dither of up to half a step before 8-bit quantization.
+// Bayer mosaic sources are interpolated by the demosaic method at each
+// texel the filter reads, as part of the warp.
+struct WarpJob
+{
+    ImageView source;
+    ImageView target;
+    const WarpMesh* mesh = nullptr;
+    Filter filter = Filter::Nearest;
+    Sampling sampling = Sampling::Hardware;
+    bool dither = false;
+    Demosaic demosaic = Demosaic::Bilinear;
+};
+
+// Common interface of the GL and CPU engines. Run() returns false for jobs
+// the engine cannot execute and leaves the target untouched.
+class WarpEngine
+{
+public:
+    virtual ~WarpEngine() {}
+    virtual bool Run(const WarpJob& job) = 0;
+    virtual const char* Name() const = 0;
+};
+
+// Mesh for an affine warp: the target pixel at normalized coordinate (u, v)
+// samples the source at (m[0] * u + m[1] * v + m[2], m[3] * u + m[4] * v + m[5]).
+WarpMesh MakeAffineMesh(const float m[6]);
+
+// Affine mesh rotating the source about its center by degrees and scaling it
+// by 1 / scale, i.e. scale < 1 magnifies.
+WarpMesh MakeRotationMesh(float degrees, float scale);
+
+// Regular grid of columns x rows cells over the target; map gives the source
+// coordinate (su, sv) of each vertex at normalized target coordinate (u, v).
+// Indices are 16-bit, so grids of more than 65536 vertices are coarsened to
+// fit with about the same aspect ratio.
+WarpMesh MakeGridMesh(int columns, int rows, const std::function<void(float u, float v, float& su, float& sv)>& map);
+
+// Grid mesh removing radial lens distortion: the target pixel at offset d
+// from the center samples the source at center + d * (1 + k1 r^2 + k2 r^4),
+// with r = |d| in normalized coordinates.
+WarpMesh MakeUndistortMesh(float k1, float k2, int gridSize = 16);
+
+#endif
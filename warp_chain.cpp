@@ -0,0 +1,140 @@
+#include <math.h>
+
+#include "warp_chain.h"
+
+using namespace std;
+
+WarpChain& WarpChain::Affine(const float m[6])
+{
+    const double h[9] = { m[0], m[1], m[2], m[3], m[4], m[5], 0, 0, 1 };
+    AddMatrix(h);
+    return *this;
+}
+
+WarpChain& WarpChain::Homography(const float h[9])
+{
+    const double matrix[9] = { h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], h[8] };
+    AddMatrix(matrix);
+    return *this;
+}
+
+WarpChain& WarpChain::Rotate(float degrees, float scale)
+{
+    const double angle = degrees * 3.14159265358979 / 180.0;
+    const double c = scale * cos(angle);
+    const double s = scale * sin(angle);
+    const double h[9] = { c, -s, 0.5 - 0.5 * (c - s), s, c, 0.5 - 0.5 * (s + c), 0, 0, 1 };
+    AddMatrix(h);
+    return *this;
+}
+
+WarpChain& WarpChain::Crop(float x, float y, float w, float h)
+{
+    const double matrix[9] = { w, 0, x, 0, h, y, 0, 0, 1 };
+    AddMatrix(matrix);
+    return *this;
+}
+
+WarpChain& WarpChain::Mesh(const WarpMesh& mesh)
+{
+    Step step;
+    step.matrix = false;
+    step.mesh = mesh;
+    steps.push_back(step);
+    return *this;
+}
+
+WarpChain& WarpChain::Then(const WarpChain& other)
+{
+    for (auto& step : other.steps) {
+        if (step.matrix)
+            AddMatrix(step.h);
+        else
+            steps.push_back(step);
+    }
+    return *this;
+}
+
+// A step added later maps first: the last matrix L followed by h samples
+// L(h(p)), so the product is L * h.
+void WarpChain::AddMatrix(const double h[9])
+{
+    if (steps.empty() || !steps.back().matrix)
+        steps.push_back(Step());
+
+    double* last = steps.back().h;
+    double product[9];
+    for (int row = 0; row < 3; ++row)
+        for (int column = 0; column < 3; ++column)
+            product[row * 3 + column] = last[row * 3] * h[column] + last[row * 3 + 1] * h[3 + column] + last[row * 3 + 2] * h[6 + column];
+    for (int i = 0; i < 9; ++i)
+        last[i] = product[i];
+}
+
+// Barycentric interpolation in the triangle containing (u, v), or else the
+// one it is least outside of.
+void WarpChain::MapMesh(const WarpMesh& mesh, float u, float v, float& su, float& sv)
+{
+    float best = -1e30f;
+    su = u;
+    sv = v;
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        const unsigned short* corners = &mesh.indices[i];
+        float x[3], y[3];
+        for (int k = 0; k < 3; ++k) {
+            x[k] = (mesh.targetGrid[corners[k] * 2] + 1) * 0.5f;
+            y[k] = (mesh.targetGrid[corners[k] * 2 + 1] + 1) * 0.5f;
+        }
+        const float det = (y[1] - y[2]) * (x[0] - x[2]) + (x[2] - x[1]) * (y[0] - y[2]);
+        if (det == 0)
+            continue;
+        const float l0 = ((y[1] - y[2]) * (u - x[2]) + (x[2] - x[1]) * (v - y[2])) / det;
+        const float l1 = ((y[2] - y[0]) * (u - x[2]) + (x[0] - x[2]) * (v - y[2])) / det;
+        const float l2 = 1 - l0 - l1;
+        const float inside = fminf(l0, fminf(l1, l2));
+        if (inside <= best)
+            continue;
+
+        best = inside;
+        su = l0 * mesh.sourceGrid[corners[0] * 2] + l1 * mesh.sourceGrid[corners[1] * 2] + l2 * mesh.sourceGrid[corners[2] * 2];
+        sv = l0 * mesh.sourceGrid[corners[0] * 2 + 1] + l1 * mesh.sourceGrid[corners[1] * 2 + 1] + l2 * mesh.sourceGrid[corners[2] * 2 + 1];
+        if (inside >= 0)
+            return;
+    }
+}
+
+void WarpChain::Map(float u, float v, float& su, float& sv) const
+{
+    double x = u, y = v;
+    for (auto step = steps.rbegin(); step != steps.rend(); ++step) {
+        if (step->matrix) {
+            const double* h = step->h;
+            const double w = h[6] * x + h[7] * y + h[8];
+            const double mappedX = (h[0] * x + h[1] * y + h[2]) / w;
+            y = (h[3] * x + h[4] * y + h[5]) / w;
+            x = mappedX;
+        } else {
+            float mappedX, mappedY;
+            MapMesh(step->mesh, float(x), float(y), mappedX, mappedY);
+            x = mappedX;
+            y = mappedY;
+        }
+    }
+    su = float(x);
+    sv = float(y);
+}
+
+WarpMesh WarpChain::Compose(int gridSize) const
+{
+    if (steps.empty()) {
+        const float identity[6] = { 1, 0, 0, 0, 1, 0 };
+        return MakeAffineMesh(identity);
+    }
+    if (steps.size() == 1 && steps[0].matrix && steps[0].h[6] == 0 && steps[0].h[7] == 0) {
+        const double* h = steps[0].h;
+        const float m[6] = { float(h[0] / h[8]), float(h[1] / h[8]), float(h[2] / h[8]),
+            float(h[3] / h[8]), float(h[4] / h[8]), float(h[5] / h[8]) };
+        return MakeAffineMesh(m);
+    }
+    return MakeGridMesh(gridSize, gridSize, [this](float u, float v, float& su, float& sv) { Map(u, v, su, sv); });
+}
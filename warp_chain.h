@@ -0,0 +1,61 @@
+#ifndef WARP_CHAIN_H
+#define WARP_CHAIN_H
+
+#include <vector>
+
+#include "warp.h"
+
+// Records a sequence of geometric steps and composes them into one mesh, so
+// the whole chain resamples the original source once: fewer passes and no
+// interpolation error compounding between steps. Each step maps the image
+// produced by the steps before it, in normalized coordinates; consecutive
+// affine and projective steps are multiplied into one matrix as they are
+// added, and mesh steps are evaluated through their triangles.
+class WarpChain
+{
+public:
+    // The output pixel at (u, v) samples the step's input at
+    // (m[0] * u + m[1] * v + m[2], m[3] * u + m[4] * v + m[5]).
+    WarpChain& Affine(const float m[6]);
+
+    // As Affine, divided by h[6] * u + h[7] * v + h[8].
+    WarpChain& Homography(const float h[9]);
+
+    // Same mapping as MakeRotationMesh().
+    WarpChain& Rotate(float degrees, float scale);
+
+    // Keeps the normalized rectangle at (x, y) of width w and height h,
+    // stretched to the output.
+    WarpChain& Crop(float x, float y, float w, float h);
+
+    // Any mesh; outside its triangles the nearest one is extended.
+    WarpChain& Mesh(const WarpMesh& mesh);
+
+    // Appends all steps of another chain.
+    WarpChain& Then(const WarpChain& other);
+
+    size_t StepCount() const { return steps.size(); }
+
+    // Source coordinate sampled by the output pixel at (u, v).
+    void Map(float u, float v, float& su, float& sv) const;
+
+    // A chain of affine steps becomes an exact four-vertex mesh; anything
+    // else is sampled at the vertices of a gridSize x gridSize grid, which
+    // the rasterizer interpolates linearly in between.
+    WarpMesh Compose(int gridSize = 32) const;
+
+private:
+    struct Step
+    {
+        bool matrix = true;     // h maps, otherwise mesh does
+        double h[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+        WarpMesh mesh;
+    };
+
+    void AddMatrix(const double h[9]);
+    static void MapMesh(const WarpMesh& mesh, float u, float v, float& su, float& sv);
+
+    std::vector<Step> steps;
+};
+
+#endif